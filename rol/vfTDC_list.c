@@ -32,6 +32,52 @@
 unsigned int BLOCKLEVEL=1;
 #define BUFFERLEVEL 1
 
+/* Adapt the block level to the trigger rate: measured at sync events,
+   applied at the next Prestart
+   - Comment out to keep a fixed block level
+*/
+/* #define ADAPTIVE_BLOCKLEVEL */
+
+/* Check at sync events that all modules are reading the same events
+   - Comment out to disable
+*/
+/* #define CONSISTENCY_CHECK */
+
+/* Skip the vfTDC clock setup if already done by a previous download
+   (clock source unchanged and running)
+   - Comment out for a full initialization at each download
+*/
+/* #define WARM_RESTART */
+
+/* Read the vfTDC settings from a configuration file, instead of the
+   values in rocDownload
+   - Comment out to use the values in rocDownload
+*/
+/* #define VFTDC_CONFIG_FILE "vfTDC.cnf" */
+
+/* Fill online histograms of the hits, and publish them with the scalers,
+   rates and errors in shared memory for monitoring programs (vfTDCShmRead)
+   - Comment out to disable
+*/
+/* #define ONLINE_MONITOR */
+
+/* Alarm if triggers are not read out within 2 seconds
+   - Comment out to disable
+*/
+/* #define READOUT_WATCHDOG */
+
+/* Keep only the hits within a narrower software window of the trigger
+   than the hardware window
+   - Comment out to keep all hits
+*/
+/* #define SOFT_WINDOW */
+
+/* Remove the hits of noisy or dead channels, and limit the number of
+   hits per channel in an event
+   - Comment out to keep all hits
+*/
+/* #define CHANNEL_FILTER */
+
 /* Redefine tsCrate according to TI_MASTER or TI_SLAVE */
 #ifdef TI_SLAVE
 int tsCrate=0;
@@ -44,6 +90,10 @@ int tsCrate=1;
 /* function prototype */
 void rocTrigger(int arg);
 
+/* Readout list message codes (vfTDCLogRegister) */
+static int rolLogNoData   = -1;
+static int rolLogNotReady = -1;
+
 /****************************************
  *  DOWNLOAD
  ****************************************/
@@ -112,14 +162,74 @@ rocDownload()
   extern unsigned int vfTDCA32Base;
 
   vfTDCA32Base=0x09000000;
+  int useConfigFile = 0;
+#ifdef VFTDC_CONFIG_FILE
+  struct vftdc_config_struct tdcConfig;
+  if(vfTDCConfigRead(VFTDC_CONFIG_FILE, &tdcConfig) == OK)
+    {
+      useConfigFile = 1;
+      if(tdcConfig.a32Base)
+	vfTDCA32Base = tdcConfig.a32Base;
+    }
+  else
+    printf("rocDownload: ERROR reading %s.  Using the values in rocDownload.\n",
+	   VFTDC_CONFIG_FILE);
+#endif
   vfTDCInit(14<<19, 1<<19, 1, 
 	    VFTDC_INIT_VXS_SYNCRESET |
 	    VFTDC_INIT_VXS_TRIG      |
-	    VFTDC_INIT_VXS_CLKSRC);
+	    VFTDC_INIT_VXS_CLKSRC
+#ifdef WARM_RESTART
+	    | VFTDC_INIT_WARM_RESTART
+#endif
+	    );
+
+  if(useConfigFile)
+    {
+#ifdef VFTDC_CONFIG_FILE
+      /* Only registers that differ from the file are written */
+      vfTDCConfigApply(&tdcConfig);
+#endif
+    }
+  else
+    {
+      int window_width   = 250; /* 250 = 250*4ns = 1000ns */
+      int window_latency = 100; /* 100 = 100*4ns =  400ns */
+      vfTDCSetWindowParamters(0, window_latency, window_width);
+    }
+
+#ifdef SOFT_WINDOW
+  /* All channels: 100ns to 500ns after the trigger (steps of 4ns) */
+  vfTDCSetSoftWindow(0, -1, 25, 100);
+#endif
+
+#ifdef CHANNEL_FILTER
+  {
+    /* One bit per channel (group*32 + channel), e.g. mask channel 0/7 */
+    unsigned int chanmask[VFTDC_CHANMASK_WORDS] = {1<<7, 0, 0, 0, 0, 0};
+    vfTDCSetChannelMask(0, chanmask);
+    /* At most 8 hits per channel in an event */
+    vfTDCSetMultiplicityCap(0, -1, 8);
+  }
+#endif
+
+  /* Format readout messages in the background, at most 10 per second of each kind */
+  rolLogNoData   = vfTDCLogRegister("rocTrigger: No vfTDC data or error.  dCnt = %d\n");
+  rolLogNotReady = vfTDCLogRegister("rocTrigger: Data not ready in vfTDC.\n");
+  vfTDCLogStart(10);
 
-  int window_width   = 250; /* 250 = 250*4ns = 1000ns */
-  int window_latency = 100; /* 100 = 100*4ns =  400ns */
-  vfTDCSetWindowParamters(0, window_latency, window_width);
+#ifdef ONLINE_MONITOR
+  /* Publish scalers, rates, errors and the online histograms once per
+     second, for monitoring programs (vfTDCShmRead) */
+  vfTDCHistInit();
+  vfTDCShmStart(NULL, 1000);
+#endif
+
+#ifdef ADAPTIVE_BLOCKLEVEL
+  /* Blocklevel 1 - 32, readout may use up to 50% of the CPU,
+     raise the blocklevel if more than 4 blocks are waiting */
+  vfTDCBlockLevelControlConfig(VFTDC_BLCTRL_APPLY, 1, 32, 0.5, 4);
+#endif
 
   vfTDCStatus(0,0);
 
@@ -140,6 +250,17 @@ rocPrestart()
   int stat;
   int islot;
 
+#ifdef ADAPTIVE_BLOCKLEVEL
+  {
+    /* Block level recommended during the previous run, if any */
+    int blkLevel = vfTDCBlockLevelControlApply();
+#ifdef TI_MASTER
+    if(blkLevel > 0)
+      tiSetBlockLevel(blkLevel);
+#endif
+  }
+#endif
+
   vfTDCStatus(0,0);
   tiStatus(0);
 
@@ -164,6 +285,14 @@ rocGo()
   /* Use this info to change block level is all modules */
   vfTDCSetBlockLevel(0, BLOCKLEVEL);
 
+  /* Start live time accounting for this run, sampled once per second */
+  vfTDCLiveStart(1000);
+
+#ifdef READOUT_WATCHDOG
+  /* Alarm if triggers are not read out within 2 seconds */
+  vfTDCWatchdogStart(2000, VFTDC_WATCHDOG_ALARM);
+#endif
+
 
 
 }
@@ -177,9 +306,16 @@ rocEnd()
 
   int islot;
 
+#ifdef READOUT_WATCHDOG
+  vfTDCWatchdogStop();
+#endif
+
   vfTDCStatus(0,0);
   tiStatus(0);
 
+  vfTDCLiveStop();
+  vfTDCLivePrint();
+
   printf("rocEnd: Ended after %d blocks\n",tiGetIntCount());
   
 }
@@ -192,6 +328,9 @@ rocTrigger(int arg)
 {
   int ii, islot;
   int stat, dCnt, len=0, idata, blkReady=0,timeout=0;
+  int maxwords, room, rflag;
+  struct vftdc_readout_result tdcResult;
+  struct vftdc_buffer_struct tdcBuf;
 
   tiSetOutputPort(1,0,0,0);
 
@@ -224,22 +363,66 @@ rocTrigger(int arg)
 
   if(timeout>=100)
     {
-      printf("%s: Data not ready in vfTDC.\n",__FUNCTION__);
+      vfTDCLogEnqueue(rolLogNotReady,0,0,0);
       return;
     }
 
-  /* e.g. Max number of words = Blocklevel * (10 hits per channel + 10 other words) */
-  dCnt = vfTDCReadBlock(0,dma_dabufp,BLOCKLEVEL*(10*192+10),1);
+  /* e.g. Max number of words = Blocklevel * (10 hits per channel + 10 other words),
+     but no more than the room left in the event buffer.
+     The DMA is programmed for the size of recent blocks (VFTDC_READOUT_TIGHT),
+     and continued up to the max if this block is larger.
+     After a DMA error, the rest of the block is drained (VFTDC_READOUT_AUTORECOVER).
+     The block is read directly into the event, without filler words to
+     align it (VFTDC_READOUT_ALIGNED is for scratch buffers).
+     Hits are added to the online histograms (VFTDC_READOUT_HISTOGRAM) */
+  maxwords = BLOCKLEVEL*(10*192+10);
+  room = (MAX_EVENT_LENGTH>>2) - (int)(dma_dabufp - the_event->data);
+  if(maxwords > room)
+    maxwords = room;
+  rflag = 1|VFTDC_READOUT_TIGHT|VFTDC_READOUT_AUTORECOVER;
+#ifdef ONLINE_MONITOR
+  rflag |= VFTDC_READOUT_HISTOGRAM;
+#endif
+  dCnt = vfTDCReadBlockResult(0,dma_dabufp,maxwords,rflag,&tdcResult);
   if(dCnt<=0)
     {
-      printf("%s: No vfTDC data or error.  dCnt = %d\n",__FUNCTION__,dCnt);
+      vfTDCLogEnqueue(rolLogNoData,dCnt,0,0);
     }
   else
     {
+      tdcBuf.data   = dma_dabufp;
+      tdcBuf.nwords = dCnt;
+      tdcBuf.order  = tdcResult.order;
+#ifdef SOFT_WINDOW
+      /* Remove the hits outside of the software window */
+      dCnt = vfTDCSoftWindowApply(dma_dabufp, dCnt, vfTDCBufferDecodeFlag(&tdcBuf));
+#endif
+#ifdef CHANNEL_FILTER
+      /* Remove the hits of masked channels, and over the cap */
+      dCnt = vfTDCFilterApply(dma_dabufp, dCnt, vfTDCBufferDecodeFlag(&tdcBuf));
+#endif
       dma_dabufp += dCnt;
     }
   BANKCLOSE;
 
+#ifdef CONSISTENCY_CHECK
+  if(tiGetSyncEventFlag())
+    {
+      /* Check that all modules are reading the same events.
+	 The first divergent slot, if any, is logged. */
+      vfTDCCheckConsistency(NULL, BLOCKLEVEL);
+    }
+#endif
+
+#ifdef ADAPTIVE_BLOCKLEVEL
+  if(tiGetSyncEventFlag())
+    {
+      /* Measure, and recommend a block level for the next run.
+	 It is applied in Prestart, never while blocks are being built. */
+      vfTDCBlockLevelControlSyncEvent(BLOCKLEVEL);
+    }
+#endif
+
   tiSetOutputPort(0,0,0,0);
 
 }
@@ -250,5 +433,11 @@ rocCleanup()
   int islot=0;
 
   printf("%s: Reset all FADCs\n",__FUNCTION__);
+
+#ifdef ONLINE_MONITOR
+  vfTDCShmStop();
+  vfTDCHistFree();
+#endif
+  vfTDCLogStop();
   
 }
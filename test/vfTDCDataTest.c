@@ -0,0 +1,815 @@
+/*
+ * File:
+ *    vfTDCDataTest.c
+ *
+ * Description:
+ *    Test the vfTDC Library processing of read out data, without
+ *    hardware, on hand built blocks.
+ *
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "jvme.h"
+#include "vfTDCLib.h"
+
+/* Registers of a module that is not there, for the settings that read them */
+extern volatile struct vfTDC_struct *TDCp[];
+static struct vfTDC_struct fakeTDC;
+
+#define TEST_SLOT     14
+#define TEST_LATENCY  100
+#define MAXWORDS      1024
+#define MAXHITS       1024
+#define NBIGBLOCKS    400   /* Blocks of up to 32 words and 9 hits */
+
+static int nerrors = 0;
+
+#define CHECK(_cond,_what)						\
+  if(!(_cond)) { printf("%s: FAIL: %s\n",__FUNCTION__,_what); nerrors++; }
+
+/* Append a block to buf, in host order: nevents events, each with the
+   nhits hits (group*32 + channel, coarse time) of chan and coarse.
+   A filler is added when the block has an odd number of words.
+   Returns the number of words added. */
+static int
+putBlock(unsigned int *buf, int slot, int blk, int nevents, int nhits,
+	 const int *chan, const int *coarse)
+{
+  int n=0, ievt, ihit;
+
+  buf[n++] = 0x80000000 | (slot<<22) | ((blk & 0x3FF)<<8) | nevents;
+  for(ievt=0; ievt<nevents; ievt++)
+    {
+      buf[n++] = 0x90000000 | (slot<<22) | (blk*nevents + ievt);
+      buf[n++] = 0x98000000 | 0x123;
+      buf[n++] = 0x456;
+      for(ihit=0; ihit<nhits; ihit++)
+	buf[n++] = 0xB8000000 | (chan[ihit]<<19) | (coarse[ihit]<<8);
+    }
+  buf[n] = 0x88000000 | (slot<<22) | (n+1);
+  n++;
+  if(n & 1)
+    buf[n++] = VFTDC_DUMMY_DATA;
+
+  return n;
+}
+
+/* Host to VME (readout) byte order */
+static void
+toVme(unsigned int *buf, int nwords)
+{
+  int iword;
+
+  for(iword=0; iword<nwords; iword++)
+    buf[iword] = LSWAP(buf[iword]);
+}
+
+/* Compare a filtered buffer with the expected one (both in VME order) */
+static int
+sameData(unsigned int *data, int nwords, unsigned int *expect, int nexpect)
+{
+  int iword;
+
+  if(nwords != nexpect)
+    {
+      printf("  %d words, expected %d\n",nwords,nexpect);
+      return 0;
+    }
+
+  for(iword=0; iword<nwords; iword++)
+    {
+      if(data[iword] != expect[iword])
+	{
+	  printf("  word %d: 0x%08x, expected 0x%08x\n",
+		 iword,LSWAP(data[iword]),LSWAP(expect[iword]));
+	  return 0;
+	}
+    }
+
+  return 1;
+}
+
+/*************************************************************
+ Block decoding (vfTDCDecodeBlock, vfTDCDecodeParallel)
+*************************************************************/
+
+static void
+testDecode()
+{
+  unsigned int data[MAXWORDS], *big;
+  struct vftdc_data_struct hits[MAXHITS], *shits, *phits;
+  int n, nbig, nhits, nphits, iblk, ithr, ihit, ok;
+  const int chan[3]    = { 1, 35, 191 };
+  const int coarse[3]  = { 10, 20, 1023 };
+  const int nthreads[4] = { 1, 2, 4, 7 };
+
+  /* End of a previous block, then two blocks of two slots */
+  data[0] = 0xB8000000 | (2<<19) | (30<<8);
+  data[1] = 0x88000000 | (TEST_SLOT<<22) | 20;
+  n = 2;
+  n += putBlock(&data[n], TEST_SLOT, 1, 2, 3, chan, coarse);
+  n += putBlock(&data[n], 3, 2, 1, 2, chan, coarse);
+  toVme(data, n);
+
+  nhits = vfTDCDecodeBlock(data, n, VFTDC_DECODE_SWAP, hits, MAXHITS);
+  CHECK(nhits == 9, "number of hits");
+  if(nhits != 9)
+    return;
+
+  /* The hit before the first block header has no context */
+  CHECK((hits[0].slot_id_hd == 0) && (hits[0].time_coarse == 30) &&
+	(hits[0].chan == 2), "hit before the first block");
+
+  ok = 1;
+  for(ihit=1; ihit<nhits; ihit++)
+    {
+      if((hits[ihit].slot_id_hd != ((ihit < 7) ? TEST_SLOT : 3)) ||
+	 (hits[ihit].blk_num != ((ihit < 7) ? 1 : 2)) ||
+	 (hits[ihit].evt_num_1 != ((ihit < 4) ? 2 : ((ihit < 7) ? 3 : 2))) ||
+	 (hits[ihit].time_1 != 0x123) || (hits[ihit].time_2 != 0x456) ||
+	 ((hits[ihit].group<<5 | hits[ihit].chan) != chan[(ihit-1) % 3]) ||
+	 (hits[ihit].time_coarse != coarse[(ihit-1) % 3]))
+	ok = 0;
+    }
+  CHECK(ok, "hit context");
+
+  CHECK(vfTDCDecodeBlock(data, n, VFTDC_DECODE_SWAP, hits, 4) == 4,
+	"hits array full");
+
+  /* Host order */
+  toVme(data, n);
+  CHECK(vfTDCDecodeBlock(data, n, 0, hits, MAXHITS) == 9, "host order");
+
+  /* Many blocks of different sizes: the parallel decode must give the
+     hits of the serial decode, in the same order */
+  big = (unsigned int *)malloc(NBIGBLOCKS*32*sizeof(unsigned int));
+  shits = (struct vftdc_data_struct *)
+    malloc(NBIGBLOCKS*9*sizeof(struct vftdc_data_struct));
+  if((big == NULL) || (shits == NULL))
+    {
+      printf("%s: ERROR: Unable to allocate memory\n",__FUNCTION__);
+      nerrors++;
+      if(big) free(big);
+      if(shits) free(shits);
+      return;
+    }
+
+  big[0] = data[0];
+  nbig = 1;
+  for(iblk=0; iblk<NBIGBLOCKS; iblk++)
+    nbig += putBlock(&big[nbig], 1 + (iblk % 20), iblk, 1 + (iblk % 3),
+		     iblk % 4, chan, coarse);
+  toVme(big, nbig);
+
+  nhits = vfTDCDecodeBlock(big, nbig, VFTDC_DECODE_SWAP, shits, NBIGBLOCKS*9);
+
+  for(ithr=0; ithr<4; ithr++)
+    {
+      nphits = vfTDCDecodeParallel(big, nbig, VFTDC_DECODE_SWAP,
+				   nthreads[ithr], &phits);
+      if((nphits != nhits) || (phits == NULL) ||
+	 (memcmp(phits, shits, nhits*sizeof(struct vftdc_data_struct)) != 0))
+	{
+	  printf("%s: FAIL: %d threads: %d hits, serial %d\n",
+		 __FUNCTION__,nthreads[ithr],nphits,nhits);
+	  nerrors++;
+	}
+      if(phits)
+	free(phits);
+    }
+
+  free(big);
+  free(shits);
+}
+
+/*************************************************************
+ Byte swapping (vfTDCSwapBuffer, vfTDCBufferToHost)
+*************************************************************/
+
+static void
+testSwap()
+{
+  unsigned int src[80], dst[80], expect[80];
+  struct vftdc_buffer_struct buf;
+  int off, nwords, iword, ok=1;
+
+  for(iword=0; iword<80; iword++)
+    src[iword] = 0x01020304 * (iword+1) + 0x8040a0f0;
+
+  /* Every length around the vector sizes, from aligned and unaligned
+     addresses; the words after nwords are not touched */
+  for(off=0; off<4; off++)
+    {
+      for(nwords=0; nwords<=67; nwords++)
+	{
+	  memset(dst, 0xA5, sizeof(dst));
+	  memset(expect, 0xA5, sizeof(expect));
+	  for(iword=0; iword<nwords; iword++)
+	    expect[off+iword] = LSWAP(src[off+iword]);
+
+	  if((vfTDCSwapBuffer(&dst[off], &src[off], nwords) != OK) ||
+	     (memcmp(dst, expect, sizeof(dst)) != 0))
+	    {
+	      printf("  offset %d, %d words\n",off,nwords);
+	      ok = 0;
+	    }
+
+	  /* In place */
+	  memcpy(dst, src, sizeof(dst));
+	  memcpy(expect, src, sizeof(expect));
+	  for(iword=0; iword<nwords; iword++)
+	    expect[off+iword] = LSWAP(src[off+iword]);
+
+	  if((vfTDCSwapBuffer(&dst[off], &dst[off], nwords) != OK) ||
+	     (memcmp(dst, expect, sizeof(dst)) != 0))
+	    {
+	      printf("  in place: offset %d, %d words\n",off,nwords);
+	      ok = 0;
+	    }
+	}
+    }
+  CHECK(ok, "swapped words");
+
+  CHECK(vfTDCSwapBuffer(dst, src, -1) == ERROR, "negative size");
+
+  /* The buffer is only swapped when its order changes */
+  memcpy(dst, src, sizeof(dst));
+  buf.data   = dst;
+  buf.nwords = 80;
+  buf.order  = VFTDC_ORDER_VME;
+  CHECK(vfTDCBufferDecodeFlag(&buf) == VFTDC_DECODE_SWAP, "VME order flag");
+
+  vfTDCBufferToHost(&buf);
+  vfTDCBufferToHost(&buf);
+  CHECK((buf.order == VFTDC_ORDER_HOST) && (dst[5] == LSWAP(src[5])) &&
+	(dst[79] == LSWAP(src[79])), "to host once");
+  CHECK(vfTDCBufferDecodeFlag(&buf) == 0, "host order flag");
+
+  vfTDCBufferToVME(&buf);
+  vfTDCBufferToVME(&buf);
+  CHECK((buf.order == VFTDC_ORDER_VME) &&
+	(memcmp(dst, src, sizeof(dst)) == 0), "back to VME once");
+}
+
+/*************************************************************
+ Table driven decoder against the word type switch it replaces
+*************************************************************/
+
+/* Decoder of vfTDCDecodeBlock before the table dispatch */
+static int
+refDecode(unsigned int *data, int nwords, int dflag,
+	  struct vftdc_data_struct *hits, int maxhits)
+{
+  struct vftdc_data_struct cur;
+  unsigned int word;
+  int iword, nhits=0;
+
+  memset((char *)&cur, 0, sizeof(cur));
+  cur.type = VFTDC_TYPE_FILLER;
+
+  for(iword=0; iword<nwords; iword++)
+    {
+      word = (dflag & VFTDC_DECODE_SWAP) ? LSWAP(data[iword]) : data[iword];
+
+      if(word & VFTDC_DATA_TYPE_DEFINE)
+	{
+	  cur.new_type = 1;
+	  cur.type = (word & VFTDC_DATA_TYPE_MASK) >> 27;
+	}
+      else
+	cur.new_type = 0;
+
+      switch(cur.type)
+	{
+	case VFTDC_TYPE_BLOCK_HEADER:
+	  memset((char *)&cur, 0, sizeof(cur));
+	  cur.new_type   = 1;
+	  cur.type       = VFTDC_TYPE_BLOCK_HEADER;
+	  cur.slot_id_hd = (word & 0x7C00000) >> 22;
+	  cur.modID      = (word & 0x3C0000) >> 18;
+	  cur.blk_num    = (word & 0x3FF00) >> 8;
+	  cur.n_evts     = (word & 0xFF);
+	  break;
+
+	case VFTDC_TYPE_BLOCK_TRAILER:
+	  cur.slot_id_tr = (word & 0x7C00000) >> 22;
+	  cur.n_words    = (word & 0x3FFFFF);
+	  break;
+
+	case VFTDC_TYPE_EVENT_HEADER:
+	  cur.slot_id_evh = (word & 0x7C00000) >> 22;
+	  cur.evt_num_1   = (word & 0x3FFFFF);
+	  break;
+
+	case VFTDC_TYPE_TRIGGER_TIME:
+	  if(cur.new_type)
+	    {
+	      cur.time_1   = (word & 0x7FFFFFF);
+	      cur.time_now = 1;
+	    }
+	  else if(cur.time_now == 1)
+	    {
+	      cur.time_2   = (word & 0xFFFFFF);
+	      cur.time_now = 2;
+	    }
+	  break;
+
+	case VFTDC_TYPE_TDC_HIT:
+	  if(nhits >= maxhits)
+	    return nhits;
+
+	  cur.group       = (word & 0x07000000) >> 24;
+	  cur.chan        = (word & 0x00f80000) >> 19;
+	  cur.edge_type   = (word & 0x00040000) >> 18;
+	  cur.time_coarse = (word & 0x0003ff00) >> 8;
+	  cur.two_ns      = (word & 0x00000080) >> 7;
+	  cur.time_fine   = (word & 0x0000007f);
+	  hits[nhits++] = cur;
+	  break;
+
+	default:
+	  break;
+	}
+    }
+
+  return nhits;
+}
+
+static void
+testTableDecode()
+{
+  unsigned int data[MAXWORDS];
+  struct vftdc_data_struct hits[MAXWORDS], expect[MAXWORDS];
+  /* Data types of the defining words, hits most often */
+  const unsigned int types[10] = { 0, 1, 2, 3, 3, 7, 7, 7, 14, 15 };
+  int itry, iword, nhits, nexp, maxhits, dflag, ok=1;
+
+  srand(1);
+  for(itry=0; itry<200; itry++)
+    {
+      for(iword=0; iword<MAXWORDS; iword++)
+	{
+	  data[iword] = ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+	  if(rand() & 1)
+	    data[iword] = VFTDC_DATA_TYPE_DEFINE | (types[rand() % 10]<<27) |
+	      (data[iword] & 0x07FFFFFF);
+	  else if(rand() & 1)
+	    data[iword] &= ~VFTDC_DATA_TYPE_DEFINE;
+	}
+
+      /* Every other try: VME order, and the hits array filled up */
+      dflag   = (itry & 1) ? VFTDC_DECODE_SWAP : 0;
+      maxhits = (itry & 2) ? (itry % 50) : MAXWORDS;
+
+      nexp  = refDecode(data, MAXWORDS, dflag, expect, maxhits);
+      nhits = vfTDCDecodeBlock(data, MAXWORDS, dflag, hits, maxhits);
+      if((nhits != nexp) ||
+	 (memcmp(hits, expect, nexp*sizeof(struct vftdc_data_struct)) != 0))
+	{
+	  printf("  try %d: %d hits, expected %d\n",itry,nhits,nexp);
+	  ok = 0;
+	}
+    }
+  CHECK(ok, "random words");
+}
+
+/*************************************************************
+ Software trigger window (vfTDCSoftWindowApply)
+*************************************************************/
+
+static void
+testSoftWindow()
+{
+  unsigned int data[MAXWORDS], expect[MAXWORDS];
+  int n, nexp, rval;
+  /* Window of 10 steps, 20 before the trigger: coarse 80 to 89 are kept.
+     A block of one event has 5 words plus its hits. */
+  const int chan[4]     = { 1, 2, 35, 191 };
+  const int coarse[4]   = { 79, 80, 89, 90 };
+  const int chanIn[2]   = { 2, 35 };
+  const int coarseIn[2] = { 80, 89 };
+  const int chan3[3]    = { 1, 2, 3 };
+  const int coarse3[3]  = { 80, 85, 100 };
+  const int coarse1[4]  = { 79, 85, 90, 95 };
+
+  vfTDCSetSoftWindow(TEST_SLOT, -1, -20, 10);
+
+  /* 8 words, 2 of 3 hits kept: 7 words, a filler is added */
+  n    = putBlock(data, TEST_SLOT, 1, 1, 3, chan3, coarse3);
+  nexp = putBlock(expect, TEST_SLOT, 1, 1, 2, chan3, coarse3);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCSoftWindowApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "odd result");
+
+  /* 9 words and a filler, 1 of 4 hits kept: 6 words, the filler goes */
+  n    = putBlock(data, TEST_SLOT, 2, 1, 4, chan, coarse1);
+  nexp = putBlock(expect, TEST_SLOT, 2, 1, 1, &chan[1], &coarse1[1]);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCSoftWindowApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "even result");
+
+  /* No hits kept */
+  n    = putBlock(data, TEST_SLOT, 3, 2, 1, chan, coarse);
+  nexp = putBlock(expect, TEST_SLOT, 3, 2, 0, NULL, NULL);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCSoftWindowApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "all hits removed");
+
+  /* Leading fillers, then several blocks in the buffer */
+  data[0] = VFTDC_DUMMY_DATA;
+  data[1] = VFTDC_DUMMY_DATA;
+  n = 2;
+  n += putBlock(&data[n], TEST_SLOT, 4, 2, 4, chan, coarse);
+  n += putBlock(&data[n], TEST_SLOT, 5, 1, 4, chan, coarse1);
+  n += putBlock(&data[n], TEST_SLOT, 6, 2, 2, chanIn, coarseIn);
+  expect[0] = VFTDC_DUMMY_DATA;
+  expect[1] = VFTDC_DUMMY_DATA;
+  nexp = 2;
+  nexp += putBlock(&expect[nexp], TEST_SLOT, 4, 2, 2, chanIn, coarseIn);
+  nexp += putBlock(&expect[nexp], TEST_SLOT, 5, 1, 1, &chan[1], &coarse1[1]);
+  nexp += putBlock(&expect[nexp], TEST_SLOT, 6, 2, 2, chanIn, coarseIn);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCSoftWindowApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "leading fillers, several blocks");
+
+  /* Other slots are not filtered */
+  n    = putBlock(data, TEST_SLOT+1, 7, 1, 4, chan, coarse);
+  memcpy(expect, data, n*sizeof(unsigned int));
+  toVme(data, n); toVme(expect, n);
+  rval = vfTDCSoftWindowApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, n), "other slot");
+
+  vfTDCDisableSoftWindow(TEST_SLOT);
+}
+
+/*************************************************************
+ Channel mask and multiplicity cap (vfTDCFilterApply)
+*************************************************************/
+
+static void
+testFilter()
+{
+  unsigned int data[MAXWORDS], expect[MAXWORDS];
+  unsigned int mask[VFTDC_CHANMASK_WORDS], masked0, capped0, masked, capped;
+  int n, nexp, rval;
+  /* Channels 3 and 191 masked, channel 5 capped at 2 hits per event.
+     The filter does not look at the time. */
+  const int coarse[7]   = { 50, 50, 50, 50, 50, 50, 50 };
+  const int chanOdd[4]  = { 3, 5, 5, 5 };
+  const int chanEven[5] = { 3, 3, 5, 5, 5 };
+  const int chanCap[3]  = { 5, 5, 5 };
+  const int chanMix[6]  = { 3, 5, 5, 5, 7, 191 };
+  const int chanMask[2] = { 3, 191 };
+  const int chanKept[3] = { 5, 5, 7 };
+
+  memset(mask, 0, sizeof(mask));
+  mask[0] = 1<<3;
+  mask[5] = 1<<31;
+  vfTDCSetChannelMask(TEST_SLOT, mask);
+  vfTDCSetMultiplicityCap(TEST_SLOT, 5, 2);
+  vfTDCGetFilterCounts(TEST_SLOT, &masked0, &capped0);
+
+  /* 9 words and a filler, 2 of 4 hits kept: 7 words and the filler */
+  n    = putBlock(data, TEST_SLOT, 1, 1, 4, chanOdd, coarse);
+  nexp = putBlock(expect, TEST_SLOT, 1, 1, 2, chanCap, coarse);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCFilterApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "odd result");
+
+  /* 10 words, 2 of 5 hits kept: 7 words, a filler is added */
+  n    = putBlock(data, TEST_SLOT, 2, 1, 5, chanEven, coarse);
+  nexp = putBlock(expect, TEST_SLOT, 2, 1, 2, chanCap, coarse);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCFilterApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "filler added");
+
+  /* 11 words and a filler, 3 of 6 hits kept: 8 words, the filler goes */
+  n    = putBlock(data, TEST_SLOT, 3, 1, 6, chanMix, coarse);
+  nexp = putBlock(expect, TEST_SLOT, 3, 1, 3, chanKept, coarse);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCFilterApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "even result");
+
+  /* No hits kept */
+  n    = putBlock(data, TEST_SLOT, 4, 2, 2, chanMask, coarse);
+  nexp = putBlock(expect, TEST_SLOT, 4, 2, 0, NULL, NULL);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCFilterApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "all hits removed");
+
+  /* Leading filler, then several blocks; the cap counts per event */
+  data[0] = VFTDC_DUMMY_DATA;
+  n = 1;
+  n += putBlock(&data[n], TEST_SLOT, 5, 3, 3, chanCap, coarse);
+  n += putBlock(&data[n], TEST_SLOT, 6, 2, 6, chanMix, coarse);
+  n += putBlock(&data[n], TEST_SLOT, 7, 1, 5, chanEven, coarse);
+  expect[0] = VFTDC_DUMMY_DATA;
+  nexp = 1;
+  nexp += putBlock(&expect[nexp], TEST_SLOT, 5, 3, 2, chanCap, coarse);
+  nexp += putBlock(&expect[nexp], TEST_SLOT, 6, 2, 3, chanKept, coarse);
+  nexp += putBlock(&expect[nexp], TEST_SLOT, 7, 1, 2, chanCap, coarse);
+  toVme(data, n); toVme(expect, nexp);
+  rval = vfTDCFilterApply(data, n, VFTDC_DECODE_SWAP);
+  CHECK(sameData(data, rval, expect, nexp), "leading filler, several blocks");
+
+  /* Hits removed: 1+2+2+4+0+4+2 masked, and 1+1+1+0+3+2+1 over the cap */
+  vfTDCGetFilterCounts(TEST_SLOT, &masked, &capped);
+  CHECK((masked - masked0 == 15) && (capped - capped0 == 9), "removed hit counts");
+
+  vfTDCSetChannelMask(TEST_SLOT, NULL);
+  vfTDCSetMultiplicityCap(TEST_SLOT, -1, 0);
+}
+
+/*************************************************************
+ Event decoding into an arena (vfTDCDecodeEvents)
+*************************************************************/
+
+static void
+testDecodeEvents()
+{
+  unsigned int data[MAXWORDS];
+  char mem[4096];
+  struct vftdc_arena_struct arena;
+  struct vftdc_event_struct *events, *first;
+  int n, nevents, ievt, ihit, ok;
+  const int chan[3]   = { 1, 35, 191 };
+  const int coarse[3] = { 10, 20, 1023 };
+  /* Expected events: slot, block, event number, hits */
+  const int slot[4]   = { TEST_SLOT, TEST_SLOT, TEST_SLOT, 3 };
+  const int blk[4]    = { 1, 1, 2, 3 };
+  const int evt[4]    = { 2, 3, 2, 3 };
+  const int nhits[4]  = { 3, 3, 0, 2 };
+
+  /* Leading filler, blocks of two slots, one event without hits */
+  data[0] = VFTDC_DUMMY_DATA;
+  n = 1;
+  n += putBlock(&data[n], TEST_SLOT, 1, 2, 3, chan, coarse);
+  n += putBlock(&data[n], TEST_SLOT, 2, 1, 0, NULL, NULL);
+  n += putBlock(&data[n], 3, 3, 1, 2, chan, coarse);
+  toVme(data, n);
+
+  /* Memory not aligned */
+  CHECK(vfTDCArenaInit(&arena, &mem[1], sizeof(mem)-1) == OK, "arena init");
+  CHECK(((unsigned long)arena.base & 7) == 0, "arena alignment");
+
+  nevents = vfTDCDecodeEvents(data, n, VFTDC_DECODE_SWAP, &arena, &events);
+  CHECK(nevents == 4, "number of events");
+  if(nevents != 4)
+    return;
+
+  ok = 1;
+  for(ievt=0; ievt<nevents; ievt++)
+    {
+      if((events[ievt].slot != slot[ievt]) ||
+	 (events[ievt].blk_num != blk[ievt]) ||
+	 (events[ievt].evt_num != evt[ievt]) ||
+	 (events[ievt].time_1 != 0x123) || (events[ievt].time_2 != 0x456) ||
+	 (events[ievt].nhits != nhits[ievt]))
+	ok = 0;
+
+      /* The hits of the events follow each other */
+      if((ievt > 0) &&
+	 (events[ievt].hits != events[ievt-1].hits + events[ievt-1].nhits))
+	ok = 0;
+
+      for(ihit=0; ihit<events[ievt].nhits; ihit++)
+	{
+	  if((events[ievt].hits[ihit].slot != slot[ievt]) ||
+	     (events[ievt].hits[ihit].chan != chan[ihit]) ||
+	     (VFTDC_HIT_GROUP(events[ievt].hits[ihit].chan) != chan[ihit]>>5) ||
+	     (VFTDC_HIT_TIME_COARSE(events[ievt].hits[ihit].time) != coarse[ihit]))
+	    ok = 0;
+	}
+    }
+  CHECK(ok, "events and hits");
+
+  /* After a reset, the same memory is used again */
+  first = events;
+  vfTDCArenaReset(&arena);
+  nevents = vfTDCDecodeEvents(data, n, VFTDC_DECODE_SWAP, &arena, &events);
+  CHECK((nevents == 4) && (events == first), "arena reset");
+
+  /* Room for the events, not for all of the hits */
+  vfTDCArenaInit(&arena, mem, 4*sizeof(struct vftdc_event_struct) +
+		 4*sizeof(struct vftdc_hit_struct));
+  CHECK(vfTDCDecodeEvents(data, n, VFTDC_DECODE_SWAP, &arena, &events) == ERROR,
+	"arena full");
+
+  CHECK(vfTDCArenaInit(&arena, mem, 4) == ERROR, "arena too small");
+}
+
+/*************************************************************
+ Online histograms (vfTDCHistFill, vfTDCHistSwap)
+*************************************************************/
+
+static void
+testHist()
+{
+  unsigned int data[MAXWORDS];
+  struct vftdc_hist_struct *h;
+  int n;
+  const int chan[3]   = { 1, 35, 191 };
+  const int coarse[3] = { 10, 20, 1023 };
+
+  CHECK(vfTDCHistFill(TEST_SLOT, data, 0) == ERROR, "not initialized");
+  if(vfTDCHistInit() != OK)
+    {
+      nerrors++;
+      return;
+    }
+
+  /* A: 1 block, 3 hits */
+  n = putBlock(data, TEST_SLOT, 1, 1, 3, chan, coarse);
+  toVme(data, n);
+  vfTDCHistFill(TEST_SLOT, data, n);
+
+  /* The readout has not changed sets yet */
+  CHECK(vfTDCHistSwap(0) == NULL, "first swap pending");
+
+  /* B: 1 block, 4 hits, filled after the slot changed sets */
+  n = putBlock(data, TEST_SLOT, 2, 2, 2, chan, coarse);
+  toVme(data, n);
+  vfTDCHistFill(TEST_SLOT, data, n);
+
+  h = vfTDCHistSwap(0);
+  CHECK((h != NULL) && (h[TEST_SLOT].nblocks == 1) &&
+	(h[TEST_SLOT].nhits == 3) && (h[3].nhits == 0), "only A");
+
+  /* C goes with B; the next swap waits for the readout again */
+  n = putBlock(data, TEST_SLOT, 3, 1, 1, chan, coarse);
+  toVme(data, n);
+  vfTDCHistFill(TEST_SLOT, data, n);
+  CHECK(vfTDCHistSwap(0) == NULL, "second swap pending");
+
+  /* D: the slot changes sets with it, so B and C are completed */
+  vfTDCHistFill(TEST_SLOT, data, n);
+  h = vfTDCHistSwap(0);
+  CHECK((h != NULL) && (h[TEST_SLOT].nblocks == 2) &&
+	(h[TEST_SLOT].nhits == 5) &&
+	(h[TEST_SLOT].occupancy[chan[0]] == 3) &&
+	(h[TEST_SLOT].occupancy[chan[1]] == 2) &&
+	(h[TEST_SLOT].occupancy[chan[2]] == 0), "B and C");
+
+  /* Multiblock readout: the blocks of each slot go to that slot */
+  vfTDCHistInit();
+  n  = putBlock(data, TEST_SLOT, 1, 1, 3, chan, coarse);
+  n += putBlock(&data[n], 3, 1, 2, 2, chan, coarse);
+  n += putBlock(&data[n], TEST_SLOT, 2, 1, 1, chan, coarse);
+  toVme(data, n);
+  vfTDCHistFill(TEST_SLOT, data, n);
+  vfTDCHistSwap(0);
+  vfTDCHistFill(TEST_SLOT, data, 0);
+  vfTDCHistFill(3, data, 0);
+  h = vfTDCHistSwap(0);
+  CHECK((h != NULL) && (h[TEST_SLOT].nblocks == 2) &&
+	(h[TEST_SLOT].nhits == 4) && (h[3].nblocks == 1) &&
+	(h[3].nhits == 4) && (h[3].occupancy[chan[1]] == 2),
+	"blocks of each slot");
+  CHECK((h != NULL) &&
+	(h[TEST_SLOT].coarse[chan[0]][coarse[0]>>VFTDC_HIST_BIN_SHIFT] == 2) &&
+	(h[TEST_SLOT].coarse[chan[2]][VFTDC_HIST_NBINS-1] == 1),
+	"coarse time bins");
+
+  vfTDCHistFree();
+}
+
+/*************************************************************
+ Configuration file (vfTDCConfigRead)
+*************************************************************/
+
+/* Write text to a new temporary file, and return its name in name */
+static int
+writeConfig(char *name, const char *text)
+{
+  int fd;
+
+  strcpy(name, "/tmp/vfTDCDataTest.XXXXXX");
+  fd = mkstemp(name);
+  if(fd < 0)
+    {
+      perror("mkstemp");
+      return ERROR;
+    }
+
+  if(write(fd, text, strlen(text)) != (ssize_t)strlen(text))
+    {
+      perror("write");
+      close(fd);
+      unlink(name);
+      return ERROR;
+    }
+
+  close(fd);
+  return OK;
+}
+
+static void
+testConfig()
+{
+  struct vftdc_config_struct cfg;
+  char name[64];
+  int rval;
+
+  const char *good =
+    "# Comment line\n"
+    "VFTDC_CRATE  all\n"
+    "VFTDC_A32_BASE  0x09000000\n"
+    "VFTDC_SLOT  all                # Defaults\n"
+    "VFTDC_WINDOW_LATENCY  100\n"
+    "VFTDC_WINDOW_WIDTH    250\n"
+    "VFTDC_CLOCK_SOURCE  vxs\n"
+    "VFTDC_SLOT  5\n"
+    "VFTDC_WINDOW_WIDTH    200\n"
+    "VFTDC_TRIG_SOURCE   HFBR1\n"
+    "VFTDC_SYNC_SOURCE   VME\n"
+    "VFTDC_CRATE  vfTDCDataTest-no-such-host\n"
+    "VFTDC_SLOT  6\n"
+    "VFTDC_WINDOW_WIDTH    7\n"
+    "VFTDC_CRATE  end\n"
+    "VFTDC_WINDOW_WIDTH    8\n";
+
+  const char *bad =
+    "VFTDC_CRATE  all\n"
+    "VFTDC_SLOT  3\n"
+    "VFTDC_WINDOW_WIDTH    30\n"
+    "VFTDC_SLOT  99\n"
+    "VFTDC_WINDOW_WIDTH    11\n"
+    "VFTDC_WINDOW_LATENCY  12\n"
+    "VFTDC_SLOT  4\n"
+    "VFTDC_WINDOW_WIDTH    40\n"
+    "VFTDC_CLOCK_SOURCE  NONE\n"
+    "VFTDC_CRATE  end\n";
+
+  if(writeConfig(name, good) == OK)
+    {
+      rval = vfTDCConfigRead(name, &cfg);
+      unlink(name);
+      CHECK(rval == OK, "good file");
+      CHECK(cfg.a32Base == 0x09000000, "A32 base");
+      CHECK((cfg.slot[0].latency == 100) && (cfg.slot[0].width == 250) &&
+	    (cfg.slot[0].clock == VFTDC_CLOCK_VXS) &&
+	    (cfg.slot[0].trigsrc == -1) && (cfg.slot[0].sync == -1),
+	    "all slots");
+      CHECK((cfg.slot[5].latency == -1) && (cfg.slot[5].width == 200) &&
+	    (cfg.slot[5].clock == -1) &&
+	    (cfg.slot[5].trigsrc == VFTDC_TRIGSRC_HFBR1) &&
+	    (cfg.slot[5].sync == VFTDC_SYNC_VME),
+	    "slot 5");
+      CHECK(cfg.slot[6].width == -1, "other crate");
+    }
+  else
+    nerrors++;
+
+  /* The settings after an invalid slot go nowhere, other errors are
+     reported but the rest of the file is read */
+  if(writeConfig(name, bad) == OK)
+    {
+      rval = vfTDCConfigRead(name, &cfg);
+      unlink(name);
+      CHECK(rval == ERROR, "bad file");
+      CHECK((cfg.slot[3].width == 30) && (cfg.slot[4].width == 40) &&
+	    (cfg.slot[4].clock == -1), "slots around an invalid slot");
+      CHECK((cfg.slot[0].width == -1) && (cfg.slot[0].latency == -1),
+	    "settings of an invalid slot");
+    }
+  else
+    nerrors++;
+
+  CHECK(vfTDCConfigRead("/tmp/vfTDCDataTest.no-such-file", &cfg) == ERROR,
+	"missing file");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("\nJLAB vfTDC Data Processing Tests\n");
+  printf("----------------------------\n");
+
+  /* Registers read by the settings */
+  memset(&fakeTDC, 0, sizeof(fakeTDC));
+  vmeWrite32(&fakeTDC.pl, TEST_LATENCY);
+  TDCp[TEST_SLOT] = &fakeTDC;
+
+  testDecode();
+  testSwap();
+  testTableDecode();
+  testSoftWindow();
+  testFilter();
+  testDecodeEvents();
+  testHist();
+  testConfig();
+
+  TDCp[TEST_SLOT] = NULL;
+
+  if(nerrors)
+    printf("%d checks FAILED\n",nerrors);
+  else
+    printf("All checks passed\n");
+
+  exit((nerrors) ? 1 : 0);
+}
@@ -17,9 +17,7 @@
 #include "vfTDCLib.h"
 /* #include "remexLib.h" */
 
-DMA_MEM_ID vmeIN,vmeOUT;
-extern DMANODE *the_event;
-extern unsigned int *dma_dabufp;
+DMA_MEM_ID vmeIN;
 
 extern int tiA32Base;
 
@@ -33,20 +31,30 @@ mytiISR(int arg)
 {
   volatile unsigned short reg;
   int dCnt, len=0,idata;
-  DMANODE *outEvent;
+  DMANODE *event;
+  unsigned int *dma_dabufp;
+  struct vftdc_readout_result result;
+  struct vftdc_buffer_struct buf;
   int blkReady=0, timeout=0;
   int printout = 1;
 
   unsigned int tiIntCount = tiGetIntCount();
 
 #ifdef DO_READOUT
-  GETEVENT(vmeIN,tiIntCount);
+  event = vfTDCPoolGet();
+  if(event == NULL)
+    {
+      printf("%s: ERROR: No free readout buffer\n",__FUNCTION__);
+      return;
+    }
+  dma_dabufp = (unsigned int *)event->data;
 
 #ifdef DOINT
   blkReady = tiBReady();
   if(blkReady==ERROR)
     {
       printf("%s: ERROR: tiIntPoll returned ERROR.\n",__FUNCTION__);
+      vfTDCPoolFree(event);
       return;
     }
 
@@ -60,6 +68,7 @@ mytiISR(int arg)
   if(timeout>=100)
     {
       printf("TIMEOUT!\n");
+      vfTDCPoolFree(event);
       return;
     }
 #endif
@@ -90,10 +99,11 @@ mytiISR(int arg)
   if(timeout>=100)
     {
       printf("TIMEOUT!\n");
+      vfTDCPoolFree(event);
       return;
     }
 
-  dCnt = vfTDCReadBlock(0,dma_dabufp,BLOCKLEVEL*(10*192+10),1);
+  dCnt = vfTDCReadBlockResult(0,dma_dabufp,BLOCKLEVEL*(10*192+10),1,&result);
   if(dCnt<=0)
     {
       printf("No data or error.  dCnt = %d\n",dCnt);
@@ -105,9 +115,7 @@ mytiISR(int arg)
 
 
 
-  PUTEVENT(vmeOUT);
-
-  outEvent = dmaPGetItem(vmeOUT);
+  event->length = dma_dabufp - (unsigned int *)event->data;
 #define READOUT
 #ifdef READOUT
   if(tiIntCount%printout==0)
@@ -115,18 +123,24 @@ mytiISR(int arg)
       printf("Received %d triggers...\n",
 	     tiIntCount);
 
-      len = outEvent->length;
+      len = event->length;
+
+      /* Swap the whole event once, instead of each word */
+      buf.data   = event->data;
+      buf.nwords = len;
+      buf.order  = result.order;
+      vfTDCBufferToHost(&buf);
       
       for(idata=0;idata<len;idata++)
 	{
 /* 	  if((idata%5)==0) printf("\n\t"); */
-/* 	  printf("  0x%08x ",(unsigned int)LSWAP(outEvent->data[idata])); */
-	  vfTDCDataDecode(LSWAP(outEvent->data[idata]));
+/* 	  printf("  0x%08x ",(unsigned int)buf.data[idata]); */
+	  vfTDCDataDecode(buf.data[idata]);
 	}
       printf("\n\n");
     }
 #endif
-  dmaPFreeItem(outEvent);
+  vfTDCPoolFree(event);
 #else /* DO_READOUT */
   /*   tiResetBlockReadout(); */
 
@@ -172,10 +186,11 @@ main(int argc, char *argv[]) {
   /* INIT dmaPList */
 
   dmaPFreeAll();
-  vmeIN  = dmaPCreate("vmeIN",10244,500,0);
-  vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+  /* Readout buffers: locked in memory, and touched before use */
+  vmeIN  = vfTDCPoolCreate(500,10244);
     
   dmaPStatsAll();
+  vfTDCPoolPrintStats();
 
   dmaPReInitAll();
 
@@ -310,6 +325,7 @@ main(int argc, char *argv[]) {
 
  CLOSE:
 
+  vfTDCPoolDelete();
   dmaPFreeAll();
   vmeCloseDefaultWindows();
 
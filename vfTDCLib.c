@@ -28,19 +28,28 @@
 #include <sysLib.h>
 #include <logLib.h>
 #include <taskLib.h>
+#include <tickLib.h>
 #include <intLib.h>
 #include <iv.h>
 #include <semLib.h>
 #include <vxLib.h>
+#include <hostLib.h>
 #include "vxCompat.h"
 #include "../jvme/jvme.h"
 #else 
 #include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include "jvme.h"
 #endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <string.h>
+#include <time.h>
 #include <pthread.h>
 #include "vfTDCLib.h"
 
@@ -49,6 +58,69 @@ pthread_mutex_t   vfTDCMutex = PTHREAD_MUTEX_INITIALIZER;
 #define VLOCK     if(pthread_mutex_lock(&vfTDCMutex)<0) perror("pthread_mutex_lock");
 #define VUNLOCK   if(pthread_mutex_unlock(&vfTDCMutex)<0) perror("pthread_mutex_unlock");
 
+/* Atomic operations on counters and flags shared with the readout.
+   The vxWorks compiler has no __sync builtins: there they are done
+   with interrupts locked. */
+#ifdef VXWORKS
+static unsigned int
+vfTDCAtomicAdd(volatile unsigned int *p, unsigned int v)
+{
+  unsigned int rval;
+  int key = intLock();
+
+  rval = (*p += v);
+  intUnlock(key);
+
+  return rval;
+}
+
+static int
+vfTDCAtomicCas(volatile unsigned int *p, unsigned int oldval, unsigned int newval)
+{
+  int rval = 0;
+  int key = intLock();
+
+  if(*p == oldval)
+    {
+      *p = newval;
+      rval = 1;
+    }
+  intUnlock(key);
+
+  return rval;
+}
+
+static unsigned int
+vfTDCAtomicSwap(volatile unsigned int *p, unsigned int v)
+{
+  unsigned int rval;
+  int key = intLock();
+
+  rval = *p;
+  *p = v;
+  intUnlock(key);
+
+  return rval;
+}
+
+#define VFTDC_ATOMIC_ADD(p,v)   vfTDCAtomicAdd((volatile unsigned int *)(p),(v))
+#define VFTDC_ATOMIC_SUB(p,v)   vfTDCAtomicAdd((volatile unsigned int *)(p),-(v))
+#define VFTDC_ATOMIC_CAS(p,o,n) vfTDCAtomicCas((volatile unsigned int *)(p),(o),(n))
+#define VFTDC_ATOMIC_SWAP(p,v)  vfTDCAtomicSwap((volatile unsigned int *)(p),(v))
+#ifdef VXWORKSPPC
+#define VFTDC_BARRIER()         __asm__ __volatile__ ("sync" : : : "memory")
+#else
+#define VFTDC_BARRIER()         __asm__ __volatile__ ("" : : : "memory")
+#endif
+#else
+/* ADD and SUB return the new value, SWAP the old one */
+#define VFTDC_ATOMIC_ADD(p,v)   __sync_add_and_fetch((p),(v))
+#define VFTDC_ATOMIC_SUB(p,v)   __sync_sub_and_fetch((p),(v))
+#define VFTDC_ATOMIC_CAS(p,o,n) __sync_bool_compare_and_swap((p),(o),(n))
+#define VFTDC_ATOMIC_SWAP(p,v)  __sync_lock_test_and_set((p),(v))
+#define VFTDC_BARRIER()         __sync_synchronize()
+#endif
+
 /* Global Variables */
 volatile struct vfTDC_struct       *TDCp[VFTDC_MAX_BOARDS+1];  /* pointer to vfTDC memory map */
 volatile        unsigned int       *TDCpd[VFTDC_MAX_BOARDS+1]; /* pointer to vfTDC data FIFO */
@@ -72,7 +144,23 @@ static VOIDFUNCPTR  vfTDCAckRoutine  = NULL;    /* user trigger acknowledge rout
 static int          vfTDCAckArg      = 0;       /* arg to user trigger ack routine */
 #endif
 int                 vfTDCBlockError  = VFTDC_BLOCKERROR_NO_ERROR; /* Whether (>0) or not (0) Block Transfer had an error */
+/* Cumulative block transfer errors, by slot and VFTDC_BLOCKERROR type */
+static volatile unsigned int vfTDCBlockErrorCount[VFTDC_MAX_SLOT+1][VFTDC_BLOCKERROR_NTYPES];
 int                 nvfTDC           = 0;       /* Number of initialized TDCs */
+static struct vftdc_blctrl_struct vfTDCBLCtrl; /* Adaptive blocklevel controller state */
+/* Recent block sizes (trailer n_words), indexed by slot number */
+static unsigned int vfTDCBlockWords[VFTDC_MAX_SLOT+1][VFTDC_XFERSIZE_HISTORY];
+static unsigned int vfTDCBlockWordsCount[VFTDC_MAX_SLOT+1];
+static unsigned int vfTDCTightFallback[VFTDC_MAX_SLOT+1];
+/* Block number and last event number of the most recent block header, by slot */
+static unsigned int vfTDCLastBlock[VFTDC_MAX_SLOT+1];
+static unsigned int vfTDCLastEvent[VFTDC_MAX_SLOT+1];
+static int          vfTDCLastValid[VFTDC_MAX_SLOT+1];
+static unsigned int vfTDCRecoverCount[VFTDC_MAX_SLOT+1];
+/* Number of readouts that returned data, by slot (readout progress for the watchdog) */
+static volatile unsigned int vfTDCReadCount[VFTDC_MAX_SLOT+1];
+static volatile int vfTDCRecoverRequest[VFTDC_MAX_SLOT+1]; /* From the watchdog, for the readout */
+static struct vftdc_live_struct vfTDCLive[VFTDC_MAX_SLOT+1]; /* Live/busy time accounting */
 
 /* Interrupt/Polling routine prototypes (static) */
 #ifdef NOTYET
@@ -95,16 +183,205 @@ IMPORT  STATUS sysVmeDmaDone(int, int);
 IMPORT  STATUS sysVmeDmaSend(UINT32, UINT32, int, BOOL);
 #endif
 
+/* Monotonic host time in microseconds */
+static unsigned long long
+vfTDCTimeUsec()
+{
+#ifdef VXWORKS
+  return ((unsigned long long)tickGet() * 1000000ULL) / sysClkRateGet();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+}
+
+/* 48 bit event counter, read hi-lo-hi so a carry between the reads of the
+   two registers is not missed.  Must be called with the mutex held. */
+static unsigned long long
+vfTDCReadEventCounter(int id)
+{
+  unsigned int lo, hi, hi2;
+
+  hi  = vmeRead32(&TDCp[id]->eventNumber_hi) & VFTDC_EVENTNUMBER_HI_MASK;
+  lo  = vmeRead32(&TDCp[id]->eventNumber_lo);
+  hi2 = vmeRead32(&TDCp[id]->eventNumber_hi) & VFTDC_EVENTNUMBER_HI_MASK;
+  if(hi2 != hi)
+    {
+      /* lo wrapped: read it again with the new hi */
+      lo = vmeRead32(&TDCp[id]->eventNumber_lo);
+      hi = hi2;
+    }
+
+  return lo | ((unsigned long long)(hi>>16)<<32);
+}
+
+#if defined(VFTDC_INSTRUMENT) && defined(VXWORKS)
+#warning "VFTDC_INSTRUMENT is not supported for vxWorks"
+#undef VFTDC_INSTRUMENT
+#endif
+
+#ifdef VFTDC_INSTRUMENT
+/*************************************************************
+ Readout latency instrumentation (compiled with -DVFTDC_INSTRUMENT).
+
+ Each thread that enters the readout routines claims its own set of
+ histograms.  Only that thread writes to them, so no locks or atomic
+ read-modify-writes are needed.  Readers may sum them at any time.
+*************************************************************/
+static struct vftdc_instr_struct vfTDCInstr[VFTDC_INSTR_MAX_THREADS];
+static int vfTDCInstrNthreads = 0;
+static __thread struct vftdc_instr_struct *vfTDCInstrMine = NULL;
+static __thread int vfTDCInstrFull = 0;
+
+static unsigned long long
+vfTDCTimeNsec()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+vfTDCInstrRecord(int metric, unsigned long long value)
+{
+  struct vftdc_instr_struct *h = vfTDCInstrMine;
+  int ibin = 0, ithr;
+
+  if(h == NULL)
+    {
+      if(vfTDCInstrFull)
+	return;
+      ithr = VFTDC_ATOMIC_ADD(&vfTDCInstrNthreads, 1) - 1;
+      if(ithr >= VFTDC_INSTR_MAX_THREADS)
+	{
+	  vfTDCInstrFull = 1;
+	  return;
+	}
+      h = vfTDCInstrMine = &vfTDCInstr[ithr];
+    }
+
+  /* Bin 0: value 0, bin n: 2^(n-1) <= value < 2^n */
+  if(value)
+    ibin = 64 - __builtin_clzll(value);
+  if(ibin >= VFTDC_INSTR_NBINS)
+    ibin = VFTDC_INSTR_NBINS - 1;
+
+  h->bin[metric][ibin]++;
+  h->sum[metric] += value;
+}
+
+#define VFTDC_INSTR_DECL(_t)           unsigned long long _t=0
+#define VFTDC_INSTR_START(_t)          _t = vfTDCTimeNsec()
+#define VFTDC_INSTR_STOP(_metric,_t)   vfTDCInstrRecord(_metric, vfTDCTimeNsec() - (_t))
+#define VFTDC_INSTR_VALUE(_metric,_v)  vfTDCInstrRecord(_metric, _v)
+#define VFTDC_INSTR_VLOCK(_t)					\
+  {VFTDC_INSTR_START(_t); VLOCK; VFTDC_INSTR_STOP(VFTDC_INSTR_LOCK_WAIT,_t);}
+#else
+#define VFTDC_INSTR_DECL(_t)
+#define VFTDC_INSTR_START(_t)
+#define VFTDC_INSTR_STOP(_metric,_t)
+#define VFTDC_INSTR_VALUE(_metric,_v)
+#define VFTDC_INSTR_VLOCK(_t)          VLOCK
+#endif /* VFTDC_INSTRUMENT */
+
 /**
  * @defgroup PreInit Pre-Initialization
  * @defgroup Config Initialization/Configuration
  * @defgroup Status Status
  * @defgroup Readout Data Readout
  * @defgroup IntPoll Interrupt/Polling
+ * @defgroup Decode Data Decoding
  * @defgroup Deprec Deprecated - To be removed
  */
 
 
+/* Result of probing each slot for VFTDC_INIT_AUTO_DISCOVER, indexed by slot number */
+#define VFTDC_DISCOVER_UNKNOWN  0
+#define VFTDC_DISCOVER_EMPTY    1
+#define VFTDC_DISCOVER_OTHER    2
+#define VFTDC_DISCOVER_VFTDC    3
+struct vftdc_discover_entry
+{
+  int                state;      /* VFTDC_DISCOVER_* */
+  unsigned int       boardID;    /* boardID register */
+  unsigned int       fwvers;     /* Firmware version, from the status register */
+  unsigned long long probeTime;  /* vfTDCTimeUsec of the probe */
+};
+static struct vftdc_discover_entry vfTDCDiscoverCache[VFTDC_MAX_SLOT+1];
+
+/*
+  Probe the A24 address of each slot for a vfTDC, and fill vfTDCAddrList.
+  The result for each slot (with the board ID and firmware version of a
+  vfTDC) is reused for VFTDC_DISCOVER_MAX_AGE seconds, after which the slot
+  is probed again: a board may have been added to an empty slot.
+  Probes are done one after the other: the VME driver serializes them anyway.
+  Returns the number of vfTDCs found.
+*/
+static int
+vfTDCDiscover()
+{
+  int islot, res, nfound=0, nprobe=0;
+  unsigned int rdata=0;
+  unsigned long long now;
+  volatile struct vfTDC_struct *ft;
+  struct vftdc_discover_entry *entry;
+
+  memset((char *)vfTDCAddrList,0,sizeof(vfTDCAddrList));
+  now = vfTDCTimeUsec();
+
+  for(islot=VFTDC_DISCOVER_FIRST_SLOT; islot<=VFTDC_MAX_SLOT; islot++)
+    {
+      entry = &vfTDCDiscoverCache[islot];
+
+      if((entry->state == VFTDC_DISCOVER_UNKNOWN) ||
+	 ((now - entry->probeTime) >= (unsigned long long)VFTDC_DISCOVER_MAX_AGE*1000000ULL))
+	{
+	  ft = (struct vfTDC_struct *)((unsigned long)(islot<<19) + vfTDCA24Offset);
+	  nprobe++;
+	  entry->probeTime = now;
+#ifdef VXWORKS
+	  res = vxMemProbe((char *) &(ft->boardID),VX_READ,4,(char *)&rdata);
+#else
+	  res = vmeMemProbe((char *) &(ft->boardID),4,(char *)&rdata);
+#endif
+	  if(res < 0)
+	    entry->state = VFTDC_DISCOVER_EMPTY;
+	  else if(((rdata&VFTDC_BOARDID_TYPE_MASK)>>16) != VFTDC_BOARDID_TYPE_VFTDC)
+	    entry->state = VFTDC_DISCOVER_OTHER;
+	  else
+	    {
+	      entry->state   = VFTDC_DISCOVER_VFTDC;
+	      entry->boardID = rdata;
+	      entry->fwvers  =
+		(vmeRead32(&ft->status)&VFTDC_STATUS_FIRMWARE_VERSION_MASK)>>20;
+	    }
+	}
+
+      if((entry->state == VFTDC_DISCOVER_VFTDC) && (nfound < VFTDC_MAX_BOARDS))
+	vfTDCAddrList[nfound++] = (islot<<19);
+    }
+
+  printf("%s: Found %d vfTDC(s), %d slot(s) probed\n",
+	 __FUNCTION__,nfound,nprobe);
+
+  return nfound;
+}
+
+/**
+ *  @ingroup PreInit
+ *  @brief Forget the slots probed by VFTDC_INIT_AUTO_DISCOVER, so all
+ *    slots are probed at the next vfTDCInit.  Use after the modules in
+ *    the crate have been changed.
+ */
+void
+vfTDCClearDiscoveryCache()
+{
+  memset((char *)vfTDCDiscoverCache,0,sizeof(vfTDCDiscoverCache));
+}
+
 /**
  *  @ingroup Config
  *  @brief Initialize JLAB vfTDC Library. 
@@ -116,7 +393,7 @@ IMPORT  STATUS sysVmeDmaSend(UINT32, UINT32, int, BOOL);
  * @param ntdc
  *  - Number of times to increment
  *
- *  @param Flag 18 bit integer
+ *  @param iFlag 21 bit integer
  * <pre>
  *       Low 7 bits - Specifies the default Signal distribution (clock,trigger) 
  *                    sources for the board (Internal, FrontPanel, VXS, VME(Soft))
@@ -147,6 +424,23 @@ IMPORT  STATUS sysVmeDmaSend(UINT32, UINT32, int, BOOL);
  *      bit 18:  Skip firmware check.  Useful for firmware updating.
  *             0 Perform firmware check
  *             1 Skip firmware check
+ *
+ *      bit 19:  Find the modules by scanning the A24 address (slot<<19)
+ *               of each slot.  addr, addr_inc, and ntdc are ignored.
+ *               The result of each slot is remembered, and not probed
+ *               again for VFTDC_DISCOVER_MAX_AGE seconds
+ *               (see vfTDCClearDiscoveryCache).
+ *             0 Initialize with addr and addr_inc, or vfTDCAddrList
+ *             1 Scan the crate
+ *
+ *      bit 20:  Warm restart.  Read back the clock, trigger, sync, A32
+ *               and blocklevel settings of each module.  Modules with the
+ *               requested clock source, and a running clock (livetime and
+ *               busytime counters advancing), only get a soft reset that
+ *               keeps the scalers, instead of the scaler reset and clock
+ *               selection.  Other registers are only written if they differ.
+ *             0 Full initialization
+ *             1 Warm restart
  * </pre>
  *      
  *
@@ -166,6 +460,11 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
   int noBoardInit=0;
   int useList=0;
   int noFirmwareCheck=0;
+  int autoDiscover=0;
+  int warmRestart=0, nwarm=0;
+  int warm[VFTDC_MAX_BOARDS];
+  unsigned int clkCount[VFTDC_MAX_BOARDS];
+  unsigned int clkReg=0, trigReg=0, syncReg=0;
 
   /* Check if we are to exit when pointers are setup */
   noBoardInit     = (iFlag&VFTDC_INIT_SKIP)>>16;
@@ -176,6 +475,18 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
   /* Are we skipping the firmware check? */
   noFirmwareCheck = (iFlag&VFTDC_INIT_SKIP_FIRMWARE_CHECK)>>18;
 
+  /* Are we scanning the crate for modules? */
+  autoDiscover    = (iFlag&VFTDC_INIT_AUTO_DISCOVER)>>19;
+
+  /* Only apply what differs from the current configuration? */
+  warmRestart     = (iFlag&VFTDC_INIT_WARM_RESTART)>>20;
+  if(autoDiscover)
+    {
+      /* Any A24 slot address, to find the A24 offset */
+      addr = (VFTDC_DISCOVER_FIRST_SLOT<<19);
+      useList = 1;
+    }
+
   /* Determine clock, sync, and trigger sources */
   srSrc   = (iFlag&VFTDC_INIT_SYNCRESETSRC_MASK);
   trigSrc = (iFlag&VFTDC_INIT_TRIGSRC_MASK);
@@ -219,6 +530,17 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
       vfTDCA24Offset = laddr - addr;
     }
 
+  if(autoDiscover)
+    {
+      ntdc = vfTDCDiscover();
+      if(ntdc <= 0)
+	{
+	  printf("%s: ERROR: No vfTDC found in the crate\n",
+		 __FUNCTION__);
+	  return(ERROR);
+	}
+    }
+
   /* Init Some Global variables */
   nvfTDC = 0;
   memset((char *)vfTDCID,0,sizeof(vfTDCID));
@@ -234,12 +556,21 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
 	  laddr_inc = laddr +ii*addr_inc;
 	}
       ft = (struct vfTDC_struct *)laddr_inc;
-      /* Check if Board exists at that address */
+      if(autoDiscover)
+	{
+	  /* Already probed by vfTDCDiscover */
+	  rdata = vfTDCDiscoverCache[vfTDCAddrList[ii]>>19].boardID;
+	  res = 0;
+	}
+      else
+	{
+	  /* Check if Board exists at that address */
 #ifdef VXWORKS
-      res = vxMemProbe((char *) &(ft->boardID),VX_READ,4,(char *)&rdata);
+	  res = vxMemProbe((char *) &(ft->boardID),VX_READ,4,(char *)&rdata);
 #else
-      res = vmeMemProbe((char *) &(ft->boardID),4,(char *)&rdata);
+	  res = vmeMemProbe((char *) &(ft->boardID),4,(char *)&rdata);
 #endif
+	}
       if(res < 0) 
 	{
 #ifdef VXWORKS
@@ -275,7 +606,10 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
 		  continue;
 		}
 
-	      fwvers = (vmeRead32(&ft->status)&VFTDC_STATUS_FIRMWARE_VERSION_MASK)>>20;
+	      if(autoDiscover)
+		fwvers = vfTDCDiscoverCache[vfTDCAddrList[ii]>>19].fwvers;
+	      else
+		fwvers = (vmeRead32(&ft->status)&VFTDC_STATUS_FIRMWARE_VERSION_MASK)>>20;
 	      if(!noFirmwareCheck)
 		{
 		  /* Check FPGA firmware version */
@@ -311,14 +645,119 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
 	}
     }
 
-  /* Hard Reset of all VFTDC boards in the Crate */
+  /* Clock, Trigger, and syncReset source register settings */
+  switch(clkSrc)
+    {
+    case VFTDC_INIT_INT_CLKSRC:
+      wreg = VFTDC_CLOCK_INTERNAL;
+      break;
+
+    case VFTDC_INIT_HFBR1_CLKSRC:
+      wreg = VFTDC_CLOCK_HFBR1;
+      break;
+
+    case VFTDC_INIT_VXS_CLKSRC:
+      wreg = VFTDC_CLOCK_VXS;
+      break;
+
+    default:
+      printf("%s: ERROR: Invalid Clock Source (%d). Setting internal.\n",
+	     __FUNCTION__,clkSrc);
+      clkSrc = VFTDC_INIT_INT_CLKSRC;
+      wreg = VFTDC_CLOCK_INTERNAL;
+      break;
+    }
+  clkReg = (wreg) | (wreg<<2) | (wreg<<4) | (wreg<<6);
+
+  switch(trigSrc)
+    {
+    case VFTDC_INIT_SOFT_TRIG:
+      trigReg = VFTDC_TRIGSRC_VME;
+      break;
+
+    case VFTDC_INIT_HFBR1_TRIG:
+      trigReg = VFTDC_TRIGSRC_HFBR1;
+      break;
+
+    case VFTDC_INIT_VXS_TRIG:
+      trigReg = VFTDC_TRIGSRC_VXS;
+      break;
+
+    default:
+      printf("%s: ERROR: Invalid trigger source (%d). Using software.\n",
+	     __FUNCTION__,trigSrc>>2);
+      trigSrc= VFTDC_INIT_SOFT_TRIG;
+      trigReg = VFTDC_TRIGSRC_VME;
+    }
+
+  switch(srSrc)
+    {
+    case VFTDC_INIT_SOFT_SYNCRESET:
+      syncReg = VFTDC_SYNC_VME;
+      break;
+
+    case VFTDC_INIT_HFBR1_SYNCRESET:
+      syncReg = VFTDC_SYNC_HFBR1;
+      break;
+
+    case VFTDC_INIT_VXS_SYNCRESET:
+      syncReg = VFTDC_SYNC_VXS;
+      break;
+
+    default:
+      printf("%s: ERROR: Invalid syncReset source (%d). Using software\n",
+	     __FUNCTION__,srSrc>>5);
+      srSrc = VFTDC_INIT_SOFT_SYNCRESET;
+      syncReg = VFTDC_SYNC_VME;
+    }
+
+  /* Warm restart: modules already using the requested clock keep it */
+  memset((char *)warm,0,sizeof(warm));
+  if(warmRestart && !noBoardInit)
+    {
+      /* The clock is running if the live and busy time counters advance */
+      for(ii=0;ii<nvfTDC;ii++) 
+	{
+	  if((vmeRead32(&TDCp[vfTDCID[ii]]->clock) & VFTDC_CLOCK_ALL_MASK) == clkReg)
+	    {
+	      warm[ii] = 1;
+	      clkCount[ii] = vmeRead32(&TDCp[vfTDCID[ii]]->livetime) +
+		vmeRead32(&TDCp[vfTDCID[ii]]->busytime);
+	    }
+	}
+      taskDelay(1);
+      for(ii=0;ii<nvfTDC;ii++) 
+	{
+	  if(!warm[ii])
+	    continue;
+	  if((vmeRead32(&TDCp[vfTDCID[ii]]->livetime) +
+	      vmeRead32(&TDCp[vfTDCID[ii]]->busytime)) == clkCount[ii])
+	    {
+	      printf("%s: Slot %2d: Clock not running.  Full initialization.\n",
+		     __FUNCTION__,vfTDCID[ii]);
+	      warm[ii] = 0;
+	      continue;
+	    }
+	  nwarm++;
+	}
+      printf("%s: Warm restart: %d of %d VFTDC(s) keep their clock configuration\n",
+	     __FUNCTION__,nwarm,nvfTDC);
+    }
+
+  /* Hard Reset of all VFTDC boards in the Crate (soft reset only for a warm restart) */
   if(!noBoardInit)
     {
       for(ii=0;ii<nvfTDC;ii++) 
 	{
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->reset,VFTDC_RESET_SOFT | VFTDC_RESET_SCALERS_RESET);
+	  if(warm[ii])
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->reset,VFTDC_RESET_SOFT);
+	  else
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->reset,VFTDC_RESET_SOFT | VFTDC_RESET_SCALERS_RESET);
 	}
-      taskDelay(60); 
+      if(nwarm < nvfTDC)
+	taskDelay(60); 
+      else
+	taskDelay(1);
     }
 
   /* Initialize Interrupt variables */
@@ -360,32 +799,11 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
   if(!noBoardInit)
     {
       
-      switch(clkSrc)
-	{
-	case VFTDC_INIT_INT_CLKSRC:
-	  wreg = VFTDC_CLOCK_INTERNAL;
-	  break;
-
-	case VFTDC_INIT_HFBR1_CLKSRC:
-	  wreg = VFTDC_CLOCK_HFBR1;
-	  break;
-
-	case VFTDC_INIT_VXS_CLKSRC:
-	  wreg = VFTDC_CLOCK_VXS;
-	  break;
-
-	default:
-	  printf("%s: ERROR: Invalid Clock Source (%d). Setting internal.\n",
-		 __FUNCTION__,clkSrc);
-	  clkSrc = VFTDC_INIT_INT_CLKSRC;
-	  wreg = VFTDC_CLOCK_INTERNAL;
-	  break;
-	}
-
       for(ii=0;ii<nvfTDC;ii++) 
 	{
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->clock, 
-		     (wreg) | (wreg<<2) | (wreg<<4) | (wreg<<6));
+	  if(warm[ii])
+	    continue;
+	  vmeWrite32(&TDCp[vfTDCID[ii]]->clock, clkReg);
 	  taskDelay(1);
 	  vmeWrite32(&TDCp[vfTDCID[ii]]->reset,VFTDC_RESET_CLK250);
 	  taskDelay(1);
@@ -394,59 +812,22 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
 	  vmeWrite32(&TDCp[vfTDCID[ii]]->reset,VFTDC_RESET_SOFT);
 	  taskDelay(1);
 	}
-      taskDelay(5);
+      if(nwarm < nvfTDC)
+	taskDelay(5);
 
       /* Setup Trigger and Sync Reset sources */
-      switch(trigSrc)
-	{
-	case VFTDC_INIT_SOFT_TRIG:
-	  wreg = VFTDC_TRIGSRC_VME;
-	  break;
-
-	case VFTDC_INIT_HFBR1_TRIG:
-	  wreg = VFTDC_TRIGSRC_HFBR1;
-	  break;
-
-	case VFTDC_INIT_VXS_TRIG:
-	  wreg = VFTDC_TRIGSRC_VXS;
-	  break;
-
-	default:
-	  printf("%s: ERROR: Invalid trigger source (%d). Using software.\n",
-		 __FUNCTION__,trigSrc>>2);
-	  trigSrc= VFTDC_INIT_SOFT_TRIG;
-	  wreg = VFTDC_TRIGSRC_VME;
-	}
-
       for(ii=0;ii<nvfTDC;ii++) 
 	{
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->trigsrc, wreg);
-	}
-
-      switch(srSrc)
-	{
-	case VFTDC_INIT_SOFT_SYNCRESET:
-	  wreg = VFTDC_SYNC_VME;
-	  break;
-
-	case VFTDC_INIT_HFBR1_SYNCRESET:
-	  wreg = VFTDC_SYNC_HFBR1;
-	  break;
-
-	case VFTDC_INIT_VXS_SYNCRESET:
-	  wreg = VFTDC_SYNC_VXS;
-	  break;
-
-	default:
-	  printf("%s: ERROR: Invalid syncReset source (%d). Using software\n",
-		 __FUNCTION__,srSrc>>5);
-	  srSrc = VFTDC_INIT_SOFT_SYNCRESET;
-	  wreg = VFTDC_SYNC_VME;
+	  if(!warmRestart ||
+	     ((vmeRead32(&TDCp[vfTDCID[ii]]->trigsrc) & VFTDC_TRIGSRC_SOURCEMASK) != trigReg))
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->trigsrc, trigReg);
 	}
 
       for(ii=0;ii<nvfTDC;ii++) 
 	{
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->sync, wreg);
+	  if(!warmRestart ||
+	     ((vmeRead32(&TDCp[vfTDCID[ii]]->sync) & VFTDC_SYNC_SOURCEMASK) != syncReg))
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->sync, syncReg);
 	}
 
     }
@@ -477,13 +858,20 @@ vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag)
       TDCpd[vfTDCID[ii]] = (unsigned int *)(laddr);  /* Set a pointer to the FIFO */
       if(!noBoardInit)
 	{
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->adr32,a32addr);  /* Write the register */
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->vmeControl,
-		     vmeRead32(&TDCp[vfTDCID[ii]]->vmeControl) | 
-		     VFTDC_VMECONTROL_A32 | VFTDC_VMECONTROL_BERR);
+	  rdata = vmeRead32(&TDCp[vfTDCID[ii]]->vmeControl);
+	  if(!warmRestart || 
+	     (vmeRead32(&TDCp[vfTDCID[ii]]->adr32) != a32addr))
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->adr32,a32addr);  /* Write the register */
+	  if(!warmRestart ||
+	     ((rdata & (VFTDC_VMECONTROL_A32 | VFTDC_VMECONTROL_BERR)) != 
+	      (VFTDC_VMECONTROL_A32 | VFTDC_VMECONTROL_BERR)))
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->vmeControl,
+		       rdata | VFTDC_VMECONTROL_A32 | VFTDC_VMECONTROL_BERR);
 	
 	  /* Set Default Block Level to 1 */
-	  vmeWrite32(&TDCp[vfTDCID[ii]]->blocklevel,1);
+	  if(!warmRestart ||
+	     ((vmeRead32(&TDCp[vfTDCID[ii]]->blocklevel) & VFTDC_BLOCKLEVEL_MASK) != 1))
+	    vmeWrite32(&TDCp[vfTDCID[ii]]->blocklevel,1);
 
 	}
 
@@ -770,19 +1158,43 @@ vfTDCStatus(int id, int pflag)
 
 }
 
-#ifdef NOTYET
+/* Registers of vfTDCGetSnapshot.  Must be called with the mutex held. */
+static void
+vfTDCReadSnapshot(int id, struct vftdc_snapshot_struct *snap)
+{
+  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SCALERS_LATCH);
+  snap->trig1_scaler = vmeRead32(&TDCp[id]->trig1_scaler);
+  snap->trig2_scaler = vmeRead32(&TDCp[id]->trig2_scaler);
+  snap->sync_scaler  = vmeRead32(&TDCp[id]->sync_scaler);
+  snap->berr_scaler  = vmeRead32(&TDCp[id]->berr_scaler);
+  snap->livetime     = vmeRead32(&TDCp[id]->livetime);
+  snap->busytime     = vmeRead32(&TDCp[id]->busytime);
+  snap->eventCounter = vfTDCReadEventCounter(id);
+  snap->status       = vmeRead32(&TDCp[id]->status);
+  snap->blockBuffer  = vmeRead32(&TDCp[id]->blockBuffer);
+  snap->busy         = vmeRead32(&TDCp[id]->busy);
+
+  snap->slot         = id;
+  snap->blocksReady  = 
+    (snap->blockBuffer & VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
+}
+
 /**
  * @ingroup Status
- * @brief Get the Firmware Version
+ * @brief Take a snapshot of the scalers, counters and buffer status of a vfTDC
+ *
+ *   Scalers are latched, then read together with the live/busy time,
+ *   event counter, status and block buffer registers, in a single short
+ *   lock hold.  Nothing is printed (see vfTDCPrintSnapshot).
  *
  * @param id Slot Number
- * @return Firmware Version if successful, ERROR otherwise
+ * @param snap Where to store the snapshot
  *
+ * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCGetFirmwareVersion()
+vfTDCGetSnapshot(int id, struct vftdc_snapshot_struct *snap)
 {
-  unsigned int rval=0;
   if(id==0) id=vfTDCID[0];
 
   if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
@@ -792,285 +1204,398 @@ vfTDCGetFirmwareVersion()
       return ERROR;
     }
 
+  if(snap==NULL)
+    {
+      printf("%s: ERROR: Invalid snapshot pointer\n",__FUNCTION__);
+      return ERROR;
+    }
+
   VLOCK;
-  /* reset the VME_to_JTAG engine logic */
-  vmeWrite32(&TDCp->reset,VFTDC_RESET_JTAG);
+  vfTDCReadSnapshot(id, snap);
+  VUNLOCK;
 
-  /* Reset FPGA JTAG to "reset_idle" state */
-  vmeWrite32(&TDCp->JTAGFPGABase[(0x003C)>>2],0);
+  return OK;
+}
 
-  /* enable the user_code readback */
-  vmeWrite32(&TDCp->JTAGFPGABase[(0x092C)>>2],0x3c8);
+/**
+ * @ingroup Status
+ * @brief Print a snapshot from vfTDCGetSnapshot to standard out
+ *
+ * @param snap Snapshot to print
+ */
+void
+vfTDCPrintSnapshot(struct vftdc_snapshot_struct *snap)
+{
+  unsigned int st;
 
-  /* shift in 32-bit to FPGA JTAG */
-  vmeWrite32(&TDCp->JTAGFPGABase[(0x1F1C)>>2],0);
-  
-  /* Readback the firmware version */
-  rval = vmeRead32(&TDCp->JTAGFPGABase[(0x1F1C)>>2]);
-  VUNLOCK;
+  if(snap==NULL)
+    return;
 
-  return rval;
-}
+  st = snap->status;
 
+  printf("\n");
+  printf("SNAPSHOT for vfTDC in slot %d\n",snap->slot);
+  printf("--------------------------------------------------------------------------------\n");
+  printf(" Trigger   Scaler         = %u\n",snap->trig1_scaler);
+  printf(" Trigger 2 Scaler         = %u\n",snap->trig2_scaler);
+  printf(" SyncReset Scaler         = %u\n",snap->sync_scaler);
+  printf(" Bus Error Scaler         = %u\n",snap->berr_scaler);
+  printf(" Live Time                = %u\n",snap->livetime);
+  printf(" Busy Time                = %u\n",snap->busytime);
+  printf(" Event Counter            = %llu\n",snap->eventCounter);
+  printf(" Blocks Ready             = %u\n",snap->blocksReady);
+  printf(" Busy Monitor             = 0x%04x\n",
+	 (snap->busy & VFTDC_BUSY_MONITOR_MASK)>>16);
+  printf("\n");
+  printf(" Buffers      A           B\n");
+  printf("   First    %-5s %-5s   %-5s %-5s\n",
+	 (st & VFTDC_STATUS_FIRST_BUFFER_FULL_A)?"FULL":"",
+	 (st & VFTDC_STATUS_FIRST_BUFFER_EMPTY_A)?"EMPTY":"",
+	 (st & VFTDC_STATUS_FIRST_BUFFER_FULL_B)?"FULL":"",
+	 (st & VFTDC_STATUS_FIRST_BUFFER_EMPTY_B)?"EMPTY":"");
+  printf("   Second   %-5s %-5s   %-5s %-5s\n",
+	 (st & VFTDC_STATUS_SECOND_BUFFER_FULL_A)?"FULL":
+	 ((st & VFTDC_STATUS_SECOND_BUFFER_ALMOST_FULL_A)?"AFULL":""),
+	 "",
+	 (st & VFTDC_STATUS_SECOND_BUFFER_FULL_B)?"FULL":
+	 ((st & VFTDC_STATUS_SECOND_BUFFER_ALMOST_FULL_B)?"AFULL":""),
+	 (st & VFTDC_STATUS_SECOND_BUFFER_EMPTY_B)?"EMPTY":"");
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+}
 
 /**
  * @ingroup Status
- * @brief Get the Module Serial Number
+ * @brief Latch and read the scalers of all initialized vfTDCs in the crate
  *
- * @param id Slot Number
- * @param rSN  Pointer to string to pass Serial Number
+ *   All boards are latched back-to-back, then read, so the scalers of
+ *   different boards correspond to the same moment.  The host time of the
+ *   latch is recorded, and rates are calculated from the previous scalers
+ *   of the caller.  Each caller keeps its own previous scalers, so several
+ *   threads may call this.
  *
- * @return SerialNumber if successful, ERROR otherwise
+ * @param sc Where to store the scalers and rates
+ * @param prev Scalers from the previous call of this caller (NULL or
+ *             a zero timestamp: no rates)
  *
+ * @return OK if successful, otherwise ERROR
  */
-unsigned int
-vfTDCGetSerialNumber(char **rSN)
+int
+vfTDCLatchScalersAll(struct vftdc_crate_scalers_struct *sc,
+		     struct vftdc_crate_scalers_struct *prev)
 {
-  unsigned int rval=0;
-  char retSN[10];
+  struct vftdc_scaler_struct *b, *p;
+  float dt=0;
+  int ii;
 
-  memset(retSN,0,sizeof(retSN));
-  
-  if(id==0) id=vfTDCID[0];
+  if(sc==NULL)
+    {
+      printf("%s: ERROR: Invalid scaler pointer\n",__FUNCTION__);
+      return ERROR;
+    }
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(nvfTDC==0)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: No vfTDCs initialized\n",__FUNCTION__);
       return ERROR;
     }
 
+  memset((char *)sc, 0, sizeof(struct vftdc_crate_scalers_struct));
+
   VLOCK;
-  vmeWrite32(&TDCp->reset,VFTDC_RESET_JTAG);           /* reset */
-  vmeWrite32(&TDCp->JTAGPROMBase[(0x3c)>>2],0);     /* Reset_idle */
-  vmeWrite32(&TDCp->JTAGPROMBase[(0xf2c)>>2],0xFD); /* load the UserCode Enable */
-  vmeWrite32(&TDCp->JTAGPROMBase[(0x1f1c)>>2],0);   /* shift in 32-bit of data */
-  rval = vmeRead32(&TDCp->JTAGPROMBase[(0x1f1c)>>2]);
-  VUNLOCK;
+  for(ii=0; ii<nvfTDC; ii++)
+    vmeWrite32(&TDCp[vfTDCID[ii]]->reset,VFTDC_RESET_SCALERS_LATCH);
+  sc->timestamp = vfTDCTimeUsec();
 
-  if(rSN!=NULL)
+  for(ii=0; ii<nvfTDC; ii++)
     {
-      sprintf(retSN,"TI-%d",rval&0x7ff);
-      strcpy((char *)rSN,retSN);
+      b = &sc->board[ii];
+      b->slot         = vfTDCID[ii];
+      b->trig1_scaler = vmeRead32(&TDCp[b->slot]->trig1_scaler);
+      b->trig2_scaler = vmeRead32(&TDCp[b->slot]->trig2_scaler);
+      b->sync_scaler  = vmeRead32(&TDCp[b->slot]->sync_scaler);
+      b->berr_scaler  = vmeRead32(&TDCp[b->slot]->berr_scaler);
     }
+  VUNLOCK;
 
+  sc->nboards = nvfTDC;
 
-  printf("%s: TI Serial Number is %s (0x%08x)\n", 
-	 __FUNCTION__,retSN,rval);
+  if(prev && prev->timestamp && (sc->timestamp > prev->timestamp))
+    dt = (float)(sc->timestamp - prev->timestamp) * 1e-6;
+  sc->dt = dt;
 
-  return rval;
-  
+  if(dt > 0)
+    {
+      for(ii=0; ii<sc->nboards; ii++)
+	{
+	  b = &sc->board[ii];
+	  p = &prev->board[ii];
+	  if((ii >= prev->nboards) || (p->slot != b->slot))
+	    continue;
+
+	  /* Unsigned differences are correct across a 32bit rollover */
+	  b->trig1_rate = (float)(b->trig1_scaler - p->trig1_scaler) / dt;
+	  b->trig2_rate = (float)(b->trig2_scaler - p->trig2_scaler) / dt;
+	  b->sync_rate  = (float)(b->sync_scaler  - p->sync_scaler)  / dt;
+	  b->berr_rate  = (float)(b->berr_scaler  - p->berr_scaler)  / dt;
+	}
+    }
 
+  return OK;
 }
-#endif /* NOTYET */
 
 /**
- * @ingroup Config
- * @brief Perform a soft reset of the TI
- *
- * @param id Slot Number
- * @return OK if successful, ERROR otherwise
+ * @ingroup Status
+ * @brief Print crate scalers and rates from vfTDCLatchScalersAll to standard out
  *
+ * @param sc Scalers to print
  */
-int
-vfTDCReset(int id)
+void
+vfTDCPrintScalersAll(struct vftdc_crate_scalers_struct *sc)
 {
-  if(id==0) id=vfTDCID[0];
+  struct vftdc_scaler_struct *b;
+  int ii;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(sc==NULL)
+    return;
+
+  printf("\n");
+  printf("vfTDC Crate Scalers (interval %.3f s)\n",sc->dt);
+  printf("--------------------------------------------------------------------------------\n");
+  printf("Slot    Trigger1   Trigger2  SyncReset   BusError |  Trig1 Hz  Trig2 Hz   Sync Hz   Berr Hz\n");
+  for(ii=0; ii<sc->nboards; ii++)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
+      b = &sc->board[ii];
+      printf(" %2d  %10u %10u %10u %10u | %9.1f %9.1f %9.1f %9.1f\n",
+	     b->slot,
+	     b->trig1_scaler, b->trig2_scaler, b->sync_scaler, b->berr_scaler,
+	     b->trig1_rate, b->trig2_rate, b->sync_rate, b->berr_rate);
     }
-  
-  VLOCK;
-  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SOFT);
-  VUNLOCK;
-  return OK;
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
 }
 
-/**
- * @ingroup Config
- * @brief Set the number of events per block
- * @param id Slot Number
- * @param blockLevel Number of events per block
- * @return OK if successful, ERROR otherwise
- *
- */
-int
-vfTDCSetBlockLevel(int id, int blockLevel)
-{
-  if(id==0) id=vfTDCID[0];
+/* Busy monitor bits (busy register bits 16-31).  Bit 16+n follows busy
+   source n, except for bit 16 where the vfTDC reports its FIFO full. */
+const char *vfTDC_busy_monitor_names[VFTDC_LIVE_NSOURCES] =
+  {
+    "FIFO Full",
+    "Switch Slot B",
+    "P2",
+    "FP (fTDC)",
+    "FP (fADC)",
+    "Front Panel",
+    "Bit 6",
+    "Loopback",
+    "HFBR1",
+    "HFBR2",
+    "HFBR3",
+    "HFBR4",
+    "HFBR5",
+    "HFBR6",
+    "HFBR7",
+    "HFBR8"
+  };
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
-    {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
+#ifndef VXWORKS
+static int               vfTDCLivePeriod  = 0;  /* ms */
+static volatile int      vfTDCLiveRunning = 0;
+static pthread_t         vfTDCLiveThread;
 
-  if((blockLevel<1) || (blockLevel>255))
+static void *
+vfTDCLiveTask(void *arg)
+{
+  prctl(PR_SET_NAME,"vfTDCLive");
+
+  while(vfTDCLiveRunning)
     {
-      printf("%s: ERROR: Invalid blockLevel (%d)\n",
-	     __FUNCTION__,blockLevel);
-      return ERROR;
+      usleep(vfTDCLivePeriod*1000);
+      if(vfTDCLiveRunning)
+	vfTDCLiveSample();
     }
 
-  VLOCK;
-  vmeWrite32(&TDCp[id]->blocklevel,blockLevel);
-  VUNLOCK;
-  return OK;
+  return NULL;
 }
+#endif /* VXWORKS */
 
 /**
- * @ingroup Config
- * @brief Set trigger sources with specified trigmask
+ * @ingroup Status
+ * @brief Start live/busy time accounting for a run.
  *
- * @param id Slot Number
- * @param trigmask bits:  
- *         - 0: VXS
- *         - 1: HFBR#1
- *         - 4: Software
+ *   Clears the run totals of all initialized vfTDCs and takes the first
+ *   sample of the livetime and busytime counters.  With a period, a
+ *   thread then samples them periodically until vfTDCLiveStop (Linux).
+ *   The busy monitor is only seen at the samples, so the busy time is
+ *   attributed more finely with a shorter period.
  *
- * @return OK if successful, ERROR otherwise
+ * @param period Sampling period in ms (<=0: only vfTDCLiveSample calls)
  *
+ * @return OK if successful, otherwise ERROR
+ * @sa vfTDCLiveSample
  */
 int
-vfTDCSetTriggerSource(int id, unsigned int trigmask)
+vfTDCLiveStart(int period)
 {
-  unsigned int supported = 
-    VFTDC_TRIGSRC_VXS |
-    VFTDC_TRIGSRC_HFBR1 | 
-    VFTDC_TRIGSRC_VME;
+  int ii, rval;
+#ifndef VXWORKS
+  int status;
 
-  if(id==0) id=vfTDCID[0];
+  if(vfTDCLiveRunning)
+    vfTDCLiveStop();
+#endif
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
-    {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
+  VLOCK;
+  memset((char *)vfTDCLive, 0, sizeof(vfTDCLive));
+  for(ii=0; ii<nvfTDC; ii++)
+    vfTDCLive[vfTDCID[ii]].slot = vfTDCID[ii];
+  VUNLOCK;
 
-  if(trigmask & ~supported)
+  rval = vfTDCLiveSample();
+  if((rval != OK) || (period <= 0))
+    return rval;
+
+#ifdef VXWORKS
+  printf("%s: WARN: Periodic sampling not supported for vxWorks\n",__FUNCTION__);
+#else
+  vfTDCLivePeriod  = period;
+  vfTDCLiveRunning = 1;
+  status = pthread_create(&vfTDCLiveThread, NULL, vfTDCLiveTask, NULL);
+  if(status != 0)
     {
-      printf("%s: ERROR: Unsupported Trigger source mask (0x%x).\n",
-	     __FUNCTION__,trigmask);
+      vfTDCLiveRunning = 0;
+      printf("%s: ERROR: Sampling thread could not be started.\n",__FUNCTION__);
+      printf("\t pthread_create returned: %d\n",status);
       return ERROR;
     }
-
-  VLOCK;
-  vmeWrite32(&TDCp[id]->trigsrc, trigmask);
-  VUNLOCK;
+#endif
 
   return OK;
 }
 
-#ifdef NOTYET
 /**
- * @ingroup Config
- * @brief Enable trigger sources
- * Enable trigger sources set by 
- *                          tiSetTriggerSource(...) or
- *                          tiSetTriggerSourceMask(...)
- * @param id Slot Number
- * @sa tiSetTriggerSource
- * @sa tiSetTriggerSourceMask
- *
- * @return OK if successful, ERROR otherwise
+ * @ingroup Status
+ * @brief Stop the periodic sampling of vfTDCLiveStart, and take a last sample.
  *
+ * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCEnableTriggerSource()
+vfTDCLiveStop()
 {
-  if(id==0) id=vfTDCID[0];
-
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
-    {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
-
-  if(tiTriggerSource==0)
+#ifndef VXWORKS
+  if(vfTDCLiveRunning)
     {
-      printf("%s: WARN: No Trigger Sources Enabled\n",__FUNCTION__);
+      vfTDCLiveRunning = 0;
+      if(pthread_join(vfTDCLiveThread, NULL) != 0)
+	{
+	  perror("pthread_join");
+	  return ERROR;
+	}
     }
+#endif
 
-  VLOCK;
-  vmeWrite32(&TDCp->trigsrc, tiTriggerSource);
-  VUNLOCK;
-
-  return OK;
-
+  return vfTDCLiveSample();
 }
 
 /**
- * @ingroup Config
- * @brief Disable trigger sources
- *    
- * @param id Slot Number
- * @param fflag 
- *   -  0: Disable Triggers
- *   - >0: Disable Triggers and generate enough triggers to fill the current block
+ * @ingroup Status
+ * @brief Sample the livetime, busytime and busy monitor of all initialized vfTDCs.
  *
- * @return OK if successful, ERROR otherwise
+ *   The live fraction of the interval since the previous sample and of the
+ *   run are updated.  The busy time of the interval is attributed to the
+ *   busy monitor bits that are set at the time of the sample (shared
+ *   equally when several are set), or counted as unattributed when none is
+ *   set, i.e. the board was not holding busy itself when sampled.  Sampling
+ *   more often gives a finer attribution.  The remainder of a share is
+ *   carried to the next sample, so no busy time is lost.
  *
+ *   May be called from any thread, also while vfTDCLiveStart samples
+ *   periodically.
+ *
+ * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCDisableTriggerSource(int fflag)
+vfTDCLiveSample()
 {
-  int regset=0;
-  if(id==0) id=vfTDCID[0];
+  unsigned int live[VFTDC_MAX_BOARDS], busy[VFTDC_MAX_BOARDS], mon[VFTDC_MAX_BOARDS];
+  unsigned int dlive, dbusy, monitor, nset, isrc;
+  struct vftdc_live_struct *lt;
+  int ii;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(nvfTDC==0)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: No vfTDCs initialized\n",__FUNCTION__);
       return ERROR;
     }
 
   VLOCK;
+  for(ii=0; ii<nvfTDC; ii++)
+    {
+      live[ii] = vmeRead32(&TDCp[vfTDCID[ii]]->livetime);
+      busy[ii] = vmeRead32(&TDCp[vfTDCID[ii]]->busytime);
+      mon[ii]  = vmeRead32(&TDCp[vfTDCID[ii]]->busy);
+    }
 
-  if(tiMaster)
-    regset = VFTDC_TRIGSRC_LOOPBACK;
+  for(ii=0; ii<nvfTDC; ii++)
+    {
+      lt = &vfTDCLive[vfTDCID[ii]];
+      lt->slot = vfTDCID[ii];
 
-  vmeWrite32(&TDCp->trigsrc,regset);
+      if(lt->nsamples > 0)
+	{
+	  /* Unsigned differences are correct across a 32bit rollover */
+	  dlive = live[ii] - lt->livetime;
+	  dbusy = busy[ii] - lt->busytime;
+
+	  lt->liveSum += dlive;
+	  lt->busySum += dbusy;
+	  if(dlive + dbusy)
+	    lt->liveFraction = (float)dlive / (float)(dlive + dbusy);
+	  if(lt->liveSum + lt->busySum)
+	    lt->runLiveFraction = 
+	      (float)lt->liveSum / (float)(lt->liveSum + lt->busySum);
+
+	  monitor = (mon[ii] & VFTDC_BUSY_MONITOR_MASK)>>16;
+	  if(dbusy)
+	    {
+	      nset = 0;
+	      for(isrc=0; isrc<VFTDC_LIVE_NSOURCES; isrc++)
+		if(monitor & (1<<isrc)) nset++;
 
-  VUNLOCK;
-  if(fflag && tiMaster)
-    {
-      tiFillToEndBlock();      
+	      if(nset == 0)
+		lt->busyUnattributed += dbusy;
+	      else
+		{
+		  dbusy += lt->busyRemainder;
+		  lt->busyRemainder = dbusy % nset;
+		  for(isrc=0; isrc<VFTDC_LIVE_NSOURCES; isrc++)
+		    if(monitor & (1<<isrc))
+		      lt->busyBySource[isrc] += dbusy / nset;
+		}
+	    }
+	}
+
+      lt->livetime = live[ii];
+      lt->busytime = busy[ii];
+      lt->monitor  = (mon[ii] & VFTDC_BUSY_MONITOR_MASK)>>16;
+      lt->nsamples++;
     }
+  VUNLOCK;
 
   return OK;
-
 }
-#endif /* NOTYET */
 
 /**
- * @ingroup Config
- * @brief Set the Sync source mask
+ * @ingroup Status
+ * @brief Return the live/busy time accounting of a vfTDC
  *
  * @param id Slot Number
- * @param sync - MASK indicating the sync source
- *       bit: description
- *       -  0: VXS
- *       -  1: HFBR1
- *       -  4: Software
- *
- * @return OK if successful, ERROR otherwise
+ * @param lt Where to store the accounting
  *
+ * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCSetSyncSource(int id, unsigned int sync)
+vfTDCLiveGet(int id, struct vftdc_live_struct *lt)
 {
-  unsigned int supported = 
-    VFTDC_SYNC_VXS |
-    VFTDC_SYNC_HFBR1 | 
-    VFTDC_SYNC_VME;
-
   if(id==0) id=vfTDCID[0];
 
   if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
@@ -1080,1270 +1605,6249 @@ vfTDCSetSyncSource(int id, unsigned int sync)
       return ERROR;
     }
 
-  if(sync & ~supported)
+  if(lt==NULL)
     {
-      printf("%s: ERROR: Invalid Sync Source Mask (%d).\n",
-	     __FUNCTION__,sync);
+      printf("%s: ERROR: Invalid pointer\n",__FUNCTION__);
       return ERROR;
     }
 
   VLOCK;
-  vmeWrite32(&TDCp[id]->sync,sync);
+  *lt = vfTDCLive[id];
   VUNLOCK;
 
   return OK;
 }
 
 /**
- * @ingroup Config
- * @brief Perform a "software" trigger
- *
- * @param id Slot Number
- *
- * @return OK if successful, ERROR otherwise
- *
+ * @ingroup Status
+ * @brief Print the live/busy time accounting of all initialized vfTDCs to standard out
  */
-int
-vfTDCSoftTrig(int id)
+void
+vfTDCLivePrint()
 {
-  if(id==0) id=vfTDCID[0];
+  struct vftdc_live_struct live, *lt = &live;
+  int ii, isrc;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  printf("\n");
+  printf("vfTDC Live Time\n");
+  printf("--------------------------------------------------------------------------------\n");
+  for(ii=0; ii<nvfTDC; ii++)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
-
-  VLOCK;
-  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_TRIGGER);
-  VUNLOCK;
+      VLOCK;
+      live = vfTDCLive[vfTDCID[ii]];
+      VUNLOCK;
+      printf(" Slot %2d: Live = %6.2f%% (last interval)  %6.2f%% (run)  samples = %u\n",
+	     vfTDCID[ii], 100.*lt->liveFraction, 100.*lt->runLiveFraction,
+	     lt->nsamples);
 
-  return OK;
+      if(lt->busySum == 0)
+	continue;
 
+      printf("   Busy time by source:\n");
+      for(isrc=0; isrc<VFTDC_LIVE_NSOURCES; isrc++)
+	{
+	  if(lt->busyBySource[isrc] == 0)
+	    continue;
+	  printf("     %-14s %6.2f%%\n",vfTDC_busy_monitor_names[isrc],
+		 100.*(double)lt->busyBySource[isrc] / (double)lt->busySum);
+	}
+      printf("     %-14s %6.2f%%\n","Unattributed",
+	     100.*(double)lt->busyUnattributed / (double)lt->busySum);
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
 }
 
+const char *vfTDC_instr_names[VFTDC_INSTR_NMETRICS] =
+  {
+    "Lock wait (ns)",
+    "DMA setup (ns)",
+    "DMA done wait (ns)",
+    "Words per transfer",
+    "BERR terminations",
+    "vfTDCReadBlock (ns)",
+    "vfTDCBReady (ns)"
+  };
+
 /**
- * @ingroup Config
- * @brief Set the trigger window paramters
+ * @ingroup Status
+ * @brief Sum the readout instrumentation histograms of all threads.
  *
- * @param id Slot Number
- * @param latency Look back since readout trigger (steps of 4ns)
- * @param width   width of the TDC readout window (steps of 4ns)
+ *   May be called at any time, from any thread, while the readout is running.
+ *   Requires the library to be compiled with -DVFTDC_INSTRUMENT.
  *
- * @return OK if successful, ERROR otherwise
+ * @param h Where to store the summed histograms
  *
+ * @return Number of threads with histograms, otherwise ERROR
  */
 int
-vfTDCSetWindowParamters(int id, int latency, int width)
+vfTDCInstrGet(struct vftdc_instr_struct *h)
 {
-  if(id==0) id=vfTDCID[0];
+#ifdef VFTDC_INSTRUMENT
+  int ithr, nthr, imet, ibin;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(h==NULL)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Invalid pointer\n",__FUNCTION__);
       return ERROR;
     }
 
-  if((latency<0) || (latency>VFTDC_PL_MASK))
-    {
-      printf("%s: ERROR: Invalid latency (%d)\n",
-	     __FUNCTION__,latency);
+  memset((char *)h, 0, sizeof(struct vftdc_instr_struct));
+
+  nthr = vfTDCInstrNthreads;
+  if(nthr > VFTDC_INSTR_MAX_THREADS)
+    nthr = VFTDC_INSTR_MAX_THREADS;
+
+  for(ithr=0; ithr<nthr; ithr++)
+    for(imet=0; imet<VFTDC_INSTR_NMETRICS; imet++)
+      {
+	for(ibin=0; ibin<VFTDC_INSTR_NBINS; ibin++)
+	  h->bin[imet][ibin] += vfTDCInstr[ithr].bin[imet][ibin];
+	h->sum[imet] += vfTDCInstr[ithr].sum[imet];
+      }
+
+  return nthr;
+#else
+  printf("%s: ERROR: Library not compiled with VFTDC_INSTRUMENT\n",__FUNCTION__);
+  return ERROR;
+#endif
+}
+
+/**
+ * @ingroup Status
+ * @brief Print the readout instrumentation histograms (all threads) to standard out
+ */
+void
+vfTDCInstrPrint()
+{
+  struct vftdc_instr_struct h;
+  unsigned long long n;
+  int nthr, imet, ibin;
+
+  nthr = vfTDCInstrGet(&h);
+  if(nthr == ERROR)
+    return;
+
+  printf("\n");
+  printf("vfTDC Readout Instrumentation (%d threads)\n",nthr);
+  printf("--------------------------------------------------------------------------------\n");
+  for(imet=0; imet<VFTDC_INSTR_NMETRICS; imet++)
+    {
+      n = 0;
+      for(ibin=0; ibin<VFTDC_INSTR_NBINS; ibin++)
+	n += h.bin[imet][ibin];
+      if(n == 0)
+	continue;
+
+      printf(" %-20s  entries = %llu  mean = %.1f\n",
+	     vfTDC_instr_names[imet], n, (double)h.sum[imet] / (double)n);
+      for(ibin=0; ibin<VFTDC_INSTR_NBINS; ibin++)
+	{
+	  if(h.bin[imet][ibin] == 0)
+	    continue;
+	  printf("   [%10llu, %10llu)  %llu\n",
+		 (ibin==0) ? 0ULL : (1ULL<<(ibin-1)), 1ULL<<ibin,
+		 h.bin[imet][ibin]);
+	}
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  printf("\n");
+}
+
+#ifdef NOTYET
+/**
+ * @ingroup Status
+ * @brief Get the Firmware Version
+ *
+ * @param id Slot Number
+ * @return Firmware Version if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCGetFirmwareVersion()
+{
+  unsigned int rval=0;
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
       return ERROR;
     }
 
-  if((width<0)||(width>VFTDC_PTW_MASK))
+  VLOCK;
+  /* reset the VME_to_JTAG engine logic */
+  vmeWrite32(&TDCp->reset,VFTDC_RESET_JTAG);
+
+  /* Reset FPGA JTAG to "reset_idle" state */
+  vmeWrite32(&TDCp->JTAGFPGABase[(0x003C)>>2],0);
+
+  /* enable the user_code readback */
+  vmeWrite32(&TDCp->JTAGFPGABase[(0x092C)>>2],0x3c8);
+
+  /* shift in 32-bit to FPGA JTAG */
+  vmeWrite32(&TDCp->JTAGFPGABase[(0x1F1C)>>2],0);
+  
+  /* Readback the firmware version */
+  rval = vmeRead32(&TDCp->JTAGFPGABase[(0x1F1C)>>2]);
+  VUNLOCK;
+
+  return rval;
+}
+
+
+/**
+ * @ingroup Status
+ * @brief Get the Module Serial Number
+ *
+ * @param id Slot Number
+ * @param rSN  Pointer to string to pass Serial Number
+ *
+ * @return SerialNumber if successful, ERROR otherwise
+ *
+ */
+unsigned int
+vfTDCGetSerialNumber(char **rSN)
+{
+  unsigned int rval=0;
+  char retSN[10];
+
+  memset(retSN,0,sizeof(retSN));
+  
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
     {
-      printf("%s: ERROR: Invalid width (%d)\n",
-	     __FUNCTION__,width);
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
       return ERROR;
     }
 
   VLOCK;
-  vmeWrite32(&TDCp[id]->pl,  latency);
-  vmeWrite32(&TDCp[id]->ptw, width);
+  vmeWrite32(&TDCp->reset,VFTDC_RESET_JTAG);           /* reset */
+  vmeWrite32(&TDCp->JTAGPROMBase[(0x3c)>>2],0);     /* Reset_idle */
+  vmeWrite32(&TDCp->JTAGPROMBase[(0xf2c)>>2],0xFD); /* load the UserCode Enable */
+  vmeWrite32(&TDCp->JTAGPROMBase[(0x1f1c)>>2],0);   /* shift in 32-bit of data */
+  rval = vmeRead32(&TDCp->JTAGPROMBase[(0x1f1c)>>2]);
   VUNLOCK;
 
-  return OK;
+  if(rSN!=NULL)
+    {
+      sprintf(retSN,"TI-%d",rval&0x7ff);
+      strcpy((char *)rSN,retSN);
+    }
+
+
+  printf("%s: TI Serial Number is %s (0x%08x)\n", 
+	 __FUNCTION__,retSN,rval);
+
+  return rval;
+  
+
 }
+#endif /* NOTYET */
 
-const char *vfTDC_blockerror_names[VFTDC_BLOCKERROR_NTYPES] =
-  {
-    "No Error",
-    "Termination on word count",
-    "Unknown Bus Error",
-    "Zero Word Count",
-    "DmaDone(..) Error"
-  };
+/**
+ * @ingroup Config
+ * @brief Perform a soft reset of the TI
+ *
+ * @param id Slot Number
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCReset(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+  
+  VLOCK;
+  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SOFT);
+  VUNLOCK;
+  return OK;
+}
 
 /**
- *  @ingroup Readout
- *  @brief Return the block error flag and optionally print out the description to standard out
- *  @param pflag If >0 will print the error flag to standard out.
- *  @return Block Error flag.
- *  @sa VFTDC_BLOCKERROR_FLAGS
+ * @ingroup Config
+ * @brief Set the number of events per block
+ * @param id Slot Number
+ * @param blockLevel Number of events per block
+ * @return OK if successful, ERROR otherwise
+ *
  */
 int
-vfTDCReadBlockStatus(int pflag)
+vfTDCSetBlockLevel(int id, int blockLevel)
 {
-  if(pflag)
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
     {
-      if(vfTDCBlockError!=VFTDC_BLOCKERROR_NO_ERROR)
-	{
-	  printf("\n%s: ERROR: %s\n",
-		 __FUNCTION__,vfTDC_blockerror_names[vfTDCBlockError]);
-	}
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
     }
 
-  return vfTDCBlockError;
-}
+  if((blockLevel<1) || (blockLevel>255))
+    {
+      printf("%s: ERROR: Invalid blockLevel (%d)\n",
+	     __FUNCTION__,blockLevel);
+      return ERROR;
+    }
 
+  VLOCK;
+  vmeWrite32(&TDCp[id]->blocklevel,blockLevel);
+  VUNLOCK;
+  return OK;
+}
 
 /**
- *  @ingroup Readout
- *  @brief General Data readout routine
+ * @ingroup Config
+ * @brief Set trigger sources with specified trigmask
+ *
+ * @param id Slot Number
+ * @param trigmask bits:  
+ *         - 0: VXS
+ *         - 1: HFBR#1
+ *         - 4: Software
+ *
+ * @return OK if successful, ERROR otherwise
  *
- *  @param  id     Slot number of module to read
- *  @param  data   local memory address to place data
- *  @param  nwrds  Max number of words to transfer
- *  @param  rflag  Readout Flag
- * <pre>
- *              0 - programmed I/O from the specified board
- *              1 - DMA transfer using Universe/Tempe DMA Engine 
- *                    (DMA VME transfer Mode must be setup prior)
- *              2 - Multiblock DMA transfer (Multiblock must be enabled
- *                     and daisychain in place or SD being used)
- * </pre>
- *  @return Number of words inserted into data if successful.  Otherwise ERROR.
  */
 int
-vfTDCReadBlock(int id, volatile UINT32 *data, int nwrds, int rflag)
+vfTDCSetTriggerSource(int id, unsigned int trigmask)
 {
-  int ii, blknum;
-  int stat, retVal, xferCount, rmode;
-  int dCnt, berr=0;
-  int dummy=0;
-  volatile unsigned int *laddr;
-  unsigned int bhead, ehead, val;
-  unsigned int vmeAdr, csr;
+  unsigned int supported = 
+    VFTDC_TRIGSRC_VXS |
+    VFTDC_TRIGSRC_HFBR1 | 
+    VFTDC_TRIGSRC_VME;
 
   if(id==0) id=vfTDCID[0];
 
   if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
     {
-      logMsg("\nvfTDCReadBlock: ERROR : VFTDC in slot %d is not initialized\n\n",id,0,0,0,0,0);
-      return(ERROR);
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
     }
 
-  if(data==NULL) 
+  if(trigmask & ~supported)
     {
-      logMsg("\nvfTDCReadBlock: ERROR: Invalid Destination address\n\n",0,0,0,0,0,0);
-      return(ERROR);
+      printf("%s: ERROR: Unsupported Trigger source mask (0x%x).\n",
+	     __FUNCTION__,trigmask);
+      return ERROR;
     }
 
-  vfTDCBlockError=VFTDC_BLOCKERROR_NO_ERROR;
-  if(nwrds <= 0) nwrds= (VFTDC_MAX_TDC_CHANNELS*VFTDC_MAX_DATA_PER_CHANNEL) + 8;
-  rmode = rflag&0x0f;
-  
-  if(rmode >= 1) 
-    { /* Block Transfers */
-    
-      /*Assume that the DMA programming is already setup. */
-      /* Don't Bother checking if there is valid data - that should be done prior
-	 to calling the read routine */
+  VLOCK;
+  vmeWrite32(&TDCp[id]->trigsrc, trigmask);
+  VUNLOCK;
 
-      /* Check for 8 byte boundary for address - insert dummy word (Slot 0 VFTDC Dummy DATA)*/
-      if((unsigned long) (data)&0x7) 
-	{
-#ifdef VXWORKS
-	  *data = VFTDC_DUMMY_DATA;
-#else
-	  *data = LSWAP(VFTDC_DUMMY_DATA);
-#endif
-	  dummy = 1;
-	  laddr = (data + 1);
-	} 
-      else 
-	{
+  return OK;
+}
+
+#ifdef NOTYET
+/**
+ * @ingroup Config
+ * @brief Enable trigger sources
+ * Enable trigger sources set by 
+ *                          tiSetTriggerSource(...) or
+ *                          tiSetTriggerSourceMask(...)
+ * @param id Slot Number
+ * @sa tiSetTriggerSource
+ * @sa tiSetTriggerSourceMask
+ *
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCEnableTriggerSource()
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if(tiTriggerSource==0)
+    {
+      printf("%s: WARN: No Trigger Sources Enabled\n",__FUNCTION__);
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp->trigsrc, tiTriggerSource);
+  VUNLOCK;
+
+  return OK;
+
+}
+
+/**
+ * @ingroup Config
+ * @brief Disable trigger sources
+ *    
+ * @param id Slot Number
+ * @param fflag 
+ *   -  0: Disable Triggers
+ *   - >0: Disable Triggers and generate enough triggers to fill the current block
+ *
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCDisableTriggerSource(int fflag)
+{
+  int regset=0;
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+
+  if(tiMaster)
+    regset = VFTDC_TRIGSRC_LOOPBACK;
+
+  vmeWrite32(&TDCp->trigsrc,regset);
+
+  VUNLOCK;
+  if(fflag && tiMaster)
+    {
+      tiFillToEndBlock();      
+    }
+
+  return OK;
+
+}
+#endif /* NOTYET */
+
+/**
+ * @ingroup Config
+ * @brief Set the Sync source mask
+ *
+ * @param id Slot Number
+ * @param sync - MASK indicating the sync source
+ *       bit: description
+ *       -  0: VXS
+ *       -  1: HFBR1
+ *       -  4: Software
+ *
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCSetSyncSource(int id, unsigned int sync)
+{
+  unsigned int supported = 
+    VFTDC_SYNC_VXS |
+    VFTDC_SYNC_HFBR1 | 
+    VFTDC_SYNC_VME;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if(sync & ~supported)
+    {
+      printf("%s: ERROR: Invalid Sync Source Mask (%d).\n",
+	     __FUNCTION__,sync);
+      return ERROR;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->sync,sync);
+  VUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Perform a "software" trigger
+ *
+ * @param id Slot Number
+ *
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCSoftTrig(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_TRIGGER);
+  VUNLOCK;
+
+  return OK;
+
+}
+
+/**
+ * @ingroup Config
+ * @brief Set the trigger window paramters
+ *
+ * @param id Slot Number
+ * @param latency Look back since readout trigger (steps of 4ns)
+ * @param width   width of the TDC readout window (steps of 4ns)
+ *
+ * @return OK if successful, ERROR otherwise
+ *
+ */
+int
+vfTDCSetWindowParamters(int id, int latency, int width)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if((latency<0) || (latency>VFTDC_PL_MASK))
+    {
+      printf("%s: ERROR: Invalid latency (%d)\n",
+	     __FUNCTION__,latency);
+      return ERROR;
+    }
+
+  if((width<0)||(width>VFTDC_PTW_MASK))
+    {
+      printf("%s: ERROR: Invalid width (%d)\n",
+	     __FUNCTION__,width);
+      return ERROR;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->pl,  latency);
+  vmeWrite32(&TDCp[id]->ptw, width);
+  VUNLOCK;
+
+  return OK;
+}
+
+#ifndef VXWORKS
+/*************************************************************
+ Readout buffer pool.
+
+ DMA buffers come from a jvme pool (dmaPCreate), which is physically
+ contiguous driver memory, so DMA needs no scatter list and huge pages
+ would not help.  The pool is created once, every buffer is locked in
+ memory and written to, so readout never takes a page fault, and the
+ alignment of the buffers is checked.
+*************************************************************/
+
+static DMA_MEM_ID vfTDCPool = NULL;
+static struct vftdc_pool_stats_struct vfTDCPoolStat;
+/* Addresses of the buffers of the pool, to recognize them in vfTDCPoolFree */
+static unsigned long vfTDCPoolLo = 0, vfTDCPoolHi = 0;
+
+/**
+ * @ingroup Readout
+ * @brief Allocate a buffer aligned to VFTDC_ALIGN_BYTES (cache line),
+ *    e.g. for decoding or copies of the readout data.  Not for DMA.
+ *
+ * @param nwords Size of the buffer in 32 bit words
+ *
+ * @return Buffer, to free with free(), if successful.  Otherwise NULL.
+ */
+unsigned int *
+vfTDCAllocAligned(int nwords)
+{
+  void *buf = NULL;
+
+  if(nwords <= 0)
+    {
+      printf("%s: ERROR: Invalid size (%d)\n",__FUNCTION__,nwords);
+      return NULL;
+    }
+
+  if(posix_memalign(&buf, VFTDC_ALIGN_BYTES, nwords*sizeof(unsigned int)) != 0)
+    {
+      printf("%s: ERROR: posix_memalign failed\n",__FUNCTION__);
+      return NULL;
+    }
+
+  return (unsigned int *)buf;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Create the readout buffer pool
+ *
+ * @param nbuffers Number of buffers
+ * @param nbytes Size of each buffer in bytes
+ *
+ * @return Pool ID, to use with vfTDCPoolGet or GETEVENT, if successful.
+ *         Otherwise NULL.
+ */
+DMA_MEM_ID
+vfTDCPoolCreate(int nbuffers, int nbytes)
+{
+  DMANODE **node;
+  volatile char *p;
+  long pagesize;
+  int ibuf, nget=0;
+
+  if(vfTDCPool != NULL)
+    {
+      printf("%s: ERROR: Pool already created\n",__FUNCTION__);
+      return NULL;
+    }
+
+  if((nbuffers <= 0) || (nbytes <= 0))
+    {
+      printf("%s: ERROR: Invalid number of buffers (%d) or size (%d)\n",
+	     __FUNCTION__,nbuffers,nbytes);
+      return NULL;
+    }
+
+  node = (DMANODE **)calloc(nbuffers, sizeof(DMANODE *));
+  if(node == NULL)
+    {
+      perror("calloc");
+      return NULL;
+    }
+
+  vfTDCPool = dmaPCreate("vfTDCPool", nbytes, nbuffers, 0);
+  if(vfTDCPool == NULL)
+    {
+      printf("%s: ERROR: dmaPCreate failed\n",__FUNCTION__);
+      free(node);
+      return NULL;
+    }
+
+  memset(&vfTDCPoolStat, 0, sizeof(vfTDCPoolStat));
+  vfTDCPoolStat.nbuffers = nbuffers;
+  vfTDCPoolStat.nbytes   = nbytes;
+  vfTDCPoolStat.locked   = 1;
+  vfTDCPoolStat.aligned  = 1;
+  vfTDCPoolStat.cacheAligned = 1;
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  vfTDCPoolLo = ~0UL;
+  vfTDCPoolHi = 0;
+
+  /* Take every buffer once: lock it, touch every page, check alignment */
+  for(ibuf=0; ibuf<nbuffers; ibuf++)
+    {
+      node[ibuf] = dmaPGetItem(vfTDCPool);
+      if(node[ibuf] == NULL)
+	break;
+      nget++;
+
+      if(mlock((void *)node[ibuf]->data, nbytes) != 0)
+	vfTDCPoolStat.locked = 0;
+
+      for(p = (volatile char *)node[ibuf]->data; 
+	  p < (volatile char *)node[ibuf]->data + nbytes; p += pagesize)
+	*p = 0;
+      *((volatile char *)node[ibuf]->data + nbytes - 1) = 0;
+
+      if((unsigned long)node[ibuf]->data & 0x7)
+	vfTDCPoolStat.aligned = 0;
+      if((unsigned long)node[ibuf]->data & (VFTDC_ALIGN_BYTES-1))
+	vfTDCPoolStat.cacheAligned = 0;
+
+      if((unsigned long)node[ibuf]->data < vfTDCPoolLo)
+	vfTDCPoolLo = (unsigned long)node[ibuf]->data;
+      if((unsigned long)node[ibuf]->data + nbytes > vfTDCPoolHi)
+	vfTDCPoolHi = (unsigned long)node[ibuf]->data + nbytes;
+    }
+
+  for(ibuf=0; ibuf<nget; ibuf++)
+    dmaPFreeItem(node[ibuf]);
+  free(node);
+
+  if(nget != nbuffers)
+    printf("%s: WARN: Only %d of %d buffers available\n",
+	   __FUNCTION__,nget,nbuffers);
+  if(!vfTDCPoolStat.locked)
+    printf("%s: WARN: Buffers could not all be locked in memory (check ulimit -l)\n",
+	   __FUNCTION__);
+  if(!vfTDCPoolStat.aligned)
+    printf("%s: WARN: Buffers are not 8 byte aligned\n",__FUNCTION__);
+
+  return vfTDCPool;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Free the readout buffer pool
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCPoolDelete()
+{
+  if(vfTDCPool == NULL)
+    return OK;
+
+  if(vfTDCPoolStat.inUse)
+    printf("%s: WARN: %d buffer(s) still in use\n",__FUNCTION__,vfTDCPoolStat.inUse);
+
+  dmaPFree(vfTDCPool);
+  vfTDCPool = NULL;
+  vfTDCPoolLo = vfTDCPoolHi = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Take a buffer from the readout buffer pool
+ *
+ * @return Buffer if one is free, otherwise NULL
+ */
+DMANODE *
+vfTDCPoolGet()
+{
+  DMANODE *node;
+  int inUse, maxInUse;
+
+  if(vfTDCPool == NULL)
+    return NULL;
+
+  node = dmaPGetItem(vfTDCPool);
+  if(node == NULL)
+    {
+      VFTDC_ATOMIC_ADD(&vfTDCPoolStat.nfail, 1);
+      return NULL;
+    }
+
+  VFTDC_ATOMIC_ADD(&vfTDCPoolStat.nget, 1);
+  inUse = VFTDC_ATOMIC_ADD(&vfTDCPoolStat.inUse, 1);
+  maxInUse = vfTDCPoolStat.maxInUse;
+  while((inUse > maxInUse) &&
+	!VFTDC_ATOMIC_CAS(&vfTDCPoolStat.maxInUse, maxInUse, inUse))
+    maxInUse = vfTDCPoolStat.maxInUse;
+
+  return node;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Return a buffer from vfTDCPoolGet to the readout buffer pool
+ *
+ *   A buffer of another pool is returned to its own pool, and is not
+ *   counted as freed.
+ *
+ * @param node Buffer
+ */
+void
+vfTDCPoolFree(DMANODE *node)
+{
+  int pooled;
+
+  if(node == NULL)
+    return;
+
+  pooled = ((unsigned long)node->data >= vfTDCPoolLo) &&
+    ((unsigned long)node->data < vfTDCPoolHi);
+
+  dmaPFreeItem(node);
+  if(pooled)
+    VFTDC_ATOMIC_SUB(&vfTDCPoolStat.inUse, 1);
+}
+
+/**
+ * @ingroup Status
+ * @brief Return the readout buffer pool statistics
+ *
+ * @param stats Where to return the statistics
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCPoolGetStats(struct vftdc_pool_stats_struct *stats)
+{
+  if(stats == NULL)
+    {
+      printf("%s: ERROR: Invalid stats pointer\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(vfTDCPool == NULL)
+    {
+      printf("%s: ERROR: Pool not created\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  *stats = vfTDCPoolStat;
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Print the readout buffer pool statistics
+ */
+void
+vfTDCPoolPrintStats()
+{
+  if(vfTDCPool == NULL)
+    {
+      printf("%s: Pool not created\n",__FUNCTION__);
+      return;
+    }
+
+  printf("%s:\n",__FUNCTION__);
+  printf("  Buffers: %d x %d bytes, %s, %s\n",
+	 vfTDCPoolStat.nbuffers, vfTDCPoolStat.nbytes,
+	 vfTDCPoolStat.locked ? "locked" : "NOT locked",
+	 vfTDCPoolStat.cacheAligned ? "cache line aligned" :
+	 (vfTDCPoolStat.aligned ? "8 byte aligned" : "NOT aligned"));
+  printf("  In use: %d (max %d)  Taken: %u  Failed: %u\n",
+	 vfTDCPoolStat.inUse, vfTDCPoolStat.maxInUse,
+	 vfTDCPoolStat.nget, vfTDCPoolStat.nfail);
+}
+#endif /* VXWORKS */
+
+/*************************************************************
+ Configuration file.
+
+ Text file with one keyword and value per line, '#' starts a comment:
+
+   VFTDC_CRATE  all             # or the host name of the ROC
+   VFTDC_A32_BASE  0x09000000   # Used by vfTDCInit
+   VFTDC_SLOT  all              # Defaults for all slots
+   VFTDC_WINDOW_LATENCY  100    # 4 ns steps
+   VFTDC_WINDOW_WIDTH    250    # 4 ns steps
+   VFTDC_CLOCK_SOURCE  VXS      # INT, HFBR1 or VXS
+   VFTDC_TRIG_SOURCE   VXS      # VME, HFBR1 or VXS
+   VFTDC_SYNC_SOURCE   VXS      # VME, HFBR1 or VXS
+   VFTDC_SLOT  5                # Settings for slot 5 only
+   VFTDC_WINDOW_WIDTH    200
+   VFTDC_CRATE  end
+
+ Only the sections for all crates or this host are used.
+*************************************************************/
+
+/* Register value for an (upper case) source name, or -1 if not valid */
+static int
+vfTDCConfigSource(const char *name, int clock)
+{
+  if(clock)
+    {
+      if(!strcmp(name,"INT") || !strcmp(name,"INTERNAL")) return VFTDC_CLOCK_INTERNAL;
+      if(!strcmp(name,"HFBR1")) return VFTDC_CLOCK_HFBR1;
+      if(!strcmp(name,"VXS"))   return VFTDC_CLOCK_VXS;
+    }
+  else
+    {
+      /* VFTDC_TRIGSRC_* and VFTDC_SYNC_* have the same bits */
+      if(!strcmp(name,"VME") || !strcmp(name,"SOFT")) return VFTDC_TRIGSRC_VME;
+      if(!strcmp(name,"HFBR1")) return VFTDC_TRIGSRC_HFBR1;
+      if(!strcmp(name,"VXS"))   return VFTDC_TRIGSRC_VXS;
+    }
+
+  return -1;
+}
+
+/**
+ * @ingroup Config
+ * @brief Read module settings from a configuration file
+ *
+ * @param filename Name of the configuration file
+ * @param cfg Where to store the settings.  Settings not in the file are -1.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCConfigRead(const char *filename, struct vftdc_config_struct *cfg)
+{
+  FILE *f;
+  char line[256], host[128], key[64], val[64], uval[64], *c;
+  int lineno=0, active=1, slot=0, islot, ival, nerr=0;
+
+  if(cfg == NULL)
+    {
+      printf("%s: ERROR: Invalid config pointer\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  memset(cfg, 0, sizeof(struct vftdc_config_struct));
+  for(islot=0; islot<=VFTDC_MAX_SLOT; islot++)
+    {
+      cfg->slot[islot].latency = -1;
+      cfg->slot[islot].width   = -1;
+      cfg->slot[islot].clock   = -1;
+      cfg->slot[islot].trigsrc = -1;
+      cfg->slot[islot].sync    = -1;
+    }
+
+  f = fopen(filename, "r");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Cannot open %s\n",__FUNCTION__,filename);
+      return ERROR;
+    }
+
+  memset(host, 0, sizeof(host));
+  gethostname(host, sizeof(host)-1);
+  /* Short host name */
+  if((c = strchr(host,'.')) != NULL)
+    *c = 0;
+
+  while(fgets(line, sizeof(line), f) != NULL)
+    {
+      lineno++;
+      if((c = strchr(line,'#')) != NULL)
+	*c = 0;
+      val[0] = 0;
+      if(sscanf(line, "%63s %63s", key, val) < 1)
+	continue;
+      for(c=val; ; c++)
+	{
+	  uval[c-val] = toupper((unsigned char)*c);
+	  if(*c == 0)
+	    break;
+	}
+
+      if(!strcmp(key,"VFTDC_CRATE"))
+	{
+	  if(!strcmp(uval,"END"))
+	    active = 0;
+	  else
+	    active = (!strcmp(uval,"ALL") || !strcmp(val,host));
+	  slot = 0;
+	  continue;
+	}
+
+      if(!active)
+	continue;
+
+      ival = (int)strtol(val, NULL, 0);
+
+      if(!strcmp(key,"VFTDC_A32_BASE"))
+	cfg->a32Base = (unsigned int)strtoul(val, NULL, 0);
+      else if(!strcmp(key,"VFTDC_SLOT"))
+	{
+	  if(!strcmp(uval,"ALL"))
+	    slot = 0;
+	  else if((ival > 0) && (ival <= VFTDC_MAX_SLOT))
+	    slot = ival;
+	  else
+	    {
+	      printf("%s: ERROR: %s line %d: Invalid slot (%s).  Settings ignored until the next VFTDC_SLOT.\n",
+		     __FUNCTION__,filename,lineno,val);
+	      slot = -1;
+	      nerr++;
+	    }
+	}
+      else if(slot < 0)
+	continue; /* Settings of an invalid slot */
+      else if(!strcmp(key,"VFTDC_WINDOW_LATENCY"))
+	{
+	  if((ival < 0) || (ival > VFTDC_PL_MASK))
+	    {
+	      printf("%s: ERROR: %s line %d: Invalid latency (%s)\n",
+		     __FUNCTION__,filename,lineno,val);
+	      nerr++;
+	    }
+	  else
+	    cfg->slot[slot].latency = ival;
+	}
+      else if(!strcmp(key,"VFTDC_WINDOW_WIDTH"))
+	{
+	  if((ival < 0) || (ival > VFTDC_PTW_MASK))
+	    {
+	      printf("%s: ERROR: %s line %d: Invalid width (%s)\n",
+		     __FUNCTION__,filename,lineno,val);
+	      nerr++;
+	    }
+	  else
+	    cfg->slot[slot].width = ival;
+	}
+      else if(!strcmp(key,"VFTDC_CLOCK_SOURCE") ||
+	      !strcmp(key,"VFTDC_TRIG_SOURCE") ||
+	      !strcmp(key,"VFTDC_SYNC_SOURCE"))
+	{
+	  ival = vfTDCConfigSource(uval, !strcmp(key,"VFTDC_CLOCK_SOURCE"));
+	  if(ival < 0)
+	    {
+	      printf("%s: ERROR: %s line %d: Invalid source (%s)\n",
+		     __FUNCTION__,filename,lineno,val);
+	      nerr++;
+	    }
+	  else if(!strcmp(key,"VFTDC_CLOCK_SOURCE"))
+	    cfg->slot[slot].clock = ival;
+	  else if(!strcmp(key,"VFTDC_TRIG_SOURCE"))
+	    cfg->slot[slot].trigsrc = ival;
+	  else
+	    cfg->slot[slot].sync = ival;
+	}
+      else
+	{
+	  printf("%s: WARN: %s line %d: Unknown keyword (%s)\n",
+		 __FUNCTION__,filename,lineno,key);
+	}
+    }
+
+  fclose(f);
+
+  return (nerr > 0) ? ERROR : OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Apply settings from vfTDCConfigRead to all initialized modules
+ *
+ *   The registers of all modules are read back, and only those that differ
+ *   from the settings are written.  Settings for a slot take precedence over
+ *   the settings for all slots.  A clock source change is followed by the
+ *   clock and soft resets of that module.
+ *
+ * @param cfg Settings from vfTDCConfigRead
+ *
+ * @return Number of registers written if successful, otherwise ERROR
+ */
+int
+vfTDCConfigApply(struct vftdc_config_struct *cfg)
+{
+  struct vftdc_slot_config_struct sc;
+  int itdc, id, nwrite=0, nclock=0;
+  int clockChange[VFTDC_MAX_BOARDS];
+  unsigned int clkReg;
+
+  if(cfg == NULL)
+    {
+      printf("%s: ERROR: Invalid config pointer\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  memset((char *)clockChange,0,sizeof(clockChange));
+
+  VLOCK;
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      id = vfTDCID[itdc];
+
+      /* Slot settings, or the defaults for all slots */
+      sc = cfg->slot[id];
+      if(sc.latency < 0) sc.latency = cfg->slot[0].latency;
+      if(sc.width   < 0) sc.width   = cfg->slot[0].width;
+      if(sc.clock   < 0) sc.clock   = cfg->slot[0].clock;
+      if(sc.trigsrc < 0) sc.trigsrc = cfg->slot[0].trigsrc;
+      if(sc.sync    < 0) sc.sync    = cfg->slot[0].sync;
+
+      if((sc.latency >= 0) &&
+	 ((int)(vmeRead32(&TDCp[id]->pl) & VFTDC_PL_MASK) != sc.latency))
+	{
+	  vmeWrite32(&TDCp[id]->pl, sc.latency);
+	  nwrite++;
+	}
+
+      if((sc.width >= 0) &&
+	 ((int)(vmeRead32(&TDCp[id]->ptw) & VFTDC_PTW_MASK) != sc.width))
+	{
+	  vmeWrite32(&TDCp[id]->ptw, sc.width);
+	  nwrite++;
+	}
+
+      if((sc.trigsrc >= 0) &&
+	 ((int)(vmeRead32(&TDCp[id]->trigsrc) & VFTDC_TRIGSRC_SOURCEMASK) != sc.trigsrc))
+	{
+	  vmeWrite32(&TDCp[id]->trigsrc, sc.trigsrc);
+	  nwrite++;
+	}
+
+      if((sc.sync >= 0) &&
+	 ((int)(vmeRead32(&TDCp[id]->sync) & VFTDC_SYNC_SOURCEMASK) != sc.sync))
+	{
+	  vmeWrite32(&TDCp[id]->sync, sc.sync);
+	  nwrite++;
+	}
+
+      if(sc.clock >= 0)
+	{
+	  clkReg = sc.clock | (sc.clock<<2) | (sc.clock<<4) | (sc.clock<<6);
+	  if((vmeRead32(&TDCp[id]->clock) & VFTDC_CLOCK_ALL_MASK) != clkReg)
+	    {
+	      vmeWrite32(&TDCp[id]->clock, clkReg);
+	      clockChange[itdc] = 1;
+	      nwrite++;
+	      nclock++;
+	    }
+	}
+    }
+  VUNLOCK;
+
+  /* Resets needed after a clock source change */
+  if(nclock)
+    {
+      taskDelay(1);
+      for(itdc=0; itdc<nvfTDC; itdc++)
+	{
+	  if(!clockChange[itdc])
+	    continue;
+	  id = vfTDCID[itdc];
+	  /* Not holding the mutex while waiting */
+	  VLOCK;
+	  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_CLK250);
+	  VUNLOCK;
+	  taskDelay(1);
+	  VLOCK;
+	  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_IODELAY);
+	  VUNLOCK;
+	  taskDelay(1);
+	  VLOCK;
+	  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SOFT);
+	  VUNLOCK;
+	}
+      taskDelay(5);
+    }
+
+  printf("%s: %d register(s) written, %d clock source change(s)\n",
+	 __FUNCTION__,nwrite,nclock);
+
+  return nwrite;
+}
+
+/*************************************************************
+ Readout path logging.
+
+ The readout routines only enqueue a message code and up to three
+ arguments into a lock-free ring.  When the logging thread is running
+ (vfTDCLogStart), it formats the messages and limits each code to
+ vfTDCLogRateLimit messages per second.  Otherwise messages are
+ printed immediately, as before.  Per-code counters are always exact.
+*************************************************************/
+
+const char *vfTDC_log_formats[VFTDC_LOG_MAX_CODES] =
+  {
+    "\nvfTDCReadBlock: ERROR : VFTDC in slot %d is not initialized\n\n",
+    "\nvfTDCReadBlock: ERROR: Invalid Destination address\n\n",
+    "\nvfTDCReadBlock: ERROR: Multiblock readout not yet supported\n\n",
+    "\nvfTDCReadBlock: ERROR in DMA transfer Initialization 0x%x\n\n",
+    "vfTDCReadBlock: DMA transfer terminated by unknown BUS Error (csr=0x%x xferCount=%d id=%d)\n",
+    "vfTDCReadBlock: WARN: DMA transfer terminated by word count 0x%x\n",
+    "vfTDCReadBlock: WARN: DMA transfer returned zero word count 0x%x\n",
+    "\nvfTDCReadBlock: ERROR: DmaDone returned an Error (0x%x)\n\n",
+    "vfTDCReadBlock: FIFO Empty (0x%08x)\n",
+    "\nvfTDCReadBlock: ERROR: Invalid Header Word 0x%08x\n\n",
+    "vfTDCRecoverReadout: Slot %d: Readout recovered (%d words drained)\n",
+    "\nvfTDCRecoverReadout: ERROR: Slot %d: Readout not realigned (block %d, event diff %d)\n\n",
+    "\nvfTDCCheckConsistency: ERROR: Slot %d out of sync (reason %d, value %d)\n\n",
+    "\nvfTDCWatchdog: ERROR: Slot %d readout stalled (type %d, for %d ms)\n\n",
+    "\nvfTDCReadBlock: ERROR: Slot %d: Destination not aligned for VFTDC_READOUT_ALIGNED\n\n"
+  };
+
+struct vftdc_log_entry
+{
+  volatile unsigned int seq;
+  int                   code;
+  int                   arg[3];
+};
+
+static struct vftdc_log_entry vfTDCLogRing[VFTDC_LOG_RING_SIZE];
+static volatile unsigned int  vfTDCLogHead = 0;  /* next position to write */
+static unsigned int           vfTDCLogTail = 0;  /* next position to read (logging thread only) */
+static volatile unsigned int  vfTDCLogCount[VFTDC_LOG_MAX_CODES];
+static volatile unsigned int  vfTDCLogDropped = 0;
+static volatile int           vfTDCLogNCodes = VFTDC_LOG_NCODES;
+static volatile int           vfTDCLogRunning = 0;
+static volatile int           vfTDCLogWriters = 0;   /* vfTDCLogEnqueue calls in progress */
+static volatile int           vfTDCLogQuit = 0;
+static int                    vfTDCLogRateLimit = 10;
+#ifndef VXWORKS
+static pthread_t              vfTDCLogThread;
+#endif
+
+/**
+ * @ingroup Status
+ * @brief Add a message format for the readout list, and return its code.
+ *
+ *   The format takes up to three integer arguments.  The string is not
+ *   copied, so it must remain valid.  Registering the same format again
+ *   returns the same code.
+ *
+ * @param format printf format of the message
+ *
+ * @return Message code for vfTDCLogEnqueue if successful, otherwise ERROR
+ */
+int
+vfTDCLogRegister(const char *format)
+{
+  int code;
+
+  if(format == NULL)
+    {
+      printf("%s: ERROR: Invalid format (NULL)\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  VLOCK;
+  /* Same format registered again (e.g. at the next Download) */
+  for(code=VFTDC_LOG_NCODES; code<vfTDCLogNCodes; code++)
+    {
+      if(strcmp(vfTDC_log_formats[code], format) == 0)
+	{
+	  VUNLOCK;
+	  return code;
+	}
+    }
+
+  if(vfTDCLogNCodes >= VFTDC_LOG_MAX_CODES)
+    {
+      VUNLOCK;
+      printf("%s: ERROR: No more message codes (max %d)\n",
+	     __FUNCTION__,VFTDC_LOG_MAX_CODES);
+      return ERROR;
+    }
+  code = vfTDCLogNCodes;
+  vfTDC_log_formats[code] = format;
+  VFTDC_BARRIER();
+  vfTDCLogNCodes = code + 1;
+  VUNLOCK;
+
+  return code;
+}
+
+/**
+ * @ingroup Status
+ * @brief Log a readout message by code, without formatting or printing it here.
+ *
+ * @param code Message code (VFTDC_LOG_*, or from vfTDCLogRegister)
+ * @param a1 First argument of the message format
+ * @param a2 Second argument
+ * @param a3 Third argument
+ */
+void
+vfTDCLogEnqueue(int code, int a1, int a2, int a3)
+{
+  struct vftdc_log_entry *e;
+  unsigned int pos, seq;
+
+  if((code<0) || (code>=vfTDCLogNCodes))
+    return;
+
+  VFTDC_ATOMIC_ADD(&vfTDCLogCount[code], 1);
+
+  /* vfTDCLogStop waits for the calls that saw the thread running */
+  VFTDC_ATOMIC_ADD(&vfTDCLogWriters, 1);
+  if(!vfTDCLogRunning)
+    {
+      VFTDC_ATOMIC_SUB(&vfTDCLogWriters, 1);
+      logMsg((char *)vfTDC_log_formats[code],a1,a2,a3,0,0,0);
+      return;
+    }
+
+  /* Bounded multi-producer ring: a cell is free for position pos when its seq == pos */
+  while(1)
+    {
+      pos = vfTDCLogHead;
+      e   = &vfTDCLogRing[pos & (VFTDC_LOG_RING_SIZE-1)];
+      seq = e->seq;
+      VFTDC_BARRIER();
+
+      if(seq == pos)
+	{
+	  if(VFTDC_ATOMIC_CAS(&vfTDCLogHead, pos, pos+1))
+	    break;
+	}
+      else if((int)(seq - pos) < 0)
+	{
+	  /* Full: drop, but the counter above is already updated */
+	  VFTDC_ATOMIC_ADD(&vfTDCLogDropped, 1);
+	  VFTDC_ATOMIC_SUB(&vfTDCLogWriters, 1);
+	  return;
+	}
+    }
+
+  e->code   = code;
+  e->arg[0] = a1;
+  e->arg[1] = a2;
+  e->arg[2] = a3;
+  VFTDC_BARRIER();
+  e->seq    = pos + 1;
+  VFTDC_ATOMIC_SUB(&vfTDCLogWriters, 1);
+}
+
+#ifndef VXWORKS
+/* Format the queued messages, at most vfTDCLogRateLimit per code per second */
+static void
+vfTDCLogDrain(unsigned int *nprinted, unsigned int *nsuppressed)
+{
+  struct vftdc_log_entry *e;
+  unsigned int pos;
+
+  while(1)
+    {
+      pos = vfTDCLogTail;
+      e   = &vfTDCLogRing[pos & (VFTDC_LOG_RING_SIZE-1)];
+      if(e->seq != pos + 1)
+	break;
+      VFTDC_BARRIER();
+
+      if(nprinted[e->code] < (unsigned int)vfTDCLogRateLimit)
+	{
+	  printf(vfTDC_log_formats[e->code], e->arg[0], e->arg[1], e->arg[2]);
+	  nprinted[e->code]++;
+	}
+      else
+	nsuppressed[e->code]++;
+
+      VFTDC_BARRIER();
+      e->seq = pos + VFTDC_LOG_RING_SIZE;
+      vfTDCLogTail = pos + 1;
+    }
+}
+
+static void *
+vfTDCLogTask(void *arg)
+{
+  unsigned int nprinted[VFTDC_LOG_MAX_CODES], nsuppressed[VFTDC_LOG_MAX_CODES];
+  unsigned long long tstart, now;
+  unsigned int dropped=0, ndropped;
+  int icode, quit;
+
+  prctl(PR_SET_NAME,"vfTDCLog");
+
+  memset(nprinted, 0, sizeof(nprinted));
+  memset(nsuppressed, 0, sizeof(nsuppressed));
+  tstart = vfTDCTimeUsec();
+
+  while(1)
+    {
+      /* After vfTDCLogQuit, nothing more is enqueued: this is the last drain */
+      quit = vfTDCLogQuit;
+      VFTDC_BARRIER();
+      vfTDCLogDrain(nprinted, nsuppressed);
+
+      now = vfTDCTimeUsec();
+      if((now - tstart >= 1000000ULL) || quit)
+	{
+	  for(icode=0; icode<VFTDC_LOG_MAX_CODES; icode++)
+	    {
+	      if(nsuppressed[icode])
+		printf("vfTDCLog: %u more messages of code %d suppressed\n",
+		       nsuppressed[icode],icode);
+	    }
+	  ndropped = vfTDCLogDropped;
+	  if(ndropped != dropped)
+	    {
+	      printf("vfTDCLog: %u messages dropped (ring full)\n",ndropped - dropped);
+	      dropped = ndropped;
+	    }
+
+	  memset(nprinted, 0, sizeof(nprinted));
+	  memset(nsuppressed, 0, sizeof(nsuppressed));
+	  tstart = now;
+	  fflush(stdout);
+
+	  if(quit)
+	    break;
+	}
+
+      usleep(10000);
+    }
+
+  return NULL;
+}
+#endif /* VXWORKS */
+
+/**
+ * @ingroup Status
+ * @brief Start the readout logging thread.
+ *
+ *   After this call, readout messages are formatted by a background thread
+ *   and limited to maxPerSecond messages per second for each message code.
+ *
+ * @param maxPerSecond Messages per second per code (<=0: default 10)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCLogStart(int maxPerSecond)
+{
+#ifdef VXWORKS
+  /* logMsg is already deferred to the logging task */
+  printf("%s: WARN: Not supported for vxWorks\n",__FUNCTION__);
+  return ERROR;
+#else
+  unsigned int ipos;
+  int status;
+
+  if(vfTDCLogRunning)
+    return OK;
+
+  vfTDCLogRateLimit = (maxPerSecond>0) ? maxPerSecond : 10;
+
+  for(ipos=0; ipos<VFTDC_LOG_RING_SIZE; ipos++)
+    vfTDCLogRing[ipos].seq = ipos;
+  vfTDCLogHead = vfTDCLogTail = 0;
+  vfTDCLogQuit = 0;
+  VFTDC_BARRIER();
+
+  vfTDCLogRunning = 1;
+  status = pthread_create(&vfTDCLogThread, NULL, vfTDCLogTask, NULL);
+  if(status != 0)
+    {
+      vfTDCLogRunning = 0;
+      printf("%s: ERROR: Logging thread could not be started.\n",__FUNCTION__);
+      printf("\t pthread_create returned: %d\n",status);
+      return ERROR;
+    }
+
+  return OK;
+#endif
+}
+
+/**
+ * @ingroup Status
+ * @brief Stop the readout logging thread, after printing what is still queued.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCLogStop()
+{
+#ifndef VXWORKS
+  unsigned int nleft;
+
+  if(!vfTDCLogRunning)
+    return OK;
+
+  /* New messages are printed directly.  Wait for those being enqueued,
+     so that the final drain of the thread includes them. */
+  vfTDCLogRunning = 0;
+  VFTDC_BARRIER();
+  while(vfTDCLogWriters > 0)
+    usleep(100);
+
+  vfTDCLogQuit = 1;
+  if(pthread_join(vfTDCLogThread, NULL) != 0)
+    {
+      perror("pthread_join");
+      return ERROR;
+    }
+
+  /* Should not happen: count anything still queued as dropped */
+  nleft = vfTDCLogHead - vfTDCLogTail;
+  if(nleft)
+    {
+      VFTDC_ATOMIC_ADD(&vfTDCLogDropped, nleft);
+      printf("vfTDCLog: %u messages dropped (queued after stop)\n",nleft);
+    }
+#endif
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Return the number of times a readout message code was logged
+ *
+ * @param code Message code (VFTDC_LOG_*)
+ * @return Count if successful, otherwise ERROR
+ */
+int
+vfTDCLogGetCount(int code)
+{
+  if((code<0) || (code>=vfTDCLogNCodes))
+    {
+      printf("%s: ERROR: Invalid code (%d)\n",__FUNCTION__,code);
+      return ERROR;
+    }
+
+  return vfTDCLogCount[code];
+}
+
+const char *vfTDC_blockerror_names[VFTDC_BLOCKERROR_NTYPES] =
+  {
+    "No Error",
+    "Termination on word count",
+    "Unknown Bus Error",
+    "Zero Word Count",
+    "DmaDone(..) Error",
+    "DMA Initialization Error",
+    "Invalid Block Header",
+    "Unaligned Destination"
+  };
+
+/**
+ *  @ingroup Readout
+ *  @brief Return the block error flag and optionally print out the description to standard out
+ *  @param pflag If >0 will print the error flag to standard out.
+ *  @return Block Error flag.
+ *  @sa VFTDC_BLOCKERROR_FLAGS
+ */
+int
+vfTDCReadBlockStatus(int pflag)
+{
+  if(pflag)
+    {
+      if(vfTDCBlockError!=VFTDC_BLOCKERROR_NO_ERROR)
+	{
+	  printf("\n%s: ERROR: %s\n",
+		 __FUNCTION__,vfTDC_blockerror_names[vfTDCBlockError]);
+	}
+    }
+
+  return vfTDCBlockError;
+}
+
+
+/* Return the index of the block trailer at the end of data (allowing for
+   trailing filler words), or -1 if the data does not end with a trailer */
+static int
+vfTDCFindTrailer(volatile unsigned int *data, int nwords)
+{
+  int iword;
+  unsigned int word, type;
+
+  for(iword=nwords-1; (iword>=0) && (iword>=nwords-4); iword--)
+    {
+      word = data[iword];
+#ifndef VXWORKS
+      word = LSWAP(word);
+#endif
+      if((word & VFTDC_DATA_TYPE_DEFINE) == 0)
+	return -1;
+
+      type = (word & VFTDC_DATA_TYPE_MASK) >> 27;
+      if(type == VFTDC_TYPE_BLOCK_TRAILER)
+	return iword;
+      if((type != VFTDC_TYPE_FILLER) && (type != VFTDC_TYPE_DATA_NOT_VALID))
+	return -1;
+    }
+
+  return -1;
+}
+
+static void vfTDCRecordBlockSize(int id, volatile unsigned int *data, int nwords);
+static void vfTDCRecordBlockHeader(int id, volatile unsigned int *data, int nwords);
+#ifndef VXWORKS
+static void vfTDCSampleTap(volatile unsigned int *data, int nwords);
+static volatile unsigned long long vfTDCSampleReadoutUsec;
+#endif
+
+/* Block transfer / programmed I/O behind vfTDCReadBlock */
+static int
+vfTDCReadBlockTransfer(int id, volatile UINT32 *data, int nwrds, int rflag,
+		       struct vftdc_readout_result *res)
+{
+  int ii, blknum;
+  int stat, retVal, xferCount, rmode;
+  int xferBase=0, xferWords=0, tight=0, overflow=0;
+  int dCnt, berr=0;
+  int dummy=0;
+  volatile unsigned int *laddr;
+  unsigned int bhead, ehead, val;
+  unsigned int vmeAdr, csr;
+  VFTDC_INSTR_DECL(tinstr);
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      vfTDCLogEnqueue(VFTDC_LOG_NOT_INITIALIZED,id,0,0);
+      return(ERROR);
+    }
+
+  if(data==NULL) 
+    {
+      vfTDCLogEnqueue(VFTDC_LOG_INVALID_DEST,0,0,0);
+      return(ERROR);
+    }
+
+  if((rflag & VFTDC_READOUT_ALIGNED) && 
+     ((unsigned long)data & (VFTDC_ALIGN_BYTES-1)))
+    {
+      vfTDCLogEnqueue(VFTDC_LOG_UNALIGNED_DEST,id,0,0);
+      res->error = VFTDC_BLOCKERROR_UNALIGNED_DEST;
+      return(ERROR);
+    }
+
+  if(nwrds <= 0) nwrds= (VFTDC_MAX_TDC_CHANNELS*VFTDC_MAX_DATA_PER_CHANNEL) + 8;
+  rmode = rflag&0x0f;
+  
+  if(rmode >= 1) 
+    { /* Block Transfers */
+    
+      /*Assume that the DMA programming is already setup. */
+      /* Don't Bother checking if there is valid data - that should be done prior
+	 to calling the read routine */
+
+      /* Check for 8 byte boundary for address - insert dummy word (Slot 0 VFTDC Dummy DATA)*/
+      if((unsigned long) (data)&0x7) 
+	{
+#ifdef VXWORKS
+	  *data = VFTDC_DUMMY_DATA;
+#else
+	  *data = LSWAP(VFTDC_DUMMY_DATA);
+#endif
+	  dummy = 1;
+	  res->dummy = 1;
+	  laddr = (data + 1);
+	} 
+      else 
+	{
 	  dummy = 0;
 	  laddr = data;
 	}
 
-      VLOCK;
-      if(rmode == 2) 
-	{ /* Multiblock Mode */
-#ifdef NOTSUPPORTED
-	  if((vmeRead32(&TDCp[id]->vmeControl)&VFTDC_VMECONTROL_FIRST_BOARD)==0) 
+      VFTDC_INSTR_VLOCK(tinstr);
+      if(rmode == 2) 
+	{ /* Multiblock Mode */
+#ifdef NOTSUPPORTED
+	  if((vmeRead32(&TDCp[id]->vmeControl)&VFTDC_VMECONTROL_FIRST_BOARD)==0) 
+	    {
+	      logMsg("\nvfTDCReadBlock: ERROR: VFTDC in slot %d is not First Board\n\n",id,0,0,0,0,0);
+	      VUNLOCK
+	      return(ERROR);
+	    }
+	  vmeAdr = (unsigned int)((unsigned long)(VFTDCpmb) - vfTDCA32Offset);
+#else
+	  vfTDCLogEnqueue(VFTDC_LOG_MBLK_UNSUPPORTED,0,0,0);
+	  VUNLOCK;
+	  return ERROR;
+#endif
+	}
+      else
+	{
+	  vmeAdr = (unsigned int)((unsigned long)TDCpd[id] - vfTDCA32Offset);
+	}
+
+      /* Tight transfer: program the predicted block size instead of nwrds */
+      xferWords = nwrds;
+      if((rflag & VFTDC_READOUT_TIGHT) && (rmode == 1))
+	{
+	  tight = vfTDCGetTransferSize(id);
+	  if((tight > 0) && (tight < nwrds))
+	    xferWords = tight;
+	}
+
+      VFTDC_INSTR_START(tinstr);
+#ifdef VXWORKS
+      retVal = sysVmeDmaSend((UINT32)laddr, vmeAdr, (xferWords<<2), 0);
+#else
+      retVal = vmeDmaSend((unsigned long)laddr, vmeAdr, (xferWords<<2));
+#endif
+      VFTDC_INSTR_STOP(VFTDC_INSTR_DMA_SETUP,tinstr);
+      if(retVal != 0) 
+	{
+	  vfTDCLogEnqueue(VFTDC_LOG_DMA_INIT_ERROR,retVal,0,0);
+	  res->error = VFTDC_BLOCKERROR_DMA_INIT_ERROR;
+	  VUNLOCK
+	  return(ERROR);
+	}
+
+      /* Wait until Done or Error */
+      VFTDC_INSTR_START(tinstr);
+#ifdef VXWORKS
+      retVal = sysVmeDmaDone(10000,1);
+#else
+      retVal = vmeDmaDone();
+#endif
+      VFTDC_INSTR_STOP(VFTDC_INSTR_DMA_WAIT,tinstr);
+
+      if(xferWords < nwrds)
+	{
+	  /* Tight transfer ended on word count, before the block trailer:
+	     the block is larger than predicted.  Transfer the rest, up to nwrds. */
+#ifdef VXWORKS
+	  overflow = (retVal == 0);
+#else
+	  overflow = ((retVal>>2) == xferWords) &&
+	    ((vmeRead32(&TDCp[id]->status) & VFTDC_STATUS_BERR) == 0);
+#endif
+	  if(overflow && (vfTDCFindTrailer(laddr, xferWords) >= 0))
+	    {
+	      /* Block ended exactly at the predicted size */
+	      VUNLOCK
+	      return(xferWords + dummy);
+	    }
+	  else if(overflow)
+	    {
+	      vfTDCTightFallback[id]++;
+	      xferBase  = xferWords;
+	      xferWords = nwrds - xferBase;
+	      VFTDC_INSTR_START(tinstr);
+#ifdef VXWORKS
+	      retVal = sysVmeDmaSend((UINT32)(laddr + xferBase), vmeAdr, (xferWords<<2), 0);
+#else
+	      retVal = vmeDmaSend((unsigned long)(laddr + xferBase), vmeAdr, (xferWords<<2));
+#endif
+	      VFTDC_INSTR_STOP(VFTDC_INSTR_DMA_SETUP,tinstr);
+	      if(retVal != 0) 
+		{
+		  vfTDCLogEnqueue(VFTDC_LOG_DMA_INIT_ERROR,retVal,0,0);
+		  /* First part of the block is already in data: report
+		     the whole block as lost so that it can be drained */
+		  res->error = VFTDC_BLOCKERROR_DMA_INIT_ERROR;
+		  VUNLOCK
+		  return(ERROR);
+		}
+	      VFTDC_INSTR_START(tinstr);
+#ifdef VXWORKS
+	      retVal = sysVmeDmaDone(10000,1);
+#else
+	      retVal = vmeDmaDone();
+#endif
+	      VFTDC_INSTR_STOP(VFTDC_INSTR_DMA_WAIT,tinstr);
+	    }
+	}
+
+      if(retVal > 0) 
+	{
+	  /* Check to see that Bus error was generated by VFTDC */
+	  if(rmode == 2) 
+	    {
+#ifdef NOTSUPPORTED
+	      csr = vmeRead32(&TDCp[vfTDCMaxSlot]->status);  /* from Last VFTDC */
+#endif
+	    }
+	  else
+	    {
+	      csr = vmeRead32(&TDCp[id]->status);
+	    }
+	  stat = (csr)&VFTDC_STATUS_BERR;
+	  res->csr = csr;
+
+	  if((retVal>0) && (stat)) 
+	    {
+	      VFTDC_INSTR_VALUE(VFTDC_INSTR_BERR_TERM,1);
+	      res->berrSlot = id;
+#ifdef VXWORKS
+	      xferCount = (xferBase + xferWords - (retVal>>2) + dummy);  /* Number of Longwords transfered */
+#else
+	      xferCount = (xferBase + (retVal>>2) + dummy);  /* Number of Longwords transfered */
+#endif
+	      VUNLOCK
+	      return(xferCount); /* Return number of data words transfered */
+	    }
+	  else
+	    {
+#ifdef VXWORKS
+	      xferCount = (xferBase + xferWords - (retVal>>2) + dummy);  /* Number of Longwords transfered */
+#else
+	      xferCount = (xferBase + (retVal>>2) + dummy);  /* Number of Longwords transfered */
+#endif
+	      vfTDCLogEnqueue(VFTDC_LOG_UNKNOWN_BERR,csr,xferCount,id);
+	      VUNLOCK
+	      res->error = VFTDC_BLOCKERROR_UNKNOWN_BUS_ERROR;
+	      return(xferCount);
+	    }
+	} 
+      else if (retVal == 0)
+	{ /* Block Error finished without Bus Error */
+#ifdef VXWORKS
+	  vfTDCLogEnqueue(VFTDC_LOG_TERM_WORDCOUNT,nwrds,0,0);
+	  res->error = VFTDC_BLOCKERROR_TERM_ON_WORDCOUNT;
+#else
+	  vfTDCLogEnqueue(VFTDC_LOG_ZERO_WORDCOUNT,nwrds,0,0);
+	  res->error = VFTDC_BLOCKERROR_ZERO_WORD_COUNT;
+#endif
+	  VUNLOCK
+	  return(xferBase + xferWords);
+	} 
+      else 
+	{  /* Error in DMA */
+	  vfTDCLogEnqueue(VFTDC_LOG_DMADONE_ERROR,retVal,0,0);
+	  VUNLOCK
+	  res->error = VFTDC_BLOCKERROR_DMADONE_ERROR;
+	  return(ERROR);
+	}
+
+    } 
+  else 
+    {  /*Programmed IO */
+
+      /* Check if Bus Errors are enabled. If so then disable for Prog I/O reading */
+      VFTDC_INSTR_VLOCK(tinstr);
+      berr = vmeRead32(&TDCp[id]->vmeControl)&VFTDC_VMECONTROL_BERR;
+      if(berr)
+	vmeWrite32(&TDCp[id]->vmeControl, 
+		   vmeRead32(&TDCp[id]->vmeControl) & ~VFTDC_VMECONTROL_BERR);
+
+      dCnt = 0;
+      /* Read Block Header - should be first word */
+      bhead = (unsigned int) *TDCpd[id]; 
+#ifndef VXWORKS
+      bhead = LSWAP(bhead);
+#endif
+      if((bhead&VFTDC_DATA_TYPE_DEFINE)&&((bhead&VFTDC_DATA_TYPE_MASK) == VFTDC_DATA_BLOCK_HEADER)) 
+	{
+	  blknum = bhead&VFTDC_DATA_BLKNUM_MASK;
+	  ehead = (unsigned int) *TDCpd[id];
+#ifndef VXWORKS
+	  ehead = LSWAP(ehead);
+#endif
+#ifdef VXWORKS
+	  data[dCnt] = bhead;
+#else
+	  data[dCnt] = LSWAP(bhead); /* Swap back to little-endian */
+#endif
+	  dCnt++;
+#ifdef VXWORKS
+	  data[dCnt] = ehead;
+#else
+	  data[dCnt] = LSWAP(ehead); /* Swap back to little-endian */
+#endif
+	  dCnt++;
+	}
+      else
+	{
+	  /* We got bad data - Check if there is any data at all */
+	  if( ((vmeRead32(&TDCp[id]->blockBuffer) & 
+		VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>16) == 0) 
+	    {
+	      vfTDCLogEnqueue(VFTDC_LOG_FIFO_EMPTY,bhead,0,0);
+	      VUNLOCK
+	      return(0);
+	    } 
+	  else 
+	    {
+	      vfTDCLogEnqueue(VFTDC_LOG_INVALID_HEADER,bhead,0,0);
+	      res->error = VFTDC_BLOCKERROR_INVALID_HEADER;
+	      VUNLOCK
+	      return(ERROR);
+	    }
+	}
+
+      ii=0;
+      while(ii<nwrds) 
+	{
+	  val = (unsigned int) *TDCpd[id];
+	  data[ii+2] = val;
+#ifndef VXWORKS
+	  val = LSWAP(val);
+#endif
+	  if( (val&VFTDC_DATA_TYPE_DEFINE) 
+	      && ((val&VFTDC_DATA_TYPE_MASK) == VFTDC_DATA_BLOCK_TRAILER) )
+	    break;
+	  ii++;
+	}
+      ii++;
+      dCnt += ii;
+
+
+      if(berr)
+	vmeWrite32(&TDCp[id]->vmeControl, 
+		   vmeRead32(&TDCp[id]->vmeControl) | VFTDC_VMECONTROL_BERR);
+
+      VUNLOCK
+      return(dCnt);
+    }
+
+  VUNLOCK
+  return(OK);
+}
+
+/**
+ *  @ingroup Readout
+ *  @brief General Data readout routine
+ *
+ *  @param  id     Slot number of module to read
+ *  @param  data   local memory address to place data
+ *  @param  nwrds  Max number of words to transfer
+ *  @param  rflag  Readout Flag
+ * <pre>
+ *              0 - programmed I/O from the specified board
+ *              1 - DMA transfer using Universe/Tempe DMA Engine 
+ *                    (DMA VME transfer Mode must be setup prior)
+ *              2 - Multiblock DMA transfer (Multiblock must be enabled
+ *                     and daisychain in place or SD being used)
+ *
+ *            Optional bits:
+ *              VFTDC_READOUT_ALIGNED - The destination must be aligned to
+ *                     VFTDC_ALIGN_BYTES (see vfTDCAlignDestination).
+ *                     Data always starts at data[0], no dummy word is
+ *                     inserted.  Otherwise ERROR is returned.
+ *              VFTDC_READOUT_HISTOGRAM - Add the hits of the data read to
+ *                     the occupancy and coarse time histograms
+ *                     (vfTDCHistInit, vfTDCHistSwap).
+ *              VFTDC_READOUT_SAMPLE - Copy some of the blocks for the
+ *                     sampling monitor (vfTDCSampleStart).
+ *              VFTDC_READOUT_AUTORECOVER - After a DMA error that left a
+ *                     block partially read or unread (ERROR returned),
+ *                     recover the block readout of the module
+ *                     (vfTDCRecoverReadout).
+ *              VFTDC_READOUT_TIGHT - With DMA transfer (1), program the
+ *                     transfer length from recent block sizes
+ *                     (vfTDCGetTransferSize) instead of nwrds.  If the block
+ *                     is larger, the remainder (up to nwrds) is transferred
+ *                     with a second DMA.
+ * </pre>
+ *  @return Number of words inserted into data if successful.  Otherwise ERROR.
+ */
+int
+vfTDCReadBlock(int id, volatile UINT32 *data, int nwrds, int rflag)
+{
+  struct vftdc_readout_result result;
+  int rval;
+
+  rval = vfTDCReadBlockResult(id, data, nwrds, rflag, &result);
+  vfTDCBlockError = result.error;
+
+  return rval;
+}
+
+/**
+ *  @ingroup Readout
+ *  @brief Data readout routine that also returns the status of the transfer
+ *
+ *    Same as vfTDCReadBlock, but the error status of the transfer is
+ *    returned in result instead of the global used by vfTDCReadBlockStatus.
+ *    Errors are also added to the cumulative counters of the slot
+ *    (vfTDCGetBlockErrorCount).
+ *
+ *    Different modules may be read at the same time from several
+ *    threads.  A module (or the modules of a multiblock readout) must be
+ *    read by one thread at a time: its readout statistics are kept per
+ *    slot, without a lock.
+ *
+ *  @param  id     Slot number of module to read
+ *  @param  data   local memory address to place data
+ *  @param  nwrds  Max number of words to transfer
+ *  @param  rflag  Readout Flag (see vfTDCReadBlock)
+ *  @param  result Where to return the word count, error type
+ *                 (VFTDC_BLOCKERROR_*), slot that terminated the transfer
+ *                 with a bus error, whether a dummy word was inserted, and
+ *                 the byte order of the data (see vfTDCBufferDecodeFlag)
+ *
+ *  @return Number of words inserted into data if successful.  Otherwise ERROR.
+ */
+int
+vfTDCReadBlockResult(int id, volatile UINT32 *data, int nwrds, int rflag,
+		     struct vftdc_readout_result *result)
+{
+  struct vftdc_readout_result local;
+  unsigned long long t0=0;
+  int rval, autorecover=0;
+  VFTDC_INSTR_DECL(tinstr);
+
+  VFTDC_INSTR_START(tinstr);
+  if(id==0) id=vfTDCID[0];
+
+  if(result == NULL)
+    result = &local;
+  memset(result, 0, sizeof(struct vftdc_readout_result));
+
+  if((vfTDCBLCtrl.mode != VFTDC_BLCTRL_DISABLE) ||
+     (rflag & VFTDC_READOUT_SAMPLE))
+    t0 = vfTDCTimeUsec();
+
+  rval = vfTDCReadBlockTransfer(id, data, nwrds, rflag, result);
+
+  if((vfTDCBLCtrl.mode != VFTDC_BLCTRL_DISABLE) ||
+     (rflag & VFTDC_READOUT_SAMPLE))
+    t0 = vfTDCTimeUsec() - t0;
+
+#ifndef VXWORKS
+  if(rflag & VFTDC_READOUT_SAMPLE)
+    VFTDC_ATOMIC_ADD(&vfTDCSampleReadoutUsec, t0);
+#endif
+
+  if(vfTDCBLCtrl.mode != VFTDC_BLCTRL_DISABLE)
+    {
+      VLOCK;
+      vfTDCBLCtrl.readoutUsec += t0;
+      vfTDCBLCtrl.nread++;
+      VUNLOCK;
+    }
+
+  result->nwords = rval;
+  result->order  = VFTDC_ORDER_VME; /* Not swapped by the readout */
+  if(rval > 0)
+    {
+      if((id>0) && (id<=VFTDC_MAX_SLOT))
+	vfTDCReadCount[id]++;
+      vfTDCRecordBlockSize(id, data, rval);
+      vfTDCRecordBlockHeader(id, data, rval);
+      if(rflag & VFTDC_READOUT_HISTOGRAM)
+	vfTDCHistFill(id, data, rval);
+#ifndef VXWORKS
+      if(rflag & VFTDC_READOUT_SAMPLE)
+	vfTDCSampleTap(data, rval);
+#endif
+    }
+
+  /* Drain the rest of a block interrupted by a DMA error */
+  if((rflag & VFTDC_READOUT_AUTORECOVER) &&
+     ((result->error == VFTDC_BLOCKERROR_UNKNOWN_BUS_ERROR) ||
+      (result->error == VFTDC_BLOCKERROR_DMA_INIT_ERROR) ||
+      (result->error == VFTDC_BLOCKERROR_DMADONE_ERROR) ||
+      (result->error == VFTDC_BLOCKERROR_INVALID_HEADER)))
+    {
+      autorecover = 1;
+      if((rval > 0) && (vfTDCFindTrailer(data, rval) >= 0))
+	result->recovered = 0; /* Block was complete */
+      else
+	result->recovered = (vfTDCRecoverReadout(id) >= 0) ? 1 : -1;
+    }
+
+  /* Recovery requested by the watchdog (VFTDC_WATCHDOG_RECOVER), done here
+     in the readout thread, only if this readout failed as well */
+  if((id>0) && (id<=VFTDC_MAX_SLOT) && vfTDCRecoverRequest[id] &&
+     VFTDC_ATOMIC_SWAP(&vfTDCRecoverRequest[id], 0))
+    {
+      if(!autorecover &&
+	 ((rval <= 0) || (result->error != VFTDC_BLOCKERROR_NO_ERROR)))
+	result->recovered = (vfTDCRecoverReadout(id) >= 0) ? 1 : -1;
+    }
+
+  if((result->error != VFTDC_BLOCKERROR_NO_ERROR) &&
+     (id>0) && (id<=VFTDC_MAX_SLOT))
+    VFTDC_ATOMIC_ADD(&vfTDCBlockErrorCount[id][result->error], 1);
+
+  VFTDC_INSTR_VALUE(VFTDC_INSTR_XFER_WORDS,(rval>0) ? rval : 0);
+  VFTDC_INSTR_STOP(VFTDC_INSTR_READBLOCK,tinstr);
+
+  return rval;
+}
+
+/**
+ *  @ingroup Status
+ *  @brief Return the number of block transfer errors of a type for a module
+ *
+ *  @param  id    Slot number
+ *  @param  type  Error type (VFTDC_BLOCKERROR_*).  If
+ *                VFTDC_BLOCKERROR_NO_ERROR, return the sum of all types.
+ *
+ *  @return Number of errors if successful.  Otherwise ERROR.
+ */
+int
+vfTDCGetBlockErrorCount(int id, int type)
+{
+  int itype, rval=0;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if((type<0) || (type>=VFTDC_BLOCKERROR_NTYPES))
+    {
+      printf("%s: ERROR: Invalid error type (%d)\n",__FUNCTION__,type);
+      return ERROR;
+    }
+
+  if(type != VFTDC_BLOCKERROR_NO_ERROR)
+    return vfTDCBlockErrorCount[id][type];
+
+  for(itype=1; itype<VFTDC_BLOCKERROR_NTYPES; itype++)
+    rval += vfTDCBlockErrorCount[id][itype];
+
+  return rval;
+}
+
+/**
+ *  @ingroup Status
+ *  @brief Print the block transfer error counters of all initialized modules
+ *
+ *  @param  clear  If >0, clear the counters after printing them
+ */
+void
+vfTDCPrintBlockErrorCounts(int clear)
+{
+  int itdc, id, itype;
+
+  printf("%s:\n",__FUNCTION__);
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      id = vfTDCID[itdc];
+      printf("  Slot %2d:",id);
+      for(itype=1; itype<VFTDC_BLOCKERROR_NTYPES; itype++)
+	{
+	  if(vfTDCBlockErrorCount[id][itype])
+	    printf("  %s = %u",vfTDC_blockerror_names[itype],
+		   vfTDCBlockErrorCount[id][itype]);
+	  if(clear)
+	    vfTDCBlockErrorCount[id][itype] = 0;
+	}
+      if(vfTDCRecoverCount[id])
+	printf("  Recovered = %u",vfTDCRecoverCount[id]);
+      if(clear)
+	vfTDCRecoverCount[id] = 0;
+      printf("\n");
+    }
+}
+
+/* Keep the block size from the trailer at the end of data in the slot's history */
+static void
+vfTDCRecordBlockSize(int id, volatile unsigned int *data, int nwords)
+{
+  int itrailer;
+  unsigned int trailer;
+
+  if((id<=0) || (id>VFTDC_MAX_SLOT))
+    return;
+
+  itrailer = vfTDCFindTrailer(data, nwords);
+  if(itrailer < 0)
+    return;
+
+  trailer = data[itrailer];
+#ifndef VXWORKS
+  trailer = LSWAP(trailer);
+#endif
+
+  vfTDCBlockWords[id][vfTDCBlockWordsCount[id] % VFTDC_XFERSIZE_HISTORY] =
+    trailer & 0x3FFFFF;
+  vfTDCBlockWordsCount[id]++;
+}
+
+/* Keep the block number and last event number from the block header at the
+   start of data (after an optional dummy word) */
+static void
+vfTDCRecordBlockHeader(int id, volatile unsigned int *data, int nwords)
+{
+  unsigned int bhead, ehead;
+  int ihead=0;
+
+  if((id<=0) || (id>VFTDC_MAX_SLOT) || (nwords < 2))
+    return;
+
+  bhead = data[0];
+#ifndef VXWORKS
+  bhead = LSWAP(bhead);
+#endif
+  if(bhead == VFTDC_DUMMY_DATA)
+    {
+      if(nwords < 3)
+	return;
+      ihead = 1;
+      bhead = data[1];
+#ifndef VXWORKS
+      bhead = LSWAP(bhead);
+#endif
+    }
+  ehead = data[ihead+1];
+#ifndef VXWORKS
+  ehead = LSWAP(ehead);
+#endif
+
+  if(((bhead & (VFTDC_DATA_TYPE_DEFINE|VFTDC_DATA_TYPE_MASK)) !=
+      (VFTDC_DATA_TYPE_DEFINE|(VFTDC_TYPE_BLOCK_HEADER<<27))) ||
+     ((ehead & (VFTDC_DATA_TYPE_DEFINE|VFTDC_DATA_TYPE_MASK)) !=
+      (VFTDC_DATA_TYPE_DEFINE|(VFTDC_TYPE_EVENT_HEADER<<27))))
+    return;
+
+  vfTDCLastBlock[id] = (bhead & 0x3FF00)>>8;
+  vfTDCLastEvent[id] = ((ehead & 0x3FFFFF) + (bhead & 0xFF) - 1) & 0x3FFFFF;
+  vfTDCLastValid[id] = 1;
+}
+
+/**
+ *  @ingroup Readout
+ *  @brief Return a DMA transfer length based on recent block sizes
+ *
+ *  The largest block size (trailer n_words) of the last
+ *  VFTDC_XFERSIZE_HISTORY blocks read from this slot, plus 25% and
+ *  VFTDC_XFERSIZE_MARGIN words, rounded up to a multiple of 8 bytes.
+ *
+ *  @param  id     Slot number
+ *  @return Suggested transfer length in words, 0 if no blocks have been read yet,
+ *          otherwise ERROR.
+ */
+int
+vfTDCGetTransferSize(int id)
+{
+  unsigned int iblk, nblk, maxwords=0;
+  int rval;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      vfTDCLogEnqueue(VFTDC_LOG_NOT_INITIALIZED,id,0,0);
+      return ERROR;
+    }
+
+  nblk = vfTDCBlockWordsCount[id];
+  if(nblk == 0)
+    return 0;
+  if(nblk > VFTDC_XFERSIZE_HISTORY)
+    nblk = VFTDC_XFERSIZE_HISTORY;
+
+  for(iblk=0; iblk<nblk; iblk++)
+    if(vfTDCBlockWords[id][iblk] > maxwords)
+      maxwords = vfTDCBlockWords[id][iblk];
+
+  rval = maxwords + maxwords/4 + VFTDC_XFERSIZE_MARGIN;
+
+  return (rval + 1) & ~1;
+}
+
+/**
+ *  @ingroup Status
+ *  @brief Return the number of tight transfers that needed a second DMA
+ *  @param  id     Slot number
+ *  @return Number of fallback transfers, otherwise ERROR.
+ */
+int
+vfTDCGetTightFallbackCount(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  return vfTDCTightFallback[id];
+}
+
+/**
+ *  @ingroup Readout
+ *  @brief Pad a destination with filler words up to VFTDC_ALIGN_BYTES
+ *
+ *    Writes VFTDC_DUMMY_DATA filler words (in VME byte order, as read out)
+ *    from data up to the next VFTDC_ALIGN_BYTES boundary, so the block can
+ *    be read with VFTDC_READOUT_ALIGNED at a cache line aligned address.
+ *    Decoders skip filler words.  Meant for scratch buffers: for data that
+ *    is recorded, read into an aligned buffer (vfTDCPoolCreate) instead of
+ *    padding it.
+ *
+ *  @param  data   Destination (must be 4 byte aligned)
+ *  @return Number of filler words written (add to the destination), 
+ *          otherwise ERROR.
+ */
+int
+vfTDCAlignDestination(volatile unsigned int *data)
+{
+  int npad=0;
+
+  if((data == NULL) || ((unsigned long)data & 0x3))
+    {
+      printf("%s: ERROR: Invalid destination (%p)\n",__FUNCTION__,data);
+      return ERROR;
+    }
+
+  while((unsigned long)(data + npad) & (VFTDC_ALIGN_BYTES-1))
+    {
+#ifdef VXWORKS
+      data[npad++] = VFTDC_DUMMY_DATA;
+#else
+      data[npad++] = LSWAP(VFTDC_DUMMY_DATA);
+#endif
+    }
+
+  return npad;
+}
+
+/**
+ *  @ingroup Readout
+ *  @brief Recover the block readout of a module after a failed transfer
+ *
+ *    Take back the token, then drain the remainder of the interrupted block
+ *    with programmed I/O, up to its trailer.  If no trailer is found, the
+ *    block readout of the module is reset.  Only the specified module is
+ *    affected.
+ *
+ *    Realignment is verified with the block number of a drained block
+ *    header (if any), and with the event counter, which must equal the
+ *    last event read plus the events in the blocks still waiting
+ *    (within one block being built).
+ *
+ *    This is done automatically by vfTDCReadBlock with the
+ *    VFTDC_READOUT_AUTORECOVER readout flag.  Do not call it if the
+ *    interrupted block was transferred up to its trailer.
+ *
+ *  @param  id     Slot number
+ *  @return Number of words drained if realigned, otherwise ERROR.
+ */
+int
+vfTDCRecoverReadout(int id)
+{
+  unsigned int word, type, bhead=0, ehead;
+  unsigned int blocklevel, ready, evtcnt, expectBlock=0, diff=0;
+  int nwords=0, maxwords, trailer=0, haveHeader=0, berr, rval=OK;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if(vfTDCLastValid[id])
+    expectBlock = (vfTDCLastBlock[id] + 1) & 0x3FF;
+
+  VLOCK;
+  blocklevel = vmeRead32(&TDCp[id]->blocklevel) & VFTDC_BLOCKLEVEL_MASK;
+  if(blocklevel == 0)
+    blocklevel = 1;
+  maxwords = blocklevel*(VFTDC_MAX_TDC_CHANNELS*VFTDC_MAX_DATA_PER_CHANNEL + 2) + 4;
+
+  /* In case the transfer stopped in the middle of a token passing readout */
+  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_TAKE_TOKEN);
+
+  /* Disable Bus Errors for the Prog I/O reads */
+  berr = vmeRead32(&TDCp[id]->vmeControl)&VFTDC_VMECONTROL_BERR;
+  if(berr)
+    vmeWrite32(&TDCp[id]->vmeControl, 
+	       vmeRead32(&TDCp[id]->vmeControl) & ~VFTDC_VMECONTROL_BERR);
+
+  while(nwords < maxwords)
+    {
+      word = (unsigned int) *TDCpd[id];
+#ifndef VXWORKS
+      word = LSWAP(word);
+#endif
+      nwords++;
+
+      if((word & VFTDC_DATA_TYPE_DEFINE) == 0)
+	continue;
+
+      type = (word & VFTDC_DATA_TYPE_MASK)>>27;
+      if(type == VFTDC_TYPE_DATA_NOT_VALID)
+	{ /* FIFO is empty */
+	  nwords--;
+	  break;
+	}
+      else if(type == VFTDC_TYPE_BLOCK_HEADER)
+	{
+	  bhead = word;
+	  haveHeader = 1;
+	}
+      else if((type == VFTDC_TYPE_EVENT_HEADER) && (haveHeader == 1))
+	{
+	  ehead = word;
+	  haveHeader = 2;
+	  if(vfTDCLastValid[id] && (((bhead & 0x3FF00)>>8) != expectBlock))
+	    rval = ERROR;
+	  vfTDCLastBlock[id] = (bhead & 0x3FF00)>>8;
+	  vfTDCLastEvent[id] = ((ehead & 0x3FFFFF) + (bhead & 0xFF) - 1) & 0x3FFFFF;
+	  vfTDCLastValid[id] = 1;
+	}
+      else if(type == VFTDC_TYPE_BLOCK_TRAILER)
+	{
+	  trailer = 1;
+	  break;
+	}
+    }
+
+  if(!trailer)
+    vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_BLOCK_READOUT);
+
+  if(berr)
+    vmeWrite32(&TDCp[id]->vmeControl, 
+	       vmeRead32(&TDCp[id]->vmeControl) | VFTDC_VMECONTROL_BERR);
+
+  ready  = (vmeRead32(&TDCp[id]->blockBuffer) & VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
+  evtcnt = vmeRead32(&TDCp[id]->eventNumber_lo);
+  VUNLOCK;
+
+  if(vfTDCLastValid[id])
+    {
+      diff = (evtcnt - vfTDCLastEvent[id] - ready*blocklevel) & 0x3FFFFF;
+      if(diff >= blocklevel)
+	rval = ERROR;
+    }
+
+  vfTDCRecoverCount[id]++;
+
+  if(rval == ERROR)
+    {
+      vfTDCLogEnqueue(VFTDC_LOG_RECOVER_FAILED,id,vfTDCLastBlock[id],diff);
+      return ERROR;
+    }
+
+  vfTDCLogEnqueue(VFTDC_LOG_RECOVERED,id,nwords,0);
+  return nwords;
+}
+
+/**
+ *  @ingroup Status
+ *  @brief Return the number of times vfTDCRecoverReadout was done for a module
+ *  @param  id     Slot number
+ *  @return Number of recoveries, otherwise ERROR.
+ */
+int
+vfTDCGetRecoverCount(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  return vfTDCRecoverCount[id];
+}
+
+/**
+ *  @ingroup Status
+ *  @brief Check that all modules are reading out the same events
+ *
+ *    For each initialized module, the 48 bit event counter, blocks ready
+ *    and the block and event numbers of the last block header read are
+ *    compared with:
+ *      - the first module, for the event counter (within maxdiff)
+ *      - the first module with a block header read, for block number and
+ *        last event number
+ *      - its own event counter, which must equal the last event read plus
+ *        the events in the blocks still waiting (within one block being built)
+ *
+ *    The last block header is only recorded by vfTDCReadBlock and
+ *    vfTDCReadBlockResult: modules read otherwise (or not yet read) are
+ *    not valid, and only their event counter is compared.
+ *
+ *    If the blocks ready of a module keep changing while its event counter
+ *    is read (VFTDC_CONSIST_MAX_TRIES), it is returned as unstable
+ *    (VFTDC_CONSIST_UNSTABLE) without further comparison.
+ *
+ *    The first module that does not agree is returned, and logged.
+ *    Call after all modules have been read for the same trigger.
+ *
+ *  @param  c        Where to return the values and result (may be NULL)
+ *  @param  maxdiff  Allowed difference in event counters between modules
+ *                   (triggers may arrive while the modules are read)
+ *
+ *  @return 0 if consistent, the slot number of the first divergent module,
+ *          otherwise ERROR.
+ */
+int
+vfTDCCheckConsistency(struct vftdc_consistency_struct *c, unsigned int maxdiff)
+{
+  struct vftdc_consistency_struct local;
+  unsigned int ready, ready2, blocklevel, diff;
+  unsigned long long cdiff;
+  int itdc, id, itry, iref, unstable=-1;
+
+  if(nvfTDC <= 0)
+    {
+      printf("%s: ERROR: No modules initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(c == NULL)
+    c = &local;
+  memset(c, 0, sizeof(struct vftdc_consistency_struct));
+
+  VLOCK;
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      id = vfTDCID[itdc];
+      c->slot[itdc] = id;
+
+      blocklevel = vmeRead32(&TDCp[id]->blocklevel) & VFTDC_BLOCKLEVEL_MASK;
+      c->blocklevel[itdc] = (blocklevel == 0) ? 1 : blocklevel;
+
+      /* Blocks ready must not change while the counter is read */
+      ready = (vmeRead32(&TDCp[id]->blockBuffer) & VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
+      itry = 0;
+      do
+	{
+	  c->eventCounter[itdc] = vfTDCReadEventCounter(id);
+	  ready2 = ready;
+	  ready  = (vmeRead32(&TDCp[id]->blockBuffer) & VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
+	} while((ready != ready2) && (++itry < VFTDC_CONSIST_MAX_TRIES));
+      c->blocksReady[itdc] = ready;
+      if((ready != ready2) && (unstable < 0))
+	unstable = itdc;
+    }
+  VUNLOCK;
+  c->nboards = nvfTDC;
+
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      id = c->slot[itdc];
+      c->valid[itdc]     = vfTDCLastValid[id];
+      c->lastBlock[itdc] = vfTDCLastBlock[id];
+      c->lastEvent[itdc] = vfTDCLastEvent[id];
+    }
+
+  if(unstable >= 0)
+    {
+      c->badSlot = c->slot[unstable];
+      c->reason  = VFTDC_CONSIST_UNSTABLE;
+      c->value   = c->blocksReady[unstable];
+      vfTDCLogEnqueue(VFTDC_LOG_DESYNC,c->badSlot,c->reason,c->value);
+      return c->badSlot;
+    }
+
+  /* Reference for the last block header: first module read out */
+  for(iref=0; iref<nvfTDC; iref++)
+    if(c->valid[iref])
+      break;
+
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      if(c->valid[itdc])
+	{
+	  diff = ((unsigned int)c->eventCounter[itdc] - c->lastEvent[itdc]
+		  - c->blocksReady[itdc]*c->blocklevel[itdc]) & 0x3FFFFF;
+	  if(diff >= c->blocklevel[itdc])
+	    {
+	      c->reason = VFTDC_CONSIST_READOUT;
+	      c->value  = diff;
+	      break;
+	    }
+	}
+
+      if(c->valid[itdc] && (iref < itdc))
+	{
+	  if(c->lastBlock[itdc] != c->lastBlock[iref])
+	    {
+	      c->reason = VFTDC_CONSIST_BLOCK;
+	      c->value  = c->lastBlock[itdc];
+	      break;
+	    }
+	  if(c->lastEvent[itdc] != c->lastEvent[iref])
+	    {
+	      c->reason = VFTDC_CONSIST_EVENT;
+	      c->value  = c->lastEvent[itdc];
+	      break;
+	    }
+	}
+
+      if(itdc == 0)
+	continue;
+
+      cdiff = (c->eventCounter[itdc] > c->eventCounter[0]) ?
+	c->eventCounter[itdc] - c->eventCounter[0] :
+	c->eventCounter[0] - c->eventCounter[itdc];
+      if(cdiff > maxdiff)
+	{
+	  c->reason = VFTDC_CONSIST_COUNTER;
+	  c->value  = (unsigned int)cdiff;
+	  break;
+	}
+    }
+
+  if(c->reason != VFTDC_CONSIST_OK)
+    {
+      c->badSlot = c->slot[itdc];
+      vfTDCLogEnqueue(VFTDC_LOG_DESYNC,c->badSlot,c->reason,c->value);
+    }
+
+  return c->badSlot;
+}
+
+const char *vfTDC_consist_names[VFTDC_CONSIST_NTYPES] =
+  {
+    "OK",
+    "Event counter differs from first module",
+    "Block number differs from first module",
+    "Event number differs from first module",
+    "Event counter differs from events read and blocks ready",
+    "Blocks ready changing while the event counter is read"
+  };
+
+/**
+ *  @ingroup Status
+ *  @brief Print the values and result of vfTDCCheckConsistency
+ *  @param  c      Values from vfTDCCheckConsistency
+ *  @return OK if successful, otherwise ERROR.
+ */
+int
+vfTDCPrintConsistency(struct vftdc_consistency_struct *c)
+{
+  int itdc;
+
+  if(c == NULL)
+    {
+      printf("%s: ERROR: Invalid pointer\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  printf("\n");
+  printf("  Slot  EventCounter     Ready  Level  LastBlock  LastEvent\n");
+  printf("--------------------------------------------------------------------------------\n");
+  for(itdc=0; itdc<c->nboards; itdc++)
+    {
+      printf("  %2d  %14llu    %3d    %3d", c->slot[itdc], c->eventCounter[itdc],
+	     c->blocksReady[itdc], c->blocklevel[itdc]);
+      if(c->valid[itdc])
+	printf("      %4d    %8d", c->lastBlock[itdc], c->lastEvent[itdc]);
+      else
+	printf("         -           -");
+      printf("%s\n", (c->slot[itdc] == c->badSlot) ? "  <--" : "");
+    }
+  printf("--------------------------------------------------------------------------------\n");
+  if(c->reason == VFTDC_CONSIST_OK)
+    printf("  Consistent\n");
+  else
+    printf("  Slot %d: %s (%u)\n", c->badSlot,
+	   vfTDC_consist_names[c->reason], c->value);
+  printf("\n");
+
+  return OK;
+}
+
+/*************************************************************
+ Readout stall watchdog.
+
+ A thread checks each module every timeout/4: a stall is when triggers
+ for at least one block were counted with no block ready, or blocks are
+ ready, and no readout returned data since.  A stall lasting longer than
+ the timeout raises an alarm: it is logged, passed to the user routine
+ (vfTDCWatchdogConnect), and optionally a recovery of a stalled readout
+ is requested.  The recovery itself is done by the readout thread, in
+ its next vfTDCReadBlock of the module, so the watchdog never touches
+ the data of the module.
+*************************************************************/
+
+static VFTDCSTALLFUNCPTR vfTDCWatchdogRoutine = NULL;
+static unsigned int      vfTDCWatchdogArg     = 0;
+static int               vfTDCWatchdogTimeout = 0;     /* ms */
+static int               vfTDCWatchdogAction  = VFTDC_WATCHDOG_ALARM;
+static volatile int      vfTDCWatchdogRunning = 0;
+static unsigned int      vfTDCWatchdogAlarms[VFTDC_MAX_SLOT+1];
+#ifndef VXWORKS
+static pthread_t         vfTDCWatchdogThread;
+
+/* Watchdog state for one module */
+struct vftdc_watchdog_state
+{
+  unsigned int       trig1;       /* trig1_scaler at the last progress */
+  unsigned int       nread;       /* vfTDCReadCount at the last progress */
+  unsigned long long stallStart;  /* When the stall was first seen (0: not stalled) */
+  int                alarmed;
+};
+
+static void *
+vfTDCWatchdogTask(void *arg)
+{
+  struct vftdc_watchdog_state st[VFTDC_MAX_SLOT+1];
+  struct vftdc_stall_struct alarm;
+  unsigned int trig1, ready, blocklevel, nread;
+  unsigned long long now;
+  int itdc, id, type, period;
+
+  prctl(PR_SET_NAME,"vfTDCWatchdog");
+
+  memset(st, 0, sizeof(st));
+  period = vfTDCWatchdogTimeout/4;
+  if(period < 10)
+    period = 10;
+
+  VLOCK;
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      id = vfTDCID[itdc];
+      vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SCALERS_LATCH);
+      st[id].trig1 = vmeRead32(&TDCp[id]->trig1_scaler);
+      st[id].nread = vfTDCReadCount[id];
+    }
+  VUNLOCK;
+
+  while(vfTDCWatchdogRunning)
+    {
+      usleep(period*1000);
+
+      for(itdc=0; itdc<nvfTDC; itdc++)
+	{
+	  id = vfTDCID[itdc];
+
+	  VLOCK;
+	  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SCALERS_LATCH);
+	  trig1      = vmeRead32(&TDCp[id]->trig1_scaler);
+	  ready      = (vmeRead32(&TDCp[id]->blockBuffer) & 
+			VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
+	  blocklevel = vmeRead32(&TDCp[id]->blocklevel) & VFTDC_BLOCKLEVEL_MASK;
+	  VUNLOCK;
+	  nread = vfTDCReadCount[id];
+	  now   = vfTDCTimeUsec();
+	  if(blocklevel == 0)
+	    blocklevel = 1;
+
+	  if(nread != st[id].nread)
+	    { /* Readout progress */
+	      st[id].trig1      = trig1;
+	      st[id].nread      = nread;
+	      st[id].stallStart = 0;
+	      st[id].alarmed    = 0;
+	      continue;
+	    }
+
+	  if(ready > 0)
+	    type = VFTDC_STALL_NO_READOUT;
+	  else if((trig1 - st[id].trig1) >= blocklevel)
+	    type = VFTDC_STALL_NO_BLOCKS;
+	  else
+	    { /* Idle, no triggers */
+	      st[id].trig1      = trig1;
+	      st[id].stallStart = 0;
+	      continue;
+	    }
+
+	  if(st[id].stallStart == 0)
+	    st[id].stallStart = now;
+
+	  if(st[id].alarmed ||
+	     ((now - st[id].stallStart) < (unsigned long long)vfTDCWatchdogTimeout*1000ULL))
+	    continue;
+
+	  memset(&alarm, 0, sizeof(alarm));
+	  alarm.slot        = id;
+	  alarm.type        = type;
+	  alarm.triggers    = trig1 - st[id].trig1;
+	  alarm.blocksReady = ready;
+	  alarm.blocklevel  = blocklevel;
+	  alarm.nread       = nread;
+	  alarm.stalledUsec = now - st[id].stallStart;
+
+	  st[id].alarmed = 1;
+	  vfTDCWatchdogAlarms[id]++;
+	  vfTDCLogEnqueue(VFTDC_LOG_STALL, id, type, (int)(alarm.stalledUsec/1000));
+
+	  /* Blocks not being built is not a readout problem: alarm only */
+	  if((vfTDCWatchdogAction == VFTDC_WATCHDOG_RECOVER) &&
+	     (type == VFTDC_STALL_NO_READOUT))
+	    {
+	      vfTDCRecoverRequest[id] = 1;
+	      alarm.recoverRequested = 1;
+	      /* Give the readout another timeout before the next alarm */
+	      st[id].trig1      = trig1;
+	      st[id].stallStart = 0;
+	      st[id].alarmed    = 0;
+	    }
+
+	  if(vfTDCWatchdogRoutine != NULL)
+	    (*vfTDCWatchdogRoutine) (&alarm, vfTDCWatchdogArg);
+	}
+    }
+
+  return NULL;
+}
+#endif /* VXWORKS */
+
+/**
+ * @ingroup Readout
+ * @brief Connect a user routine to the readout stall watchdog alarm
+ *
+ *   The routine is called from the watchdog thread with the alarm and arg.
+ *
+ * @param routine Routine to call when a readout stall is detected (NULL: none)
+ * @param arg argument to pass to routine
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCWatchdogConnect(VFTDCSTALLFUNCPTR routine, unsigned int arg)
+{
+  vfTDCWatchdogRoutine = routine;
+  vfTDCWatchdogArg     = arg;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Start the readout stall watchdog thread
+ *
+ * @param timeout Time in ms a readout stall may last before the alarm
+ * @param action What to do in addition to logging and calling the user routine
+ *      -  VFTDC_WATCHDOG_ALARM: Nothing
+ *      -  VFTDC_WATCHDOG_RECOVER: For blocks ready and not read out, request
+ *             a recovery of the readout of the module (vfTDCRecoverReadout).
+ *             It is done by the next vfTDCReadBlock of the module, if that
+ *             readout fails as well.  Triggers counted with no blocks ready
+ *             (VFTDC_STALL_NO_BLOCKS) only raise the alarm.
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCWatchdogStart(int timeout, int action)
+{
+#ifdef VXWORKS
+  printf("%s: ERROR: Not supported for vxWorks\n",__FUNCTION__);
+  return ERROR;
+#else
+  int status;
+
+  if(nvfTDC <= 0)
+    {
+      printf("%s: ERROR: No modules initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(timeout <= 0)
+    {
+      printf("%s: ERROR: Invalid timeout (%d)\n",__FUNCTION__,timeout);
+      return ERROR;
+    }
+
+  if((action != VFTDC_WATCHDOG_ALARM) && (action != VFTDC_WATCHDOG_RECOVER))
+    {
+      printf("%s: ERROR: Invalid action (%d)\n",__FUNCTION__,action);
+      return ERROR;
+    }
+
+  if(vfTDCWatchdogRunning)
+    vfTDCWatchdogStop();
+
+  vfTDCWatchdogTimeout = timeout;
+  vfTDCWatchdogAction  = action;
+  memset((void *)vfTDCRecoverRequest, 0, sizeof(vfTDCRecoverRequest));
+  vfTDCWatchdogRunning = 1;
+
+  status = pthread_create(&vfTDCWatchdogThread, NULL, vfTDCWatchdogTask, NULL);
+  if(status != 0)
+    {
+      vfTDCWatchdogRunning = 0;
+      printf("%s: ERROR: Watchdog thread could not be started.\n",__FUNCTION__);
+      printf("\t pthread_create returned: %d\n",status);
+      return ERROR;
+    }
+
+  return OK;
+#endif
+}
+
+/**
+ * @ingroup Readout
+ * @brief Stop the readout stall watchdog thread
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCWatchdogStop()
+{
+#ifndef VXWORKS
+  if(!vfTDCWatchdogRunning)
+    return OK;
+
+  vfTDCWatchdogRunning = 0;
+  if(pthread_join(vfTDCWatchdogThread, NULL) != 0)
+    {
+      perror("pthread_join");
+      return ERROR;
+    }
+#endif
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Return the number of readout stall alarms for a module
+ *
+ * @param id Slot Number
+ * @return Number of alarms if successful, otherwise ERROR
+ */
+int
+vfTDCGetWatchdogAlarmCount(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  return vfTDCWatchdogAlarms[id];
+}
+
+#ifdef NOTYET
+/**
+ * @ingroup Config
+ * @brief Enable Fiber transceiver
+ *
+ *  Note:  All Fiber are enabled by default 
+ *         (no harm, except for 1-2W power usage)
+ *
+ * @sa tiDisableFiber
+ * @param id Slot Number
+ * @param   fiber: integer indicative of the transceiver to enable
+ *
+ *
+ * @return OK if successful, ERROR otherwise.
+ *
+ */
+int
+vfTDCEnableFiber(int id, unsigned int fiber)
+{
+  unsigned int sval;
+  unsigned int fiberbit;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if((fiber<1) | (fiber>8))
+    {
+      printf("%s: ERROR: Invalid value for fiber (%d)\n",
+	     __FUNCTION__,fiber);
+      return ERROR;
+    }
+
+  fiberbit = (1<<(fiber-1));
+
+  VLOCK;
+  sval = vmeRead32(&TDCp->fiber);
+  vmeWrite32(&TDCp->fiber,
+	     sval | fiberbit );
+  VUNLOCK;
+
+  return OK;
+  
+}
+
+/**
+ * @ingroup Config
+ * @brief Disnable Fiber transceiver
+ *
+ * @sa tiEnableFiber
+ *
+ * @param id Slot Number
+ * @param   fiber: integer indicative of the transceiver to disable
+ *
+ *
+ * @return OK if successful, ERROR otherwise.
+ *
+ */
+int
+vfTDCDisableFiber(int id, unsigned int fiber)
+{
+  unsigned int rval;
+  unsigned int fiberbit;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if((fiber<1) | (fiber>8))
+    {
+      printf("%s: ERROR: Invalid value for fiber (%d)\n",
+	     __FUNCTION__,fiber);
+      return ERROR;
+    }
+
+  fiberbit = (1<<(fiber-1));
+
+  VLOCK;
+  rval = vmeRead32(&TDCp->fiber);
+  vmeWrite32(&TDCp->fiber,
+	   rval & ~fiberbit );
+  VUNLOCK;
+
+  return rval;
+  
+}
+#endif /* NOTYET */
+
+
+/**
+ * @ingroup Config
+ * @brief Enable Bus Errors to terminate Block Reads
+ * @param id Slot Number
+ * @sa tiDisableBusError
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCEnableBusError(int id)
+{
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->vmeControl,
+	   vmeRead32(&TDCp[id]->vmeControl) | (VFTDC_VMECONTROL_BERR) );
+  VUNLOCK;
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Disable Bus Errors to terminate Block Reads
+ * @param id Slot Number
+ * @sa tiEnableBusError
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCDisableBusError(int id)
+{
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->vmeControl,
+	   vmeRead32(&TDCp[id]->vmeControl) & ~(VFTDC_VMECONTROL_BERR) );
+  VUNLOCK;
+  return OK;
+}
+
+
+/**
+ * @ingroup Config
+ * @brief Generate a software SyncReset signal.
+ *
+ *  @param id Slot Number
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCSyncReset(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+  
+  VLOCK;
+  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_SYNCRESET); 
+  taskDelay(1);
+  VUNLOCK;
+  
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Routine to set the A32 Base
+ *
+ * @param id Slot Number
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCSetAdr32(int id, unsigned int a32base)
+{
+  unsigned long laddr=0;
+  int res=0,a32Enabled=0;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if(a32base<0x00800000)
+    {
+      printf("%s: ERROR: a32base out of range (0x%08x)\n",
+	     __FUNCTION__,a32base);
+      return ERROR;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->adr32, 
+	     (a32base & VFTDC_ADR32_BASE_MASK) );
+
+  vmeWrite32(&TDCp[id]->vmeControl, 
+	     vmeRead32(&TDCp[id]->vmeControl) | VFTDC_VMECONTROL_A32);
+
+  a32Enabled = vmeRead32(&TDCp[id]->vmeControl)&(VFTDC_VMECONTROL_A32);
+  if(!a32Enabled)
+    {
+      printf("%s: ERROR: Failed to enable A32 Address\n",__FUNCTION__);
+      VUNLOCK;
+      return ERROR;
+    }
+
+#ifdef VXWORKS
+  res = sysBusToLocalAdrs(0x09,(char *)a32base,(char **)&laddr);
+  if (res != 0) 
+    {
+      printf("%s: ERROR in sysBusToLocalAdrs(0x09,0x%x,&laddr) \n",
+	     __FUNCTION__,a32base);
+      VUNLOCK;
+      return(ERROR);
+    }
+#else
+  res = vmeBusToLocalAdrs(0x09,(char *)(unsigned long)a32base,(char **)&laddr);
+  if (res != 0) 
+    {
+      printf("%s: ERROR in vmeBusToLocalAdrs(0x09,0x%x,&laddr) \n",
+	     __FUNCTION__,a32base);
+      VUNLOCK;
+      return(ERROR);
+    }
+#endif
+
+  vfTDCA32Base = a32base;
+  vfTDCA32Offset = laddr - vfTDCA32Base;
+  TDCpd[id] = (unsigned int *)(laddr);  /* Set a pointer to the FIFO */
+  VUNLOCK;
+
+  printf("%s: A32 Base address set to 0x%08x\n",
+	 __FUNCTION__,vfTDCA32Base);
+
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Disable A32
+ *
+ * @param id Slot Number
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCDisableA32(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+  
+  VLOCK;
+  vmeWrite32(&TDCp[id]->adr32,0x0);
+  vmeWrite32(&TDCp[id]->vmeControl, 
+	     vmeRead32(&TDCp[id]->vmeControl) & ~VFTDC_VMECONTROL_A32);
+  VUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Reset the L1A counter, as incremented by the TI.
+ *
+ * @param id Slot Number
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCResetEventCounter(int id)
+{
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+  
+  VLOCK;
+  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_SCALERS_RESET);
+  VUNLOCK;
+
+  return OK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Returns the event counter (48 bit)
+ *
+ * @param id Slot Number
+ * @return Number of accepted events if successful, otherwise ERROR
+ */
+unsigned long long int
+vfTDCGetEventCounter(int id)
+{
+  unsigned long long int rval=0;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  rval = vfTDCReadEventCounter(id);
+  VUNLOCK;
+  
+  return rval;
+}
+
+
+/**
+ * @ingroup Readout
+ * @brief Returns the number of Blocks available for readout
+ *
+ * @param id Slot Number
+ * @return Number of blocks available for readout if successful, otherwise ERROR
+ *
+ */
+unsigned int
+vfTDCBReady(int id)
+{
+  unsigned int blockBuffer=0, rval=0;
+  VFTDC_INSTR_DECL(tinstr);
+  VFTDC_INSTR_DECL(tcall);
+
+  VFTDC_INSTR_START(tcall);
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VFTDC_INSTR_VLOCK(tinstr);
+  blockBuffer = vmeRead32(&TDCp[id]->blockBuffer);
+  rval        = (blockBuffer&VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
+  if(rval > vfTDCBLCtrl.maxReady)
+    vfTDCBLCtrl.maxReady = rval;
+  VUNLOCK;
+
+  VFTDC_INSTR_STOP(VFTDC_INSTR_BREADY,tcall);
+
+  return rval;
+}
+
+/**
+ * @ingroup Config
+ * @brief Set the clock to the specified source.
+ *
+ * @param id Slot Number
+ * @param   source
+ *         -   0:  HFBR1
+ *         -   2:  Internal clock
+ *         -   3:  VXS
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCSetClockSource(int id, unsigned int source)
+{
+  int rval=OK;
+  unsigned int clkread=0, clkset=0;
+  char sClock[20] = "";
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  switch(source)
+    {
+    case VFTDC_CLOCK_INTERNAL:
+      sprintf(sClock,"ONBOARD (%d)",source);
+      break;
+    case VFTDC_CLOCK_HFBR1:
+      sprintf(sClock,"EXTERNAL-HFBR1 (%d)",source);
+      break;
+    case VFTDC_CLOCK_VXS:
+      sprintf(sClock,"EXTERNAL-VXS (%d)",source);
+      break;
+    default:
+      printf("%s: ERROR: Invalid Clock Souce (%d)\n",__FUNCTION__,source);
+      return ERROR;      
+    }
+
+  printf("%s: Setting clock source to %s\n",__FUNCTION__,sClock);
+
+
+  VLOCK;
+  vmeWrite32(&TDCp[id]->clock, source);
+  taskDelay(1);
+
+    // Resets
+  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_CLK250);
+  taskDelay(1);
+  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_IODELAY);
+  taskDelay(1);
+
+  if(source==1) /* Turn on running mode for External Clock verification */
+    {
+      vmeWrite32(&TDCp[id]->runningMode,VFTDC_RUNNINGMODE_ENABLE);
+      taskDelay(1);
+      clkread = vmeRead32(&TDCp[id]->clock) & VFTDC_CLOCK_MASK;
+      if(clkread != clkset)
+	{
+	  printf("%s: ERROR Setting Clock Source (clkset = 0x%x, clkread = 0x%x)\n",
+		 __FUNCTION__,source, clkread);
+	  rval = ERROR;
+	}
+      vmeWrite32(&TDCp[id]->runningMode,VFTDC_RUNNINGMODE_DISABLE);
+    }
+  VUNLOCK;
+
+  return rval;
+}
+
+/**
+ * @ingroup Status
+ * @brief Get the current clock source
+ * @param id Slot Number
+ * @return Current Clock Source
+ */
+int
+vfTDCGetClockSource(int id)
+{
+  int rval=0;
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  rval = vmeRead32(&TDCp[id]->clock) & VFTDC_CLOCK_MASK;
+  VUNLOCK;
+
+  return rval;
+}
+
+/**
+ * @ingroup Status
+ * @brief Return geographic address as provided from a VME-64X crate.
+ * @param id Slot Number
+ * @return Geographic Address if successful, otherwise ERROR.
+ */
+
+int
+vfTDCGetGeoAddress(int id)
+{
+  int rval=0;
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  rval = (vmeRead32(&TDCp[id]->boardID) & VFTDC_BOARDID_GEOADR_MASK)>>8;
+  VUNLOCK;
+
+  return rval;
+}
+
+/**
+ * @ingroup Config
+ * @brief Configure the adaptive blocklevel controller.
+ *
+ *   The controller uses the trigger rate (trig1_scaler), the block
+ *   buffer occupancy seen by vfTDCBReady and the time spent in
+ *   vfTDCReadBlock to choose a blocklevel.  Decisions are only made
+ *   in vfTDCBlockLevelControlSyncEvent, which is to be called at
+ *   sync event boundaries.
+ *
+ * @param mode
+ *   - VFTDC_BLCTRL_DISABLE:   Controller off
+ *   - VFTDC_BLCTRL_RECOMMEND: Only recommend a blocklevel
+ *   - VFTDC_BLCTRL_APPLY:     Also program the recommended blocklevel into
+ *                             all boards with vfTDCBlockLevelControlApply,
+ *                             between runs
+ * @param minBL Smallest blocklevel to recommend (used at low rate)
+ * @param maxBL Largest blocklevel to recommend
+ * @param cpuBudget Fraction (0-1) of time the readout may spend in vfTDCReadBlock
+ * @param maxBlocksReady Number of blocks ready above which the blocklevel is raised
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCBlockLevelControlConfig(int mode, int minBL, int maxBL,
+			     float cpuBudget, int maxBlocksReady)
+{
+  if((mode<VFTDC_BLCTRL_DISABLE) || (mode>VFTDC_BLCTRL_APPLY))
+    {
+      printf("%s: ERROR: Invalid mode (%d)\n",__FUNCTION__,mode);
+      return ERROR;
+    }
+
+  if((minBL<1) || (maxBL>255) || (minBL>maxBL))
+    {
+      printf("%s: ERROR: Invalid blocklevel range (%d - %d)\n",
+	     __FUNCTION__,minBL,maxBL);
+      return ERROR;
+    }
+
+  if((cpuBudget<=0) || (cpuBudget>1))
+    {
+      printf("%s: ERROR: Invalid cpuBudget (%f)\n",__FUNCTION__,cpuBudget);
+      return ERROR;
+    }
+
+  if(maxBlocksReady<1)
+    {
+      printf("%s: ERROR: Invalid maxBlocksReady (%d)\n",
+	     __FUNCTION__,maxBlocksReady);
+      return ERROR;
+    }
+
+  memset((char *)&vfTDCBLCtrl, 0, sizeof(vfTDCBLCtrl));
+  vfTDCBLCtrl.minBL          = minBL;
+  vfTDCBLCtrl.maxBL          = maxBL;
+  vfTDCBLCtrl.cpuBudget      = cpuBudget;
+  vfTDCBLCtrl.maxBlocksReady = maxBlocksReady;
+  vfTDCBLCtrl.tstart         = vfTDCTimeUsec();
+  vfTDCBLCtrl.mode           = mode;
+
+  return OK;
+}
+
+/**
+ * @ingroup Config
+ * @brief Adaptive blocklevel decision, to be called at a sync event boundary.
+ *
+ *   Nothing is written to the boards here: the TI changes its
+ *   blocklevel at a sync event, while the boards would only follow
+ *   when written, and blocks built in between would have the wrong
+ *   number of events.  The recommendation is applied between runs
+ *   (vfTDCBlockLevelControlApply).  A blocklevel is recommended from
+ *   the measurements since the previous call:
+ *   - readout CPU use above budget, or too many blocks ready: double the blocklevel
+ *   - readout CPU use below a quarter of the budget and at most one block ready:
+ *     halve the blocklevel (down to the minimum, for latency at low rate)
+ *
+ * @param currentBL Blocklevel in use by the trigger supervisor from this sync event on
+ *
+ * @return Recommended blocklevel, or currentBL if the controller is disabled.
+ */
+int
+vfTDCBlockLevelControlSyncEvent(int currentBL)
+{
+  unsigned long long now=0, dt=0, readoutUsec;
+  unsigned int trig1=0, maxReady;
+  int id, newBL;
+
+  if(vfTDCBLCtrl.mode == VFTDC_BLCTRL_DISABLE)
+    return currentBL;
+
+  id = vfTDCID[0];
+  if((nvfTDC==0) || (TDCp[id] == NULL))
+    return currentBL;
+
+  /* Take the measurements, and start the next interval, together with
+     the readout path (vfTDCReadBlock, vfTDCBReady) */
+  VLOCK;
+  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_SCALERS_LATCH);
+  trig1 = vmeRead32(&TDCp[id]->trig1_scaler);
+  now = vfTDCTimeUsec();
+  readoutUsec = vfTDCBLCtrl.readoutUsec;
+  maxReady    = vfTDCBLCtrl.maxReady;
+  vfTDCBLCtrl.readoutUsec = 0;
+  vfTDCBLCtrl.nread       = 0;
+  vfTDCBLCtrl.maxReady    = 0;
+  VUNLOCK;
+
+  dt  = now - vfTDCBLCtrl.tstart;
+
+  newBL = currentBL;
+  if(vfTDCBLCtrl.haveTrig1 && (dt > 0))
+    {
+      vfTDCBLCtrl.rate = (float)(trig1 - vfTDCBLCtrl.trig1) * 1e6 / (float)dt;
+      vfTDCBLCtrl.cpu  = (float)readoutUsec / (float)dt;
+
+      if((vfTDCBLCtrl.cpu > vfTDCBLCtrl.cpuBudget) ||
+	 (maxReady > vfTDCBLCtrl.maxBlocksReady))
+	newBL = currentBL * 2;
+      else if((vfTDCBLCtrl.cpu < 0.25*vfTDCBLCtrl.cpuBudget) &&
+	      (maxReady <= 1))
+	newBL = currentBL / 2;
+    }
+
+  if(newBL < vfTDCBLCtrl.minBL) newBL = vfTDCBLCtrl.minBL;
+  if(newBL > vfTDCBLCtrl.maxBL) newBL = vfTDCBLCtrl.maxBL;
+
+  vfTDCBLCtrl.trig1       = trig1;
+  vfTDCBLCtrl.haveTrig1   = 1;
+  vfTDCBLCtrl.tstart      = now;
+  vfTDCBLCtrl.recommended = newBL;
+
+  return newBL;
+}
+
+/**
+ * @ingroup Config
+ * @brief Program the blocklevel recommended by the adaptive blocklevel
+ *        controller into all boards.
+ *
+ *   For VFTDC_BLCTRL_APPLY mode.  To be called between runs (e.g. in
+ *   Prestart), when no blocks are being built, and together with
+ *   setting the same blocklevel in the TI.
+ *
+ * @return Blocklevel programmed, 0 if there is no recommendation yet,
+ *         otherwise ERROR.
+ */
+int
+vfTDCBlockLevelControlApply()
+{
+  int ii, bl;
+
+  if(vfTDCBLCtrl.mode != VFTDC_BLCTRL_APPLY)
+    {
+      printf("%s: ERROR: Controller not in VFTDC_BLCTRL_APPLY mode\n",
+	     __FUNCTION__);
+      return ERROR;
+    }
+
+  bl = vfTDCBLCtrl.recommended;
+  if(bl <= 0)
+    return 0;
+
+  for(ii=0; ii<nvfTDC; ii++)
+    {
+      if(vfTDCSetBlockLevel(vfTDCID[ii], bl) != OK)
+	return ERROR;
+    }
+  vfTDCBLCtrl.applied = bl;
+
+  /* Measurements restart with the new blocklevel */
+  vfTDCBLCtrl.haveTrig1 = 0;
+
+  return bl;
+}
+
+/**
+ * @ingroup Status
+ * @brief Print the state of the adaptive blocklevel controller to standard out
+ */
+void
+vfTDCBlockLevelControlStatus()
+{
+  const char *modes[3] = {"Disabled", "Recommend", "Apply"};
+
+  printf("%s: Mode = %s\n",__FUNCTION__,modes[vfTDCBLCtrl.mode]);
+  if(vfTDCBLCtrl.mode == VFTDC_BLCTRL_DISABLE)
+    return;
+
+  printf("  Blocklevel range       = %d - %d\n",vfTDCBLCtrl.minBL,vfTDCBLCtrl.maxBL);
+  printf("  CPU budget             = %.2f\n",vfTDCBLCtrl.cpuBudget);
+  printf("  Max blocks ready       = %d\n",vfTDCBLCtrl.maxBlocksReady);
+  printf("  Last trigger rate      = %.1f Hz\n",vfTDCBLCtrl.rate);
+  printf("  Last readout CPU       = %.3f\n",vfTDCBLCtrl.cpu);
+  printf("  Last recommended level = %d\n",vfTDCBLCtrl.recommended);
+}
+
+#ifdef NOTYET
+/*************************************************************
+ Library Interrupt/Polling routines
+*************************************************************/
+
+/*******************************************************************************
+ *
+ *  vfTDCInt
+ *  - Default interrupt handler
+ *    Handles the TI interrupt.  Calls a user defined routine,
+ *    if it was connected with vfTDCIntConnect()
+ *    
+ */
+static void
+vfTDCInt(void)
+{
+  vfTDCIntCount++;
+
+  INTLOCK;
+
+  if (vfTDCIntRoutine != NULL)	/* call user routine */
+    (*vfTDCIntRoutine) (vfTDCIntArg);
+
+  /* Acknowledge trigger */
+  if(tiDoAck==1)
+    {
+      vfTDCIntAck();
+    }
+  INTUNLOCK;
+
+}
+
+/*******************************************************************************
+ *
+ *  tiPoll
+ *  - Default Polling Server Thread
+ *    Handles the polling of latched triggers.  Calls a user
+ *    defined routine if was connected with vfTDCIntConnect.
+ *
+ */
+#ifndef VXWORKS
+static void
+vfTDCPoll(void)
+{
+  int tdc_data;
+  int policy=0;
+  struct sched_param sp;
+/* #define DO_CPUAFFINITY */
+#ifdef DO_CPUAFFINITY
+  int j;
+  cpu_set_t testCPU;
+
+  if (pthread_getaffinity_np(pthread_self(), sizeof(testCPU), &testCPU) <0) 
+    {
+      perror("pthread_getaffinity_np");
+    }
+  printf("%s: CPUset = ",__FUNCTION__);
+  for (j = 0; j < CPU_SETSIZE; j++)
+    if (CPU_ISSET(j, &testCPU))
+      printf(" %d", j);
+  printf("\n");
+
+  CPU_ZERO(&testCPU);
+  CPU_SET(7,&testCPU);
+  if (pthread_setaffinity_np(pthread_self(),sizeof(testCPU), &testCPU) <0) 
+    {
+      perror("pthread_setaffinity_np");
+    }
+  if (pthread_getaffinity_np(pthread_self(), sizeof(testCPU), &testCPU) <0) 
+    {
+      perror("pthread_getaffinity_np");
+    }
+
+  printf("%s: CPUset = ",__FUNCTION__);
+  for (j = 0; j < CPU_SETSIZE; j++)
+    if (CPU_ISSET(j, &testCPU))
+      printf(" %d", j);
+
+  printf("\n");
+
+
+#endif
+  
+  /* Set scheduler and priority for this thread */
+  policy=SCHED_FIFO;
+  sp.sched_priority=40;
+  printf("%s: Entering polling loop...\n",__FUNCTION__);
+  pthread_setschedparam(pthread_self(),policy,&sp);
+  pthread_getschedparam(pthread_self(),&policy,&sp);
+  printf ("%s: INFO: Running at %s/%d\n",__FUNCTION__,
+	  (policy == SCHED_FIFO ? "FIFO"
+	   : (policy == SCHED_RR ? "RR"
+	      : (policy == SCHED_OTHER ? "OTHER"
+		 : "unknown"))), sp.sched_priority);  
+  prctl(PR_SET_NAME,"tiPoll");
+
+  while(1) 
+    {
+
+      pthread_testcancel();
+
+      /* If still need Ack, don't test the Trigger Status */
+      if(tiNeedAck>0) 
+	{
+	  continue;
+	}
+
+      tdc_data = 0;
+	  
+      tdc_data = tiBReady();
+      if(tdc_data == ERROR) 
+	{
+	  printf("%s: ERROR: vfTDCIntPoll returned ERROR.\n",__FUNCTION__);
+	  break;
+	}
+
+      if(tdc_data && vfTDCIntRunning)
+	{
+	  INTLOCK; 
+	  tiDaqCount = tdc_data;
+	  vfTDCIntCount++;
+
+	  if (vfTDCIntRoutine != NULL)	/* call user routine */
+	    (*vfTDCIntRoutine) (vfTDCIntArg);
+	
+	  /* Write to TI to Acknowledge Interrupt */	  
+	  if(tiDoAck==1) 
+	    {
+	      vfTDCIntAck();
+	    }
+	  INTUNLOCK;
+	}
+    
+    }
+  printf("%s: Read ERROR: Exiting Thread\n",__FUNCTION__);
+  pthread_exit(0);
+
+}
+#endif 
+
+
+/*******************************************************************************
+ *
+ *  vfTDCStartPollingThread
+ *  - Routine that launches tiPoll in its own thread 
+ *
+ */
+#ifndef VXWORKS
+static void
+vfTDCStartPollingThread(void)
+{
+  int pvfTDC_status;
+
+  pvfTDC_status = 
+    pthread_create(&vfTDCpollthread,
+		   NULL,
+		   (void*(*)(void *)) vfTDCPoll,
+		   (void *)NULL);
+  if(pvfTDC_status!=0) 
+    {						
+      printf("%s: ERROR: vfTDC Polling Thread could not be started.\n",
+	     __FUNCTION__);	
+      printf("\t pthread_create returned: %d\n",pvfTDC_status);
+    }
+
+}
+#endif
+
+/**
+ * @ingroup IntPoll
+ * @brief Connect a user routine to the TI Interrupt or
+ *    latched trigger, if polling.
+ *
+ * @param vector VME Interrupt Vector
+ * @param routine Routine to call if block is available
+ * @param arg argument to pass to routine
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCIntConnect(unsigned int vector, VOIDFUNCPTR routine, unsigned int arg)
+{
+#ifndef VXWORKS
+  int status;
+#endif
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+
+#ifdef VXWORKS
+  /* Disconnect any current interrupts */
+  if((intDisconnect(vfTDCIntVec) !=0))
+    printf("%s: Error disconnecting Interrupt\n",__FUNCTION__);
+#endif
+
+  vfTDCIntCount = 0;
+  vfTDCAckCount = 0;
+  vfTDCDoAck = 1;
+
+  /* Set Vector and Level */
+  if((vector < 0xFF)&&(vector > 0x40)) 
+    {
+      vfTDCIntVec = vector;
+    }
+  else
+    {
+      vfTDCIntVec = VFTDC_INT_VEC;
+    }
+
+  VLOCK;
+  vmeWrite32(&TDCp->intsetup, (vfTDCIntLevel<<8) | vfTDCIntVec );
+  VUNLOCK;
+
+  switch (tiReadoutMode)
+    {
+    case VFTDC_READOUT_TS_POLL:
+    case VFTDC_READOUT_EXT_POLL:
+      break;
+
+    case VFTDC_READOUT_TS_INT:
+    case VFTDC_READOUT_EXT_INT:
+#ifdef VXWORKS
+      intConnect(INUM_TO_IVEC(vfTDCIntVec),vfTDCInt,arg);
+#else
+      status = vmeIntConnect (vfTDCIntVec, vfTDCIntLevel,
+			      vfTDCInt,arg);
+      if (status != OK) 
+	{
+	  printf("%s: vmeIntConnect failed with status = 0x%08x\n",
+		 __FUNCTION__,status);
+	  return(ERROR);
+	}
+#endif  
+      break;
+
+    default:
+      printf("%s: ERROR: TI Mode not defined (%d)\n",
+	     __FUNCTION__,tiReadoutMode);
+      return ERROR;
+    }
+
+  printf("%s: INFO: Interrupt Vector = 0x%x  Level = %d\n",
+	 __FUNCTION__,vfTDCIntVec,vfTDCIntLevel);
+
+  if(routine) 
+    {
+      vfTDCIntRoutine = routine;
+      vfTDCIntArg = arg;
+    }
+  else
+    {
+      vfTDCIntRoutine = NULL;
+      vfTDCIntArg = 0;
+    }
+
+  return(OK);
+
+}
+
+/**
+ * @ingroup IntPoll
+ * @brief Disable interrupts or kill the polling service thread
+ *
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCIntDisconnect()
+{
+#ifndef VXWORKS
+  int status;
+  void *res;
+#endif
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if(vfTDCIntRunning) 
+    {
+      logMsg("vfTDCIntDisconnect: ERROR: vfTDC is Enabled - Call vfTDCIntDisable() first\n",
+	     1,2,3,4,5,6);
+      return ERROR;
+    }
+
+  INTLOCK;
+
+  switch (tiReadoutMode) 
+    {
+    case VFTDC_READOUT_TS_INT:
+    case VFTDC_READOUT_EXT_INT:
+
+#ifdef VXWORKS
+      /* Disconnect any current interrupts */
+      sysIntDisable(vfTDCIntLevel);
+      if((intDisconnect(vfTDCIntVec) !=0))
+	printf("%s: Error disconnecting Interrupt\n",__FUNCTION__);
+#else
+      status = vmeIntDisconnect(vfTDCIntLevel);
+      if (status != OK) 
+	{
+	  printf("vmeIntDisconnect failed\n");
+	}
+#endif
+      break;
+
+    case VFTDC_READOUT_TS_POLL:
+    case VFTDC_READOUT_EXT_POLL:
+#ifndef VXWORKS
+      if(vfTDCpollthread) 
+	{
+	  if(pthread_cancel(vfTDCpollthread)<0) 
+	    perror("pthread_cancel");
+	  if(pthread_join(vfTDCpollthread,&res)<0)
+	    perror("pthread_join");
+	  if (res == PTHREAD_CANCELED)
+	    printf("%s: Polling thread canceled\n",__FUNCTION__);
+	  else
+	    printf("%s: ERROR: Polling thread NOT canceled\n",__FUNCTION__);
+	}
+#endif
+      break;
+    default:
+      break;
+    }
+
+  INTUNLOCK;
+
+  printf("%s: Disconnected\n",__FUNCTION__);
+
+  return OK;
+  
+}
+
+/**
+ * @ingroup IntPoll
+ * @brief Connect a user routine to be executed instead of the default 
+ *  TI interrupt/trigger latching acknowledge prescription
+ *
+ * @param routine Routine to call 
+ * @param arg argument to pass to routine
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCAckConnect(VOIDFUNCPTR routine, unsigned int arg)
+{
+  if(routine)
+    {
+      vfTDCAckRoutine = routine;
+      vfTDCAckArg = arg;
+    }
+  else
+    {
+      printf("%s: WARN: routine undefined.\n",__FUNCTION__);
+      vfTDCAckRoutine = NULL;
+      vfTDCAckArg = 0;
+      return ERROR;
+    }
+  return OK;
+}
+
+/**
+ * @ingroup IntPoll
+ * @brief Acknowledge an interrupt or latched trigger.  This "should" effectively 
+ *  release the "Busy" state of the TI.
+ *
+ *  Execute a user defined routine, if it is defined.  Otherwise, use
+ *  a default prescription.
+ */
+void
+vfTDCIntAck()
+{
+  int resetbits=0;
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  if (vfTDCAckRoutine != NULL)
+    {
+      /* Execute user defined Acknowlege, if it was defined */
+      VLOCK;
+      (*vfTDCAckRoutine) (vfTDCAckArg);
+      VUNLOCK;
+    }
+  else
+    {
+      VLOCK;
+      vfTDCDoAck = 1;
+      vfTDCAckCount++;
+      resetbits = VFTDC_RESET_BUSYACK;
+
+      if(!vfTDCReadoutEnabled)
+	{
+	  /* Readout Acknowledge and decrease the number of available blocks by 1 */
+	  resetbits |= VFTDC_RESET_BLOCK_READOUT;
+	}
+      
+      vmeWrite32(&TDCp->reset, resetbits);
+
+      VUNLOCK;
+    }
+
+}
+
+/**
+ * @ingroup IntPoll
+ * @brief Enable interrupts or latching triggers (depending on set TI mode)
+ *  
+ * @param iflag if = 1, trigger counter will be reset
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCIntEnable(int iflag)
+{
+#ifdef VXWORKS
+  int lock_key=0;
+#endif
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  VLOCK;
+  if(iflag == 1)
+    {
+      vfTDCIntCount = 0;
+      vfTDCAckCount = 0;
+    }
+
+  vfTDCIntRunning = 1;
+  vfTDCDoAck      = 1;
+  vfTDCNeedAck    = 0;
+
+  switch (vfTDCReadoutMode)
+    {
+    case VFTDC_READOUT_TS_POLL:
+    case VFTDC_READOUT_EXT_POLL:
+#ifndef VXWORKS
+      vfTDCStartPollingThread();
+#endif
+      break;
+
+    case VFTDC_READOUT_TS_INT:
+    case VFTDC_READOUT_EXT_INT:
+#ifdef VXWORKS
+      lock_key = intLock();
+      sysIntEnable(vfTDCIntLevel);
+#endif
+      printf("%s: ******* ENABLE INTERRUPTS *******\n",__FUNCTION__);
+      vmeWrite32(&TDCp->intsetup,
+	       vmeRead32(&TDCp->intsetup) | VFTDC_INTSETUP_ENABLE );
+      break;
+
+    default:
+      vfTDCIntRunning = 0;
+#ifdef VXWORKS
+      if(lock_key)
+	intUnlock(lock_key);
+#endif
+      printf("%s: ERROR: vfTDC Readout Mode not defined %d\n",
+	     __FUNCTION__,tiReadoutMode);
+      VUNLOCK;
+      return(ERROR);
+      
+    }
+
+  vmeWrite32(&TDCp->runningMode,0x71);
+  VUNLOCK; /* Locks performed in tiEnableTriggerSource() */
+
+  taskDelay(30);
+  vfTDCEnableTriggerSource();
+
+#ifdef VXWORKS
+  if(lock_key)
+    intUnlock(lock_key);
+#endif
+
+  return(OK);
+
+}
+
+/**
+ * @ingroup IntPoll
+ * @brief Disable interrupts or latching triggers
+ *
+*/
+void 
+vfTDCIntDisable()
+{
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+    {
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  vfTDCDisableTriggerSource(1);
+
+  VLOCK;
+  vmeWrite32(&TDCp->intsetup,
+	     vmeRead32(&TDCp->intsetup) & ~(VFTDC_INTSETUP_ENABLE));
+  vmeWrite32(&TDCp->runningMode,0x0);
+  vfTDCIntRunning = 0;
+  VUNLOCK;
+}
+
+/**
+ * @ingroup Status
+ * @brief Return current readout count
+ */
+unsigned int
+vfTDCGetIntCount()
+{
+  unsigned int rval=0;
+
+  VLOCK;
+  rval = vfTDCIntCount;
+  VUNLOCK;
+
+  return(rval);
+}
+
+/**
+ * @ingroup Status
+ * @brief Return current acknowledge count
+ */
+unsigned int
+vfTDCGetAckCount()
+{
+  unsigned int rval=0;
+
+  VLOCK;
+  rval = vfTDCAckCount;
+  VUNLOCK;
+
+  return(rval);
+}
+#endif /* NOTYET */
+
+/**
+ *  @ingroup Status
+ *  @brief Decode a data word from an vfTDC and print to standard out.
+ *  @param data 32bit vfTDC data word
+ */
+
+struct vftdc_data_struct vftdc_data;
+
+void 
+vfTDCDataDecode(unsigned int data)
+{
+  int i_print = 1;
+  static unsigned int type_last = 15;	/* initialize to type FILLER WORD */
+  static unsigned int time_last = 0;
+
+  if( data & 0x80000000 )		/* data type defining word */
+    {
+      vftdc_data.new_type = 1;
+      vftdc_data.type = (data & 0x78000000) >> 27;
+    }
+  else
+    {
+      vftdc_data.new_type = 0;
+      vftdc_data.type = type_last;
+    }
+        
+  switch( vftdc_data.type )
+    {
+    case 0:		/* BLOCK HEADER */
+      vftdc_data.slot_id_hd = ((data) & 0x7C00000) >> 22;
+      vftdc_data.modID      = (data & 0x3C0000)>>18;
+      vftdc_data.blk_num    = (data & 0x3FF00) >> 8;
+      vftdc_data.n_evts     = (data & 0xFF);
+      if( i_print ) 
+	printf("%8X - BLOCK HEADER - slot = %d  modID = %d   n_evts = %d   n_blk = %d\n",
+	       data, vftdc_data.slot_id_hd, 
+	       vftdc_data.modID, vftdc_data.n_evts, vftdc_data.blk_num);
+      break;
+
+    case 1:		/* BLOCK TRAILER */
+      vftdc_data.slot_id_tr = (data & 0x7C00000) >> 22;
+      vftdc_data.n_words = (data & 0x3FFFFF);
+      if( i_print ) 
+	printf("%8X - BLOCK TRAILER - slot = %d   n_words = %d\n",
+	       data, vftdc_data.slot_id_tr, vftdc_data.n_words);
+      break;
+
+    case 2:		/* EVENT HEADER */
+      vftdc_data.slot_id_evh = (data & 0x7C00000) >> 22;
+      vftdc_data.evt_num_1 = (data & 0x3FFFFF);
+      if( i_print ) 
+	printf("%8X - EVENT HEADER - slot = %d   evt_num = %d\n", data, 
+	       vftdc_data.slot_id_evh, vftdc_data.evt_num_1);
+      break;
+
+    case 3:		/* TRIGGER TIME */
+      if( vftdc_data.new_type )
+	{
+	  vftdc_data.time_1 = (data & 0x7FFFFFF);
+	  if( i_print ) 
+	    printf("%8X - TRIGGER TIME 1 - time = %08x\n", data, vftdc_data.time_1);
+	  vftdc_data.time_now = 1;
+	  time_last = 1;
+	}    
+      else
+	{
+	  if( time_last == 1 )
 	    {
-	      logMsg("\nvfTDCReadBlock: ERROR: VFTDC in slot %d is not First Board\n\n",id,0,0,0,0,0);
-	      VUNLOCK
-	      return(ERROR);
-	    }
-	  vmeAdr = (unsigned int)((unsigned long)(VFTDCpmb) - vfTDCA32Offset);
-#else
-	  logMsg("\nvfTDCReadBlock: ERROR: Multiblock readout not yet supported\n\n",1,2,3,4,5,6);
-	  VUNLOCK;
-	  return ERROR;
+	      vftdc_data.time_2 = (data & 0xFFFFFF);
+	      if( i_print ) 
+		printf("%8X - TRIGGER TIME 2 - time = %08x\n", data, vftdc_data.time_2);
+	      vftdc_data.time_now = 2;
+	    }    
+	  else
+	    if( i_print ) 
+	      printf("%8X - TRIGGER TIME - (ERROR)\n", data);
+	                
+	  time_last = vftdc_data.time_now;
+	}    
+      break;
+
+    case 7:
+      vftdc_data.group        = (data & 0x07000000)>>24;
+      vftdc_data.chan         = (data & 0x00f80000)>>19;
+      vftdc_data.edge_type    = (data & 0x00040000)>>18;
+      vftdc_data.time_coarse  = (data & 0x0003ff00)>>8;
+      vftdc_data.two_ns       = (data & 0x00000080)>>7;
+      vftdc_data.time_fine    = (data & 0x0000007f)>>0;
+
+      printf("%8X - TDC - grp = %d  ch = %2d  edge = %d  coarse = %4d  2ns = %d  fine time = %3d\n", 
+	     data, 
+	     vftdc_data.group,
+	     vftdc_data.chan,
+	     vftdc_data.edge_type,
+	     vftdc_data.time_coarse,
+	     vftdc_data.two_ns,
+	     vftdc_data.time_fine);
+      break;
+ 
+    case 4:
+    case 5:
+    case 6:
+    case 8:
+    case 9:
+    case 10:
+    case 11:
+    case 12:		/* UNDEFINED TYPE */
+    case 13:
+      if( i_print ) 
+	printf("%8X - UNDEFINED TYPE = %d\n", data, vftdc_data.type);
+      break;
+ 
+    case 14:		/* DATA NOT VALID (no data available) */
+      if( i_print ) 
+	printf("%8X - DATA NOT VALID = %d\n", data, vftdc_data.type);
+      break;
+
+    case 15:		/* FILLER WORD */
+      if( i_print ) 
+	printf("%8X - FILLER WORD = %d\n", data, vftdc_data.type);
+      break;
+    }
+	
+  type_last = vftdc_data.type;	/* save type of current data word */
+		   
+}        
+
+/*************************************************************
+ Online histograms.
+
+ With VFTDC_READOUT_HISTOGRAM, the readout adds each hit it returns to
+ per slot, per channel hit counts and coarse time histograms.  Each slot
+ has two sets: the readout fills the active one, while a monitor reads
+ the other.  vfTDCHistSwap asks the readout to change the sets of each
+ slot at its next block, so the readout never waits on a lock.  The
+ readout of a slot changes its active set before it clears the request,
+ and the monitor records which set was active when it posted the
+ request.  Slots are independent, so different slots may be read by
+ different threads, but a slot must be read by one thread at a time.
+*************************************************************/
+
+static struct vftdc_hist_struct *vfTDCHist[2] = {NULL, NULL};
+static struct vftdc_hist_struct *vfTDCHistDone = NULL; /* From vfTDCHistSwap */
+static volatile int vfTDCHistActive[VFTDC_MAX_SLOT+1];
+static volatile int vfTDCHistSwapRequest[VFTDC_MAX_SLOT+1];
+/* Monitor side: set that was active when the request was posted */
+static int          vfTDCHistPendingSet[VFTDC_MAX_SLOT+1];
+static int          vfTDCHistPosted[VFTDC_MAX_SLOT+1];
+
+/* Active set of a slot, after changing sets if requested */
+static struct vftdc_hist_struct *
+vfTDCHistSlot(unsigned int slot)
+{
+  if(vfTDCHistSwapRequest[slot])
+    {
+      vfTDCHistActive[slot] ^= 1;
+      VFTDC_BARRIER();
+      vfTDCHistSwapRequest[slot] = 0;
+    }
+
+  return &vfTDCHist[vfTDCHistActive[slot]][slot];
+}
+
+/**
+ * @ingroup Readout
+ * @brief Add the hits of data to the online histograms
+ *
+ *   This is what VFTDC_READOUT_HISTOGRAM does with the data read, for
+ *   data from another readout.  A slot must be filled by one thread at
+ *   a time.
+ *
+ * @param id Slot number of the data (blocks of other slots are found
+ *           by their block header)
+ * @param data Data, as returned by vfTDCReadBlock
+ * @param nwords Number of words in data
+ *
+ * @return OK if successful, otherwise ERROR.
+ */
+int
+vfTDCHistFill(int id, volatile unsigned int *data, int nwords)
+{
+  struct vftdc_hist_struct *h;
+  unsigned int word, type=VFTDC_TYPE_FILLER, chan, slot;
+  int iword;
+
+  if((vfTDCHist[0] == NULL) || (data == NULL))
+    return ERROR;
+
+  slot = ((id>0) && (id<=VFTDC_MAX_SLOT)) ? id : 0;
+  h = vfTDCHistSlot(slot);
+
+  for(iword=0; iword<nwords; iword++)
+    {
+      word = data[iword];
+#ifndef VXWORKS
+      word = LSWAP(word);
 #endif
+      if(word & VFTDC_DATA_TYPE_DEFINE)
+	{
+	  type = (word & VFTDC_DATA_TYPE_MASK) >> 27;
+	  if(type == VFTDC_TYPE_BLOCK_HEADER)
+	    {
+	      /* Multiblock readout: several slots in one buffer */
+	      slot = (word & 0x7C00000) >> 22;
+	      if(slot > VFTDC_MAX_SLOT)
+		slot = 0;
+	      h = vfTDCHistSlot(slot);
+	      h->nblocks++;
+	      continue;
+	    }
+	}
+
+      if(type == VFTDC_TYPE_TDC_HIT)
+	{
+	  chan = (word & 0x07f80000) >> 19;
+	  if(chan >= VFTDC_HIST_NCHAN)
+	    continue;
+	  h->nhits++;
+	  h->occupancy[chan]++;
+	  h->coarse[chan][((word & 0x3ff00) >> 8) >> VFTDC_HIST_BIN_SHIFT]++;
+	}
+    }
+
+  return OK;
+}
+
+/* Ask the readout to change the sets of each slot, except where the
+   previous request is still pending or its set not yet collected.
+   The set to fill next is cleared. */
+static void
+vfTDCHistRequest()
+{
+  int slot;
+
+  for(slot=0; slot<=VFTDC_MAX_SLOT; slot++)
+    {
+      if(vfTDCHistPosted[slot])
+	continue;
+      VFTDC_BARRIER();
+      vfTDCHistPendingSet[slot] = vfTDCHistActive[slot];
+      memset(&vfTDCHist[vfTDCHistPendingSet[slot]^1][slot], 0,
+	     sizeof(struct vftdc_hist_struct));
+      VFTDC_BARRIER();
+      vfTDCHistSwapRequest[slot] = 1;
+      vfTDCHistPosted[slot] = 1;
+    }
+}
+
+/* Copy the sets completed by the readout since the last request into
+   copy, indexed by slot.  Slots still pending are left empty.
+   Return the number of slots copied. */
+static int
+vfTDCHistCollect(struct vftdc_hist_struct *copy)
+{
+  int slot, ncopy=0;
+
+  for(slot=0; slot<=VFTDC_MAX_SLOT; slot++)
+    {
+      if(!vfTDCHistPosted[slot] || vfTDCHistSwapRequest[slot])
+	{
+	  memset(&copy[slot], 0, sizeof(struct vftdc_hist_struct));
+	  continue;
 	}
-      else
+      VFTDC_BARRIER();
+      memcpy(&copy[slot], &vfTDCHist[vfTDCHistPendingSet[slot]][slot],
+	     sizeof(struct vftdc_hist_struct));
+      vfTDCHistPosted[slot] = 0;
+      ncopy++;
+    }
+
+  return ncopy;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Allocate and clear the online histograms (VFTDC_READOUT_HISTOGRAM)
+ *
+ * @return OK if successful, otherwise ERROR.
+ */
+int
+vfTDCHistInit()
+{
+  int iset;
+
+  if(vfTDCHist[0] == NULL)
+    {
+      for(iset=0; iset<2; iset++)
 	{
-	  vmeAdr = (unsigned int)((unsigned long)TDCpd[id] - vfTDCA32Offset);
+	  vfTDCHist[iset] = (struct vftdc_hist_struct *)
+	    calloc(VFTDC_MAX_SLOT+1, sizeof(struct vftdc_hist_struct));
 	}
-#ifdef VXWORKS
-      retVal = sysVmeDmaSend((UINT32)laddr, vmeAdr, (nwrds<<2), 0);
-#else
-      retVal = vmeDmaSend((unsigned long)laddr, vmeAdr, (nwrds<<2));
-#endif
-      if(retVal != 0) 
+      vfTDCHistDone = (struct vftdc_hist_struct *)
+	calloc(VFTDC_MAX_SLOT+1, sizeof(struct vftdc_hist_struct));
+      if((vfTDCHist[0] == NULL) || (vfTDCHist[1] == NULL) ||
+	 (vfTDCHistDone == NULL))
 	{
-	  logMsg("\nvfTDCReadBlock: ERROR in DMA transfer Initialization 0x%x\n\n",retVal,0,0,0,0,0);
-	  VUNLOCK
-	  return(retVal);
+	  printf("%s: ERROR: Unable to allocate histograms\n",__FUNCTION__);
+	  vfTDCHistFree();
+	  return ERROR;
 	}
+    }
+  else
+    {
+      for(iset=0; iset<2; iset++)
+	memset(vfTDCHist[iset], 0,
+	       (VFTDC_MAX_SLOT+1)*sizeof(struct vftdc_hist_struct));
+    }
 
-      /* Wait until Done or Error */
-#ifdef VXWORKS
-      retVal = sysVmeDmaDone(10000,1);
-#else
-      retVal = vmeDmaDone();
-#endif
+  memset((void *)vfTDCHistActive, 0, sizeof(vfTDCHistActive));
+  memset((void *)vfTDCHistSwapRequest, 0, sizeof(vfTDCHistSwapRequest));
+  memset(vfTDCHistPosted, 0, sizeof(vfTDCHistPosted));
 
-      if(retVal > 0) 
-	{
-	  /* Check to see that Bus error was generated by VFTDC */
-	  if(rmode == 2) 
-	    {
-#ifdef NOTSUPPORTED
-	      csr = vmeRead32(&TDCp[vfTDCMaxSlot]->status);  /* from Last VFTDC */
-#endif
-	    }
-	  else
-	    {
-	      csr = vmeRead32(&TDCp[id]->status);
-	    }
-	  stat = (csr)&VFTDC_STATUS_BERR;
+  return OK;
+}
 
-	  if((retVal>0) && (stat)) 
-	    {
-#ifdef VXWORKS
-	      xferCount = (nwrds - (retVal>>2) + dummy);  /* Number of Longwords transfered */
-#else
-	      xferCount = ((retVal>>2) + dummy);  /* Number of Longwords transfered */
-#endif
-	      VUNLOCK
-	      return(xferCount); /* Return number of data words transfered */
-	    }
-	  else
-	    {
-#ifdef VXWORKS
-	      xferCount = (nwrds - (retVal>>2) + dummy);  /* Number of Longwords transfered */
-#else
-	      xferCount = ((retVal>>2) + dummy);  /* Number of Longwords transfered */
-#endif
-	      logMsg("vfTDCReadBlock: DMA transfer terminated by unknown BUS Error (csr=0x%x xferCount=%d id=%d)\n",
-		     csr,xferCount,id,0,0,0);
-	      VUNLOCK
-	      vfTDCBlockError=VFTDC_BLOCKERROR_UNKNOWN_BUS_ERROR;
-	      return(xferCount);
-	    }
-	} 
-      else if (retVal == 0)
-	{ /* Block Error finished without Bus Error */
-#ifdef VXWORKS
-	  logMsg("vfTDCReadBlock: WARN: DMA transfer terminated by word count 0x%x\n",nwrds,0,0,0,0,0);
-	  vfTDCBlockError=VFTDC_BLOCKERROR_TERM_ON_WORDCOUNT;
-#else
-	  logMsg("vfTDCReadBlock: WARN: DMA transfer returned zero word count 0x%x\n",nwrds,0,0,0,0,0);
-	  vfTDCBlockError=VFTDC_BLOCKERROR_ZERO_WORD_COUNT;
-#endif
-	  VUNLOCK
-	  return(nwrds);
-	} 
-      else 
-	{  /* Error in DMA */
-#ifdef VXWORKS
-	  logMsg("\nvfTDCReadBlock: ERROR: sysVmeDmaDone returned an Error\n\n",0,0,0,0,0,0);
-#else
-	  logMsg("\nvfTDCReadBlock: ERROR: vmeDmaDone returned an Error\n\n",0,0,0,0,0,0);
-#endif
-	  VUNLOCK
-	  vfTDCBlockError=VFTDC_BLOCKERROR_DMADONE_ERROR;
-	  return(retVal>>2);
-	}
+/**
+ * @ingroup Readout
+ * @brief Free the online histograms.  The readout must not be using
+ *        VFTDC_READOUT_HISTOGRAM anymore.
+ */
+void
+vfTDCHistFree()
+{
+  int iset;
 
-    } 
-  else 
-    {  /*Programmed IO */
+  for(iset=0; iset<2; iset++)
+    {
+      if(vfTDCHist[iset] != NULL)
+	free(vfTDCHist[iset]);
+      vfTDCHist[iset] = NULL;
+    }
+  if(vfTDCHistDone != NULL)
+    free(vfTDCHistDone);
+  vfTDCHistDone = NULL;
+}
 
-      /* Check if Bus Errors are enabled. If so then disable for Prog I/O reading */
-      VLOCK;
-      berr = vmeRead32(&TDCp[id]->vmeControl)&VFTDC_VMECONTROL_BERR;
-      if(berr)
-	vmeWrite32(&TDCp[id]->vmeControl, 
-		   vmeRead32(&TDCp[id]->vmeControl) & ~VFTDC_VMECONTROL_BERR);
+/**
+ * @ingroup Status
+ * @brief Complete the current set of online histograms and start a new one.
+ *
+ *   The readout of each slot changes sets at its next block with
+ *   VFTDC_READOUT_HISTOGRAM, so this waits up to timeout for the
+ *   initialized modules.  The hits of a slot that did not change sets
+ *   in time are returned by a later call.
+ *
+ * @param timeout Maximum wait, in milliseconds
+ *
+ * @return Completed histograms, indexed by slot number (valid until the
+ *         next call), otherwise NULL if no slot changed sets within
+ *         timeout.
+ */
+struct vftdc_hist_struct *
+vfTDCHistSwap(int timeout)
+{
+  int itdc, pending, waited=0;
 
-      dCnt = 0;
-      /* Read Block Header - should be first word */
-      bhead = (unsigned int) *TDCpd[id]; 
-#ifndef VXWORKS
-      bhead = LSWAP(bhead);
-#endif
-      if((bhead&VFTDC_DATA_TYPE_DEFINE)&&((bhead&VFTDC_DATA_TYPE_MASK) == VFTDC_DATA_BLOCK_HEADER)) 
+  if(vfTDCHist[0] == NULL)
+    {
+      printf("%s: ERROR: Histograms not initialized (vfTDCHistInit)\n",
+	     __FUNCTION__);
+      return NULL;
+    }
+
+  vfTDCHistRequest();
+
+  while(1)
+    {
+      pending = 0;
+      for(itdc=0; itdc<nvfTDC; itdc++)
 	{
-	  blknum = bhead&VFTDC_DATA_BLKNUM_MASK;
-	  ehead = (unsigned int) *TDCpd[id];
-#ifndef VXWORKS
-	  ehead = LSWAP(ehead);
-#endif
-#ifdef VXWORKS
-	  data[dCnt] = bhead;
-#else
-	  data[dCnt] = LSWAP(bhead); /* Swap back to little-endian */
-#endif
-	  dCnt++;
+	  if(vfTDCHistSwapRequest[vfTDCID[itdc]])
+	    pending++;
+	}
+      if((pending == 0) || (waited >= timeout))
+	break;
 #ifdef VXWORKS
-	  data[dCnt] = ehead;
+      taskDelay(1);
+      waited += 1000/sysClkRateGet();
 #else
-	  data[dCnt] = LSWAP(ehead); /* Swap back to little-endian */
+      usleep(1000);
+      waited++;
 #endif
-	  dCnt++;
-	}
-      else
+    }
+
+  if(vfTDCHistCollect(vfTDCHistDone) == 0)
+    return NULL;
+
+  return vfTDCHistDone;
+}
+
+/**
+ * @ingroup Status
+ * @brief Print the hit counts per channel of a slot from a set of
+ *        online histograms (from vfTDCHistSwap)
+ *
+ * @param id   Slot number
+ * @param hist Histograms returned by vfTDCHistSwap
+ *
+ * @return OK if successful, otherwise ERROR.
+ */
+int
+vfTDCHistPrint(int id, struct vftdc_hist_struct *hist)
+{
+  struct vftdc_hist_struct *h;
+  int chan, ndead=0;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (hist == NULL))
+    {
+      printf("%s: ERROR : Invalid slot (%d) or histograms\n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
+
+  h = &hist[id];
+  printf("vfTDC %2d: %u blocks, %u hits\n", id, h->nblocks, h->nhits);
+  for(chan=0; chan<VFTDC_HIST_NCHAN; chan++)
+    {
+      if((chan%8) == 0)
+	printf("  %d/%2d:", VFTDC_HIT_GROUP(chan), chan & 0x1F);
+      printf(" %9u", h->occupancy[chan]);
+      if((chan%8) == 7)
+	printf("\n");
+      if(h->occupancy[chan] == 0)
+	ndead++;
+    }
+  if(h->nhits && ndead)
+    printf("  %d channels without hits\n", ndead);
+
+  return OK;
+}
+
+#ifndef VXWORKS
+/*************************************************************
+ Shared memory monitoring.
+
+ A thread publishes the status of the modules into a POSIX shared
+ memory segment (vftdc_shm_struct) every period.  The update is
+ assembled privately, then copied in under a sequence lock: the
+ sequence number is odd while the copy is in progress, so readers
+ (vfTDCShmRead), in any process, retry instead of locking.  Readers
+ never access the VME bus nor vfTDCMutex.
+
+ Each update has the counters kept by the readout (blocks and events
+ read, errors, histograms).  The module registers (vftdc_snapshot_struct)
+ are only read every VFTDC_SHM_SNAPSHOT_UPDATES updates, and only when
+ the readout does not hold vfTDCMutex, so the publisher never waits
+ for the readout, nor makes it wait long.
+*************************************************************/
+
+/* Start of the update, after the header set by vfTDCShmStart */
+#define VFTDC_SHM_HEADER_SIZE offsetof(struct vftdc_shm_struct, timestamp)
+
+static struct vftdc_shm_struct *vfTDCShm = NULL;      /* Mapped segment */
+static struct vftdc_shm_struct *vfTDCShmStage = NULL; /* Next update */
+static char                     vfTDCShmName[64];
+static int                      vfTDCShmPeriod = 0;   /* ms */
+static volatile int             vfTDCShmRunning = 0;
+static pthread_t                vfTDCShmThread;
+
+/* vfTDCHistSwap without waiting: copy the sets completed since the last
+   call, for the slots where the readout has changed sets, and request
+   the next ones. */
+static int
+vfTDCShmHistSwap(struct vftdc_hist_struct *copy)
+{
+  int ncopy;
+
+  ncopy = vfTDCHistCollect(copy);
+  vfTDCHistRequest();
+
+  return ncopy;
+}
+
+/* Publish one update */
+static void
+vfTDCShmUpdate(struct vftdc_shm_struct *stage,
+	       struct vftdc_snapshot_struct *last)
+{
+  unsigned long long now;
+  float dt;
+  int itdc, id;
+
+  now = vfTDCTimeUsec();
+
+  /* Counters kept by the readout */
+  dt  = (stage->timestamp) ? (now - stage->timestamp) * 1e-6 : 0;
+  stage->ntdc = nvfTDC;
+  for(itdc=0; itdc<nvfTDC; itdc++)
+    {
+      id = vfTDCID[itdc];
+      stage->slotList[itdc] = id;
+      stage->readRate[id] = (dt > 0) ?
+	(vfTDCReadCount[id] - stage->readCount[id]) / dt : 0;
+      stage->readCount[id] = vfTDCReadCount[id];
+      stage->lastEvent[id] = vfTDCLastValid[id] ? vfTDCLastEvent[id] : 0;
+      memcpy(stage->blockErrors[id], (void *)vfTDCBlockErrorCount[id],
+	     sizeof(stage->blockErrors[id]));
+    }
+  stage->timestamp = now;
+
+  /* Module registers, if not read recently and the mutex is free */
+  if((stage->nupdates - stage->snapUpdate >= VFTDC_SHM_SNAPSHOT_UPDATES) &&
+     (pthread_mutex_trylock(&vfTDCMutex) == 0))
+    {
+      for(itdc=0; itdc<nvfTDC; itdc++)
+	vfTDCReadSnapshot(vfTDCID[itdc], &stage->snap[vfTDCID[itdc]]);
+      VUNLOCK;
+
+      dt = (stage->snapTimestamp) ? (now - stage->snapTimestamp) * 1e-6 : 0;
+      for(itdc=0; itdc<nvfTDC; itdc++)
 	{
-	  /* We got bad data - Check if there is any data at all */
-	  if( ((vmeRead32(&TDCp[id]->blockBuffer) & 
-		VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>16) == 0) 
-	    {
-	      logMsg("vfTDCReadBlock: FIFO Empty (0x%08x)\n",bhead,0,0,0,0,0);
-	      VUNLOCK
-	      return(0);
-	    } 
-	  else 
-	    {
-	      logMsg("\nvfTDCReadBlock: ERROR: Invalid Header Word 0x%08x\n\n",bhead,0,0,0,0,0);
-	      VUNLOCK
-	      return(ERROR);
-	    }
+	  id = vfTDCID[itdc];
+	  stage->trig1Rate[id] = ((dt > 0) && (last[id].slot == id)) ?
+	    (stage->snap[id].trig1_scaler - last[id].trig1_scaler) / dt : 0;
+	  last[id] = stage->snap[id];
 	}
+      stage->snapTimestamp = now;
+      stage->snapUpdate    = stage->nupdates;
+    }
 
-      ii=0;
-      while(ii<nwrds) 
-	{
-	  val = (unsigned int) *TDCpd[id];
-	  data[ii+2] = val;
-#ifndef VXWORKS
-	  val = LSWAP(val);
+  /* Histograms completed since the last update, when the readout fills them */
+  stage->histValid = 0;
+  if(vfTDCHist[0] != NULL)
+    stage->histValid = vfTDCShmHistSwap(stage->hist);
+
+#ifdef VFTDC_INSTRUMENT
+  stage->instrValid = (vfTDCInstrGet(&stage->instr) > 0);
 #endif
-	  if( (val&VFTDC_DATA_TYPE_DEFINE) 
-	      && ((val&VFTDC_DATA_TYPE_MASK) == VFTDC_DATA_BLOCK_TRAILER) )
-	    break;
-	  ii++;
-	}
-      ii++;
-      dCnt += ii;
 
+  stage->nupdates++;
 
-      if(berr)
-	vmeWrite32(&TDCp[id]->vmeControl, 
-		   vmeRead32(&TDCp[id]->vmeControl) | VFTDC_VMECONTROL_BERR);
+  /* Copy in, under the sequence lock */
+  vfTDCShm->seq++;
+  VFTDC_BARRIER();
+  memcpy((char *)vfTDCShm + VFTDC_SHM_HEADER_SIZE,
+	 (char *)stage + VFTDC_SHM_HEADER_SIZE,
+	 sizeof(struct vftdc_shm_struct) - VFTDC_SHM_HEADER_SIZE);
+  VFTDC_BARRIER();
+  vfTDCShm->seq++;
+}
 
-      VUNLOCK
-      return(dCnt);
+static void *
+vfTDCShmTask(void *arg)
+{
+  struct vftdc_snapshot_struct last[VFTDC_MAX_SLOT+1];
+
+  prctl(PR_SET_NAME,"vfTDCShm");
+
+  memset(last, 0, sizeof(last));
+
+  while(vfTDCShmRunning)
+    {
+      vfTDCShmUpdate(vfTDCShmStage, last);
+      usleep(vfTDCShmPeriod*1000);
+    }
+
+  return NULL;
+}
+
+/**
+ * @ingroup Status
+ * @brief Start publishing the module status into a shared memory segment
+ *
+ *   Block counts and rates, last event read, block errors, the online
+ *   histograms (if vfTDCHistInit was called, the publisher then takes
+ *   the place of vfTDCHistSwap) and the readout latency histograms (if
+ *   compiled with VFTDC_INSTRUMENT) are updated every period.  Scalers
+ *   and trigger rates are updated every VFTDC_SHM_SNAPSHOT_UPDATES
+ *   periods, when the readout is not holding the library mutex.
+ *
+ * @param name   Shared memory name (NULL: VFTDC_SHM_NAME)
+ * @param period Update period, in milliseconds
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCShmStart(const char *name, int period)
+{
+  int fd, status;
+
+  if(nvfTDC <= 0)
+    {
+      printf("%s: ERROR: No modules initialized\n",__FUNCTION__);
+      return ERROR;
+    }
+
+  if(period <= 0)
+    {
+      printf("%s: ERROR: Invalid period (%d)\n",__FUNCTION__,period);
+      return ERROR;
+    }
+
+  if(vfTDCShmRunning)
+    vfTDCShmStop();
+
+  if(name == NULL)
+    name = VFTDC_SHM_NAME;
+  strncpy(vfTDCShmName, name, sizeof(vfTDCShmName)-1);
+  vfTDCShmName[sizeof(vfTDCShmName)-1] = 0;
+
+  fd = shm_open(vfTDCShmName, O_CREAT | O_RDWR, 0644);
+  if(fd < 0)
+    {
+      perror("shm_open");
+      return ERROR;
+    }
+
+  if(ftruncate(fd, sizeof(struct vftdc_shm_struct)) < 0)
+    {
+      perror("ftruncate");
+      close(fd);
+      return ERROR;
+    }
+
+  vfTDCShm = (struct vftdc_shm_struct *)
+    mmap(NULL, sizeof(struct vftdc_shm_struct), PROT_READ | PROT_WRITE,
+	 MAP_SHARED, fd, 0);
+  close(fd);
+  if(vfTDCShm == MAP_FAILED)
+    {
+      perror("mmap");
+      vfTDCShm = NULL;
+      return ERROR;
+    }
+
+  vfTDCShmStage = (struct vftdc_shm_struct *)
+    calloc(1, sizeof(struct vftdc_shm_struct));
+  if(vfTDCShmStage == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate update buffer\n",__FUNCTION__);
+      munmap(vfTDCShm, sizeof(struct vftdc_shm_struct));
+      vfTDCShm = NULL;
+      return ERROR;
+    }
+  /* Registers are read at the first update */
+  vfTDCShmStage->snapUpdate = -VFTDC_SHM_SNAPSHOT_UPDATES;
+
+  /* Header, then an empty (even sequence) update */
+  vfTDCShm->seq = 0;
+  VFTDC_BARRIER();
+  memset((char *)vfTDCShm + VFTDC_SHM_HEADER_SIZE, 0,
+	 sizeof(struct vftdc_shm_struct) - VFTDC_SHM_HEADER_SIZE);
+  vfTDCShm->size    = sizeof(struct vftdc_shm_struct);
+  vfTDCShm->version = VFTDC_SHM_VERSION;
+  vfTDCShm->period  = period;
+  VFTDC_BARRIER();
+  vfTDCShm->magic   = VFTDC_SHM_MAGIC;
+
+  vfTDCShmPeriod  = period;
+  vfTDCShmRunning = 1;
+
+  status = pthread_create(&vfTDCShmThread, NULL, vfTDCShmTask, NULL);
+  if(status != 0)
+    {
+      vfTDCShmRunning = 0;
+      printf("%s: ERROR: Shared memory thread could not be started.\n",__FUNCTION__);
+      printf("\t pthread_create returned: %d\n",status);
+      munmap(vfTDCShm, sizeof(struct vftdc_shm_struct));
+      vfTDCShm = NULL;
+      free(vfTDCShmStage);
+      vfTDCShmStage = NULL;
+      return ERROR;
     }
 
-  VUNLOCK
-  return(OK);
+  return OK;
 }
 
-#ifdef NOTYET
 /**
- * @ingroup Config
- * @brief Enable Fiber transceiver
- *
- *  Note:  All Fiber are enabled by default 
- *         (no harm, except for 1-2W power usage)
- *
- * @sa tiDisableFiber
- * @param id Slot Number
- * @param   fiber: integer indicative of the transceiver to enable
- *
- *
- * @return OK if successful, ERROR otherwise.
+ * @ingroup Status
+ * @brief Stop publishing into shared memory.  The segment is kept, with
+ *        its last update, for readers.
  *
+ * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCEnableFiber(int id, unsigned int fiber)
+vfTDCShmStop()
 {
-  unsigned int sval;
-  unsigned int fiberbit;
-
-  if(id==0) id=vfTDCID[0];
-
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
-    {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
+  if(!vfTDCShmRunning)
+    return OK;
 
-  if((fiber<1) | (fiber>8))
+  vfTDCShmRunning = 0;
+  if(pthread_join(vfTDCShmThread, NULL) != 0)
     {
-      printf("%s: ERROR: Invalid value for fiber (%d)\n",
-	     __FUNCTION__,fiber);
+      perror("pthread_join");
       return ERROR;
     }
 
-  fiberbit = (1<<(fiber-1));
-
-  VLOCK;
-  sval = vmeRead32(&TDCp->fiber);
-  vmeWrite32(&TDCp->fiber,
-	     sval | fiberbit );
-  VUNLOCK;
+  munmap(vfTDCShm, sizeof(struct vftdc_shm_struct));
+  vfTDCShm = NULL;
+  free(vfTDCShmStage);
+  vfTDCShmStage = NULL;
 
   return OK;
-  
 }
 
 /**
- * @ingroup Config
- * @brief Disnable Fiber transceiver
- *
- * @sa tiEnableFiber
- *
- * @param id Slot Number
- * @param   fiber: integer indicative of the transceiver to disable
+ * @ingroup Status
+ * @brief Read a consistent copy of the status published by vfTDCShmStart.
  *
+ *   May be called from any process.  Does not access VME.
  *
- * @return OK if successful, ERROR otherwise.
+ * @param name Shared memory name (NULL: VFTDC_SHM_NAME)
+ * @param copy Where to store the copy
  *
+ * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCDisableFiber(int id, unsigned int fiber)
+vfTDCShmRead(const char *name, struct vftdc_shm_struct *copy)
 {
-  unsigned int rval;
-  unsigned int fiberbit;
+  volatile struct vftdc_shm_struct *shm;
+  struct stat sb;
+  unsigned int seq;
+  int fd, itry, rval=ERROR;
 
-  if(id==0) id=vfTDCID[0];
+  if(copy == NULL)
+    {
+      printf("%s: ERROR: Invalid pointer\n",__FUNCTION__);
+      return ERROR;
+    }
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(name == NULL)
+    name = VFTDC_SHM_NAME;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if(fd < 0)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      perror("shm_open");
       return ERROR;
     }
 
-  if((fiber<1) | (fiber>8))
+  if((fstat(fd, &sb) < 0) || (sb.st_size < (off_t)sizeof(struct vftdc_shm_struct)))
     {
-      printf("%s: ERROR: Invalid value for fiber (%d)\n",
-	     __FUNCTION__,fiber);
+      printf("%s: ERROR: %s is not a vfTDC status segment\n",__FUNCTION__,name);
+      close(fd);
       return ERROR;
     }
 
-  fiberbit = (1<<(fiber-1));
+  shm = (volatile struct vftdc_shm_struct *)
+    mmap(NULL, sizeof(struct vftdc_shm_struct), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(shm == MAP_FAILED)
+    {
+      perror("mmap");
+      return ERROR;
+    }
 
-  VLOCK;
-  rval = vmeRead32(&TDCp->fiber);
-  vmeWrite32(&TDCp->fiber,
-	   rval & ~fiberbit );
-  VUNLOCK;
+  if((shm->magic != VFTDC_SHM_MAGIC) || (shm->version != VFTDC_SHM_VERSION) ||
+     (shm->size != sizeof(struct vftdc_shm_struct)))
+    {
+      printf("%s: ERROR: %s has an incompatible format\n",__FUNCTION__,name);
+      munmap((void *)shm, sizeof(struct vftdc_shm_struct));
+      return ERROR;
+    }
+
+  for(itry=0; itry<VFTDC_SHM_READ_TRIES; itry++)
+    {
+      seq = shm->seq;
+      if(seq & 1)
+	{
+	  usleep(100);
+	  continue;
+	}
+      VFTDC_BARRIER();
+      memcpy(copy, (void *)shm, sizeof(struct vftdc_shm_struct));
+      VFTDC_BARRIER();
+      if(shm->seq == seq)
+	{
+	  rval = OK;
+	  break;
+	}
+    }
 
+  if(rval != OK)
+    printf("%s: ERROR: No consistent copy after %d tries\n",
+	   __FUNCTION__,VFTDC_SHM_READ_TRIES);
+
+  munmap((void *)shm, sizeof(struct vftdc_shm_struct));
   return rval;
-  
 }
-#endif /* NOTYET */
+#endif /* VXWORKS */
+
+#ifndef VXWORKS
+/*************************************************************
+ Sampling monitor.
+
+ With VFTDC_READOUT_SAMPLE, the readout copies one block out of every
+ ratio into a small ring of buffers, for a low priority thread that
+ decodes it (vfTDCDecodeEvents) and passes the events to the user
+ routine (vfTDCSampleConnect).  A block goes into any free buffer of
+ the ring; when none is free, it is not sampled and the readout never
+ waits.  With a CPU budget, the thread measures every second its own
+ CPU time and the time the readout spent in vfTDCReadBlockResult.  The
+ budget is reduced by the busy fraction of the readout, so that the
+ sampling gives way to a busy readout.  The ratio is raised in
+ proportion when over that budget or when blocks were dropped (at
+ least doubling it), and halved when under half of it.
+*************************************************************/
 
+#define VFTDC_SAMPLE_FREE    0
+#define VFTDC_SAMPLE_WRITING 1
+#define VFTDC_SAMPLE_FULL    2
 
-/**
- * @ingroup Config
- * @brief Enable Bus Errors to terminate Block Reads
- * @param id Slot Number
- * @sa tiDisableBusError
- * @return OK if successful, otherwise ERROR
- */
-int
-vfTDCEnableBusError(int id)
+struct vftdc_sample_entry
+{
+  volatile int       state;       /* VFTDC_SAMPLE_FREE/WRITING/FULL */
+  int                nwords;
+  unsigned int      *data;
+};
+
+static struct vftdc_sample_entry vfTDCSampleRing[VFTDC_SAMPLE_NBUFFERS];
+static unsigned int     *vfTDCSampleMem = NULL;
+static volatile unsigned int vfTDCSampleHead = 0;
+static int               vfTDCSampleMaxWords = 0;
+static float             vfTDCSampleBudget = 0;
+static volatile int      vfTDCSampleRatio = 1;
+static volatile unsigned int vfTDCSampleBlocks = 0;
+static volatile int      vfTDCSampleRunning = 0;
+static pthread_t         vfTDCSampleThread;
+static VFTDCSAMPLEFUNCPTR vfTDCSampleRoutine = NULL;
+static unsigned int      vfTDCSampleArg = 0;
+static struct vftdc_sample_stats_struct vfTDCSampleStats;
+
+/* Copy data (as returned by vfTDCReadBlock) into the ring, if it is
+   one of the sampled blocks and there is room */
+static void
+vfTDCSampleTap(volatile unsigned int *data, int nwords)
 {
+  struct vftdc_sample_entry *e=NULL;
+  unsigned int head;
+  int ibuf;
 
-  if(id==0) id=vfTDCID[0];
+  if(!vfTDCSampleRunning)
+    return;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if((VFTDC_ATOMIC_ADD(&vfTDCSampleBlocks, 1) % vfTDCSampleRatio) != 0)
+    return;
+
+  if(nwords > vfTDCSampleMaxWords)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
+      VFTDC_ATOMIC_ADD(&vfTDCSampleStats.ntoolarge, 1);
+      return;
     }
 
-  VLOCK;
-  vmeWrite32(&TDCp[id]->vmeControl,
-	   vmeRead32(&TDCp[id]->vmeControl) | (VFTDC_VMECONTROL_BERR) );
-  VUNLOCK;
-  return OK;
+  /* Another readout thread may have taken the buffer at head: try the
+     others before dropping the block */
+  head = vfTDCSampleHead;
+  for(ibuf=0; ibuf<VFTDC_SAMPLE_NBUFFERS; ibuf++)
+    {
+      e = &vfTDCSampleRing[(head + ibuf) % VFTDC_SAMPLE_NBUFFERS];
+      if(VFTDC_ATOMIC_CAS(&e->state, VFTDC_SAMPLE_FREE,
+			   VFTDC_SAMPLE_WRITING))
+	break;
+    }
+  if(ibuf == VFTDC_SAMPLE_NBUFFERS)
+    {
+      VFTDC_ATOMIC_ADD(&vfTDCSampleStats.ndropped, 1);
+      return;
+    }
+  VFTDC_ATOMIC_ADD(&vfTDCSampleHead, ibuf + 1);
+
+  memcpy(e->data, (void *)data, nwords<<2);
+  e->nwords = nwords;
+  VFTDC_BARRIER();
+  e->state = VFTDC_SAMPLE_FULL;
+  VFTDC_ATOMIC_ADD(&vfTDCSampleStats.nsampled, 1);
 }
 
-/**
- * @ingroup Config
- * @brief Disable Bus Errors to terminate Block Reads
- * @param id Slot Number
- * @sa tiEnableBusError
- * @return OK if successful, otherwise ERROR
- */
-int
-vfTDCDisableBusError(int id)
+static unsigned long long
+vfTDCThreadCpuUsec()
 {
+  struct timespec ts;
 
-  if(id==0) id=vfTDCID[0];
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (unsigned long long)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+/* Change the sampling ratio from the CPU time used, the busy fraction
+   of the readout, and the blocks sampled and dropped, in the last
+   interval */
+static void
+vfTDCSampleAdjust(float cpu, float busy, unsigned int nsampled,
+		  unsigned int ndropped)
+{
+  float factor=1, drop, budget;
+  int ratio = vfTDCSampleRatio;
+
+  vfTDCSampleStats.cpuFraction = cpu;
+  vfTDCSampleStats.busyFraction = busy;
+
+  if(vfTDCSampleBudget <= 0)
+    return;
+
+  /* Leave the CPU to a busy readout */
+  budget = vfTDCSampleBudget * ((busy < 0.99) ? (1 - busy) : 0.01);
+
+  if(cpu > budget)
+    factor = cpu / budget;
+
+  if(ndropped)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
+      drop = (float)(nsampled + ndropped) / ((nsampled) ? nsampled : 1);
+      if(drop > factor)
+	factor = drop;
     }
 
-  VLOCK;
-  vmeWrite32(&TDCp[id]->vmeControl,
-	   vmeRead32(&TDCp[id]->vmeControl) & ~(VFTDC_VMECONTROL_BERR) );
-  VUNLOCK;
-  return OK;
+  if(factor > 1)
+    {
+      if(factor < 2)
+	factor = 2;
+      ratio = (ratio * factor < VFTDC_SAMPLE_MAX_RATIO) ?
+	(int)(ratio * factor) : VFTDC_SAMPLE_MAX_RATIO;
+    }
+  else if((cpu < budget/2) && (ratio > 1))
+    ratio /= 2;
+
+  vfTDCSampleRatio = ratio;
 }
 
+static void *
+vfTDCSampleTask(void *arg)
+{
+  struct vftdc_sample_entry *e;
+  struct vftdc_arena_struct arena;
+  struct vftdc_event_struct *events;
+  unsigned int tail=0, nsampled=0, ndropped=0;
+  unsigned long long wall0, cpu0, busy0, now;
+  void *mem;
+  int nevents, ievt, ibuf;
+
+  prctl(PR_SET_NAME,"vfTDCSample");
+
+  mem = malloc(vfTDCSampleMaxWords *
+	       (sizeof(struct vftdc_hit_struct) + sizeof(struct vftdc_event_struct)));
+  if((mem == NULL) ||
+     (vfTDCArenaInit(&arena, mem, vfTDCSampleMaxWords *
+		     (sizeof(struct vftdc_hit_struct) +
+		      sizeof(struct vftdc_event_struct))) != OK))
+    {
+      printf("%s: ERROR: Unable to allocate decoding arena\n",__FUNCTION__);
+      if(mem)
+	free(mem);
+      vfTDCSampleRunning = 0;
+      return NULL;
+    }
+
+  wall0 = vfTDCTimeUsec();
+  cpu0  = vfTDCThreadCpuUsec();
+  busy0 = vfTDCSampleReadoutUsec;
+
+  while(vfTDCSampleRunning)
+    {
+      /* Buffers are not necessarily filled in order */
+      e = NULL;
+      for(ibuf=0; ibuf<VFTDC_SAMPLE_NBUFFERS; ibuf++)
+	{
+	  if(vfTDCSampleRing[(tail + ibuf) % VFTDC_SAMPLE_NBUFFERS].state ==
+	     VFTDC_SAMPLE_FULL)
+	    {
+	      e = &vfTDCSampleRing[(tail + ibuf) % VFTDC_SAMPLE_NBUFFERS];
+	      tail += ibuf + 1;
+	      break;
+	    }
+	}
+
+      if(e != NULL)
+	{
+	  VFTDC_BARRIER();
+	  vfTDCArenaReset(&arena);
+	  nevents = vfTDCDecodeEvents(e->data, e->nwords, VFTDC_DECODE_SWAP,
+				      &arena, &events);
+	  VFTDC_BARRIER();
+	  e->state = VFTDC_SAMPLE_FREE;
+
+	  if(nevents > 0)
+	    {
+	      vfTDCSampleStats.ndecoded++;
+	      vfTDCSampleStats.nevents += nevents;
+	      for(ievt=0; ievt<nevents; ievt++)
+		vfTDCSampleStats.nhits += events[ievt].nhits;
+
+	      if(vfTDCSampleRoutine != NULL)
+		(*vfTDCSampleRoutine) (events, nevents, vfTDCSampleArg);
+	    }
+	}
+      else
+	usleep(1000);
+
+      now = vfTDCTimeUsec();
+      if(now - wall0 >= 1000000)
+	{
+	  vfTDCSampleAdjust((float)(vfTDCThreadCpuUsec() - cpu0) / (now - wall0),
+			    (float)(vfTDCSampleReadoutUsec - busy0) / (now - wall0),
+			    vfTDCSampleStats.nsampled - nsampled,
+			    vfTDCSampleStats.ndropped - ndropped);
+	  nsampled = vfTDCSampleStats.nsampled;
+	  ndropped = vfTDCSampleStats.ndropped;
+	  wall0 = now;
+	  cpu0  = vfTDCThreadCpuUsec();
+	  busy0 = vfTDCSampleReadoutUsec;
+	}
+    }
+
+  free(mem);
+  return NULL;
+}
+#endif /* VXWORKS */
 
 /**
- * @ingroup Config
- * @brief Generate a software SyncReset signal.
+ * @ingroup Readout
+ * @brief Connect a user routine to receive the decoded events of sampled blocks
  *
- *  @param id Slot Number
+ * @param routine Routine called from the sampling thread, with the
+ *                events of one block (valid only during the call)
+ * @param arg     Argument passed to the routine
  *
- * @return OK if successful, otherwise ERROR
+ * @return OK
  */
 int
-vfTDCSyncReset(int id)
+vfTDCSampleConnect(VFTDCSAMPLEFUNCPTR routine, unsigned int arg)
 {
-  if(id==0) id=vfTDCID[0];
+#ifndef VXWORKS
+  vfTDCSampleRoutine = routine;
+  vfTDCSampleArg = arg;
+#endif
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
-    {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
-  
-  VLOCK;
-  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_SYNCRESET); 
-  taskDelay(1);
-  VUNLOCK;
-  
   return OK;
 }
 
 /**
- * @ingroup Config
- * @brief Routine to set the A32 Base
+ * @ingroup Readout
+ * @brief Start the sampling monitor (VFTDC_READOUT_SAMPLE)
+ *
+ * @param ratio     One block out of ratio is sampled (1 - VFTDC_SAMPLE_MAX_RATIO)
+ * @param cpuBudget Fraction of a CPU the sampling thread may use.  The
+ *                  ratio is adjusted to stay within it.  0: ratio is fixed.
+ * @param maxwords  Largest block that is sampled, in words
  *
- * @param id Slot Number
  * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCSetAdr32(int id, unsigned int a32base)
+vfTDCSampleStart(int ratio, float cpuBudget, int maxwords)
 {
-  unsigned long laddr=0;
-  int res=0,a32Enabled=0;
-
-  if(id==0) id=vfTDCID[0];
+#ifdef VXWORKS
+  printf("%s: ERROR: Not supported for vxWorks\n",__FUNCTION__);
+  return ERROR;
+#else
+  int ibuf, status;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if((ratio < 1) || (ratio > VFTDC_SAMPLE_MAX_RATIO))
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Invalid ratio (%d)\n",__FUNCTION__,ratio);
       return ERROR;
     }
 
-  if(a32base<0x00800000)
+  if((cpuBudget < 0) || (cpuBudget > 1) || (maxwords <= 0))
     {
-      printf("%s: ERROR: a32base out of range (0x%08x)\n",
-	     __FUNCTION__,a32base);
+      printf("%s: ERROR: Invalid cpuBudget (%f) or maxwords (%d)\n",
+	     __FUNCTION__,cpuBudget,maxwords);
       return ERROR;
     }
 
-  VLOCK;
-  vmeWrite32(&TDCp[id]->adr32, 
-	     (a32base & VFTDC_ADR32_BASE_MASK) );
-
-  vmeWrite32(&TDCp[id]->vmeControl, 
-	     vmeRead32(&TDCp[id]->vmeControl) | VFTDC_VMECONTROL_A32);
+  if(vfTDCSampleRunning)
+    vfTDCSampleStop();
 
-  a32Enabled = vmeRead32(&TDCp[id]->vmeControl)&(VFTDC_VMECONTROL_A32);
-  if(!a32Enabled)
+  vfTDCSampleMem = (unsigned int *)
+    malloc(VFTDC_SAMPLE_NBUFFERS * maxwords * sizeof(unsigned int));
+  if(vfTDCSampleMem == NULL)
     {
-      printf("%s: ERROR: Failed to enable A32 Address\n",__FUNCTION__);
-      VUNLOCK;
+      printf("%s: ERROR: Unable to allocate sample buffers\n",__FUNCTION__);
       return ERROR;
     }
 
-#ifdef VXWORKS
-  res = sysBusToLocalAdrs(0x09,(char *)a32base,(char **)&laddr);
-  if (res != 0) 
+  for(ibuf=0; ibuf<VFTDC_SAMPLE_NBUFFERS; ibuf++)
     {
-      printf("%s: ERROR in sysBusToLocalAdrs(0x09,0x%x,&laddr) \n",
-	     __FUNCTION__,a32base);
-      VUNLOCK;
-      return(ERROR);
+      vfTDCSampleRing[ibuf].state  = VFTDC_SAMPLE_FREE;
+      vfTDCSampleRing[ibuf].nwords = 0;
+      vfTDCSampleRing[ibuf].data   = vfTDCSampleMem + ibuf*maxwords;
     }
-#else
-  res = vmeBusToLocalAdrs(0x09,(char *)(unsigned long)a32base,(char **)&laddr);
-  if (res != 0) 
+  memset(&vfTDCSampleStats, 0, sizeof(vfTDCSampleStats));
+  vfTDCSampleHead     = 0;
+  vfTDCSampleBlocks   = 0;
+  vfTDCSampleMaxWords = maxwords;
+  vfTDCSampleBudget   = cpuBudget;
+  vfTDCSampleRatio    = ratio;
+  VFTDC_BARRIER();
+  vfTDCSampleRunning  = 1;
+
+  status = pthread_create(&vfTDCSampleThread, NULL, vfTDCSampleTask, NULL);
+  if(status != 0)
     {
-      printf("%s: ERROR in vmeBusToLocalAdrs(0x09,0x%x,&laddr) \n",
-	     __FUNCTION__,a32base);
-      VUNLOCK;
-      return(ERROR);
+      vfTDCSampleRunning = 0;
+      free(vfTDCSampleMem);
+      vfTDCSampleMem = NULL;
+      printf("%s: ERROR: Sampling thread could not be started.\n",__FUNCTION__);
+      printf("\t pthread_create returned: %d\n",status);
+      return ERROR;
     }
-#endif
-
-  vfTDCA32Base = a32base;
-  vfTDCA32Offset = laddr - vfTDCA32Base;
-  TDCpd[id] = (unsigned int *)(laddr);  /* Set a pointer to the FIFO */
-  VUNLOCK;
-
-  printf("%s: A32 Base address set to 0x%08x\n",
-	 __FUNCTION__,vfTDCA32Base);
 
   return OK;
+#endif
 }
 
 /**
- * @ingroup Config
- * @brief Disable A32
+ * @ingroup Readout
+ * @brief Stop the sampling monitor.  The readout must not be using
+ *        VFTDC_READOUT_SAMPLE anymore.
  *
- * @param id Slot Number
  * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCDisableA32(int id)
+vfTDCSampleStop()
 {
-  if(id==0) id=vfTDCID[0];
+#ifndef VXWORKS
+  if(vfTDCSampleMem == NULL)
+    return OK;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  vfTDCSampleRunning = 0;
+  if(pthread_join(vfTDCSampleThread, NULL) != 0)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      perror("pthread_join");
       return ERROR;
     }
-  
-  VLOCK;
-  vmeWrite32(&TDCp[id]->adr32,0x0);
-  vmeWrite32(&TDCp[id]->vmeControl, 
-	     vmeRead32(&TDCp[id]->vmeControl) & ~VFTDC_VMECONTROL_A32);
-  VUNLOCK;
+
+  free(vfTDCSampleMem);
+  vfTDCSampleMem = NULL;
+#endif
 
   return OK;
 }
 
 /**
- * @ingroup Config
- * @brief Reset the L1A counter, as incremented by the TI.
+ * @ingroup Status
+ * @brief Return the counters and current ratio of the sampling monitor
+ *
+ * @param stats Where to store them
  *
- * @param id Slot Number
  * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCResetEventCounter(int id)
+vfTDCSampleGetStats(struct vftdc_sample_stats_struct *stats)
 {
-  if(id==0) id=vfTDCID[0];
-
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(stats == NULL)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Invalid pointer\n",__FUNCTION__);
       return ERROR;
     }
-  
-  VLOCK;
-  vmeWrite32(&TDCp[id]->reset, VFTDC_RESET_SCALERS_RESET);
-  VUNLOCK;
+
+#ifndef VXWORKS
+  *stats = vfTDCSampleStats;
+  stats->ratio = vfTDCSampleRatio;
+#else
+  memset(stats, 0, sizeof(struct vftdc_sample_stats_struct));
+#endif
 
   return OK;
 }
 
 /**
  * @ingroup Status
- * @brief Returns the event counter (48 bit)
- *
- * @param id Slot Number
- * @return Number of accepted events if successful, otherwise ERROR
+ * @brief Print the counters and current ratio of the sampling monitor
  */
-unsigned long long int
-vfTDCGetEventCounter(int id)
+void
+vfTDCSamplePrintStats()
 {
-  unsigned long long int rval=0;
-  unsigned int lo=0, hi=0;
+  struct vftdc_sample_stats_struct st;
+
+  vfTDCSampleGetStats(&st);
+
+  printf("vfTDC sampling monitor\n");
+  printf("  Ratio          1/%d\n", st.ratio);
+  printf("  CPU            %.1f%%\n", st.cpuFraction*100.);
+  printf("  Readout busy   %.1f%%\n", st.busyFraction*100.);
+  printf("  Sampled        %u blocks\n", st.nsampled);
+  printf("  Dropped        %u blocks (ring full)\n", st.ndropped);
+  printf("  Too large      %u blocks\n", st.ntoolarge);
+  printf("  Decoded        %u blocks, %llu events, %llu hits\n",
+	 st.ndecoded, st.nevents, st.nhits);
+}
 
-  if(id==0) id=vfTDCID[0];
+/*************************************************************
+ Buffer byte order conversion.
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+ Data is read out in VME (big endian) byte order.  On little endian
+ hosts, a buffer is swapped once with vfTDCBufferToHost, using SSSE3 or
+ AVX2 byte shuffles when the CPU has them, instead of LSWAP on every
+ word by every consumer.
+*************************************************************/
+
+#if !defined(VXWORKS) && (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5)
+#define VFTDC_SWAP_SIMD
+#include <immintrin.h>
+#endif
+
+static void
+vfTDCSwapScalar(unsigned int *dst, const unsigned int *src, int nwords)
+{
+  int iword;
+
+  for(iword=0; iword<nwords; iword++)
+    dst[iword] = LSWAP(src[iword]);
+}
+
+#ifdef VFTDC_SWAP_SIMD
+__attribute__((target("ssse3")))
+static void
+vfTDCSwapSSSE3(unsigned int *dst, const unsigned int *src, int nwords)
+{
+  const __m128i shuf = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+  __m128i v;
+  int iword=0;
+
+  for(; iword+4<=nwords; iword+=4)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
+      v = _mm_loadu_si128((const __m128i *)(src + iword));
+      _mm_storeu_si128((__m128i *)(dst + iword), _mm_shuffle_epi8(v, shuf));
     }
 
-  VLOCK;
-  lo = vmeRead32(&TDCp[id]->eventNumber_lo);
-  hi = (vmeRead32(&TDCp[id]->eventNumber_hi) & VFTDC_EVENTNUMBER_HI_MASK)>>16;
+  vfTDCSwapScalar(dst + iword, src + iword, nwords - iword);
+}
 
-  rval = lo | ((unsigned long long)hi<<32);
-  VUNLOCK;
-  
-  return rval;
+__attribute__((target("avx2")))
+static void
+vfTDCSwapAVX2(unsigned int *dst, const unsigned int *src, int nwords)
+{
+  const __m256i shuf = _mm256_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3,
+				       12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+  __m256i v0, v1;
+  int iword=0;
+
+  for(; iword+16<=nwords; iword+=16)
+    {
+      v0 = _mm256_loadu_si256((const __m256i *)(src + iword));
+      v1 = _mm256_loadu_si256((const __m256i *)(src + iword + 8));
+      _mm256_storeu_si256((__m256i *)(dst + iword),     _mm256_shuffle_epi8(v0, shuf));
+      _mm256_storeu_si256((__m256i *)(dst + iword + 8), _mm256_shuffle_epi8(v1, shuf));
+    }
+
+  vfTDCSwapSSSE3(dst + iword, src + iword, nwords - iword);
 }
+#endif /* VFTDC_SWAP_SIMD */
 
+static void (*vfTDCSwapRoutine)(unsigned int *, const unsigned int *, int) = NULL;
+
+/* Choose the byte swap routine for this CPU */
+static void
+vfTDCSwapSelect()
+{
+  vfTDCSwapRoutine = vfTDCSwapScalar;
+#ifdef VFTDC_SWAP_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    vfTDCSwapRoutine = vfTDCSwapAVX2;
+  else if(__builtin_cpu_supports("ssse3"))
+    vfTDCSwapRoutine = vfTDCSwapSSSE3;
+#endif
+}
 
 /**
- * @ingroup Readout
- * @brief Returns the number of Blocks available for readout
+ * @ingroup Decode
+ * @brief Swap the bytes of each 32 bit word of a buffer
  *
- * @param id Slot Number
- * @return Number of blocks available for readout if successful, otherwise ERROR
+ * @param dst Destination (may be the same as src)
+ * @param src Source
+ * @param nwords Number of words
  *
+ * @return OK if successful, otherwise ERROR
  */
-unsigned int
-vfTDCBReady(int id)
+int
+vfTDCSwapBuffer(volatile unsigned int *dst, volatile unsigned int *src, int nwords)
 {
-  unsigned int blockBuffer=0, rval=0;
-
-  if(id==0) id=vfTDCID[0];
-
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if((dst == NULL) || (src == NULL) || (nwords < 0))
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Invalid buffer or size (%d)\n",__FUNCTION__,nwords);
       return ERROR;
     }
 
-  VLOCK;
-  blockBuffer = vmeRead32(&TDCp[id]->blockBuffer);
-  rval        = (blockBuffer&VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK)>>8;
-  VUNLOCK;
+  if(vfTDCSwapRoutine == NULL)
+    vfTDCSwapSelect();
 
-  return rval;
+  (*vfTDCSwapRoutine)((unsigned int *)dst, (const unsigned int *)src, nwords);
+
+  return OK;
 }
 
 /**
- * @ingroup Config
- * @brief Set the clock to the specified source.
+ * @ingroup Decode
+ * @brief Convert a buffer to host byte order, if it is not already
  *
- * @param id Slot Number
- * @param   source
- *         -   0:  HFBR1
- *         -   2:  Internal clock
- *         -   3:  VXS
+ * @param buf Buffer, and its current byte order (VFTDC_ORDER_*)
  *
  * @return OK if successful, otherwise ERROR
  */
 int
-vfTDCSetClockSource(int id, unsigned int source)
+vfTDCBufferToHost(struct vftdc_buffer_struct *buf)
 {
-  int rval=OK;
-  unsigned int clkread=0, clkset=0;
-  char sClock[20] = "";
-
-  if(id==0) id=vfTDCID[0];
-
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(buf == NULL)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Invalid buffer\n",__FUNCTION__);
       return ERROR;
     }
 
-  switch(source)
-    {
-    case VFTDC_CLOCK_INTERNAL:
-      sprintf(sClock,"ONBOARD (%d)",source);
-      break;
-    case VFTDC_CLOCK_HFBR1:
-      sprintf(sClock,"EXTERNAL-HFBR1 (%d)",source);
-      break;
-    case VFTDC_CLOCK_VXS:
-      sprintf(sClock,"EXTERNAL-VXS (%d)",source);
-      break;
-    default:
-      printf("%s: ERROR: Invalid Clock Souce (%d)\n",__FUNCTION__,source);
-      return ERROR;      
-    }
-
-  printf("%s: Setting clock source to %s\n",__FUNCTION__,sClock);
-
+  if(buf->order == VFTDC_ORDER_HOST)
+    return OK;
 
-  VLOCK;
-  vmeWrite32(&TDCp[id]->clock, source);
-  taskDelay(1);
+#ifndef VXWORKS
+  if(vfTDCSwapBuffer(buf->data, buf->data, buf->nwords) != OK)
+    return ERROR;
+#endif
+  buf->order = VFTDC_ORDER_HOST;
 
-    // Resets
-  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_CLK250);
-  taskDelay(1);
-  vmeWrite32(&TDCp[id]->reset,VFTDC_RESET_IODELAY);
-  taskDelay(1);
+  return OK;
+}
 
-  if(source==1) /* Turn on running mode for External Clock verification */
+/**
+ * @ingroup Decode
+ * @brief Convert a buffer to VME byte order, if it is not already
+ *
+ * @param buf Buffer, and its current byte order (VFTDC_ORDER_*)
+ *
+ * @return OK if successful, otherwise ERROR
+ */
+int
+vfTDCBufferToVME(struct vftdc_buffer_struct *buf)
+{
+  if(buf == NULL)
     {
-      vmeWrite32(&TDCp[id]->runningMode,VFTDC_RUNNINGMODE_ENABLE);
-      taskDelay(1);
-      clkread = vmeRead32(&TDCp[id]->clock) & VFTDC_CLOCK_MASK;
-      if(clkread != clkset)
-	{
-	  printf("%s: ERROR Setting Clock Source (clkset = 0x%x, clkread = 0x%x)\n",
-		 __FUNCTION__,source, clkread);
-	  rval = ERROR;
-	}
-      vmeWrite32(&TDCp[id]->runningMode,VFTDC_RUNNINGMODE_DISABLE);
+      printf("%s: ERROR: Invalid buffer\n",__FUNCTION__);
+      return ERROR;
     }
-  VUNLOCK;
 
-  return rval;
+  if(buf->order == VFTDC_ORDER_VME)
+    return OK;
+
+#ifndef VXWORKS
+  if(vfTDCSwapBuffer(buf->data, buf->data, buf->nwords) != OK)
+    return ERROR;
+#endif
+  buf->order = VFTDC_ORDER_VME;
+
+  return OK;
 }
 
 /**
- * @ingroup Status
- * @brief Get the current clock source
- * @param id Slot Number
- * @return Current Clock Source
+ * @ingroup Decode
+ * @brief Return the vfTDCDecode* flags for the byte order of a buffer
+ *
+ *   e.g. with the order from vfTDCReadBlockResult:
+ *     buf.order = result.order;
+ *     vfTDCDecodeBlock(buf.data, buf.nwords, vfTDCBufferDecodeFlag(&buf), hits, maxhits);
+ *
+ * @param buf Buffer, and its current byte order (VFTDC_ORDER_*)
+ *
+ * @return VFTDC_DECODE_SWAP if the words must be swapped, 0 if not,
+ *         otherwise ERROR
  */
 int
-vfTDCGetClockSource(int id)
+vfTDCBufferDecodeFlag(struct vftdc_buffer_struct *buf)
 {
-  int rval=0;
-  if(id==0) id=vfTDCID[0];
-
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(buf == NULL)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Invalid buffer\n",__FUNCTION__);
       return ERROR;
     }
 
-  VLOCK;
-  rval = vmeRead32(&TDCp[id]->clock) & VFTDC_CLOCK_MASK;
-  VUNLOCK;
-
-  return rval;
+#ifdef VXWORKS
+  /* VME order is the host order */
+  return 0;
+#else
+  return (buf->order == VFTDC_ORDER_VME) ? VFTDC_DECODE_SWAP : 0;
+#endif
 }
 
-/**
- * @ingroup Status
- * @brief Return geographic address as provided from a VME-64X crate.
- * @param id Slot Number
- * @return Geographic Address if successful, otherwise ERROR.
- */
+/*************************************************************
+ Library Data Decoding routines
+*************************************************************/
 
-int
-vfTDCGetGeoAddress(int id)
+#ifdef VXWORKS
+#define VFTDC_DECODE_WORD(_data,_dflag) (_data)
+#else
+#define VFTDC_DECODE_WORD(_data,_dflag)			\
+  (((_dflag)&VFTDC_DECODE_SWAP) ? LSWAP(_data) : (_data))
+#endif
+
+/* Decoder actions.  vfTDCDecodeAction[] is indexed by a 5-bit key:
+   for a data type defining word the key is its top five bits
+   (0x10 | data type); for a continuation word it is the current data
+   type.  The low four bits of the key are therefore always the data
+   type in effect after the word, and bit 4 is new_type. */
+#define VFTDC_DECODE_ACT_NONE      0
+#define VFTDC_DECODE_ACT_BLKHDR    1
+#define VFTDC_DECODE_ACT_BLKTLR    2
+#define VFTDC_DECODE_ACT_EVTHDR    3
+#define VFTDC_DECODE_ACT_TIME1     4
+#define VFTDC_DECODE_ACT_TIME2     5
+#define VFTDC_DECODE_ACT_HIT       6
+
+static const unsigned char vfTDCDecodeAction[32] =
+  {
+    /* Continuation words, by current data type */
+    VFTDC_DECODE_ACT_BLKHDR,	/*  0: Block header */
+    VFTDC_DECODE_ACT_BLKTLR,	/*  1: Block trailer */
+    VFTDC_DECODE_ACT_EVTHDR,	/*  2: Event header */
+    VFTDC_DECODE_ACT_TIME2,	/*  3: Trigger time, second word */
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_HIT,	/*  7: TDC hit */
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    /* Data type defining words */
+    VFTDC_DECODE_ACT_BLKHDR,	/*  0: Block header */
+    VFTDC_DECODE_ACT_BLKTLR,	/*  1: Block trailer */
+    VFTDC_DECODE_ACT_EVTHDR,	/*  2: Event header */
+    VFTDC_DECODE_ACT_TIME1,	/*  3: Trigger time, first word */
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_HIT,	/*  7: TDC hit */
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE,
+    VFTDC_DECODE_ACT_NONE,  VFTDC_DECODE_ACT_NONE
+  };
+
+/* Top five bits of a TDC hit data type defining word */
+#define VFTDC_DECODE_HIT_KEY_MASK  0xF8000000
+#define VFTDC_DECODE_HIT_KEY       0xB8000000
+
+/* Decode the words in data[start..end) (one block) into hits.
+   Returns the number of hits stored. */
+static int
+vfTDCDecodeRange(volatile unsigned int *data, int start, int end, int dflag,
+		 struct vftdc_data_struct *hits, int maxhits)
 {
-  int rval=0;
-  if(id==0) id=vfTDCID[0];
+  struct vftdc_data_struct cur;
+  unsigned int word, next, key;
+  int iword, nhits=0;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  memset((char *)&cur, 0, sizeof(cur));
+  cur.type = VFTDC_TYPE_FILLER;
+
+  for(iword=start; iword<end; iword++)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
+      word = VFTDC_DECODE_WORD(data[iword],dflag);
+
+      key = (word & VFTDC_DATA_TYPE_DEFINE) ? (word >> 27) : cur.type;
+      cur.new_type = key >> 4;
+      cur.type     = key & 0xF;
+
+      switch(vfTDCDecodeAction[key])
+	{
+	case VFTDC_DECODE_ACT_BLKHDR:
+	  /* Context does not carry over from the previous block */
+	  memset((char *)&cur, 0, sizeof(cur));
+	  cur.new_type   = 1;
+	  cur.type       = VFTDC_TYPE_BLOCK_HEADER;
+	  cur.slot_id_hd = (word & 0x7C00000) >> 22;
+	  cur.modID      = (word & 0x3C0000) >> 18;
+	  cur.blk_num    = (word & 0x3FF00) >> 8;
+	  cur.n_evts     = (word & 0xFF);
+	  break;
+
+	case VFTDC_DECODE_ACT_BLKTLR:
+	  cur.slot_id_tr = (word & 0x7C00000) >> 22;
+	  cur.n_words    = (word & 0x3FFFFF);
+	  break;
+
+	case VFTDC_DECODE_ACT_EVTHDR:
+	  cur.slot_id_evh = (word & 0x7C00000) >> 22;
+	  cur.evt_num_1   = (word & 0x3FFFFF);
+	  break;
+
+	case VFTDC_DECODE_ACT_TIME1:
+	  cur.time_1   = (word & 0x7FFFFFF);
+	  cur.time_now = 1;
+	  break;
+
+	case VFTDC_DECODE_ACT_TIME2:
+	  if(cur.time_now == 1)
+	    {
+	      cur.time_2   = (word & 0xFFFFFF);
+	      cur.time_now = 2;
+	    }
+	  break;
+
+	case VFTDC_DECODE_ACT_HIT:
+	  /* Stay here for the whole run of hit words (defining or
+	     continuation), so the common case does not go back through
+	     the dispatch */
+	  for(;;)
+	    {
+	      if(nhits >= maxhits)
+		return nhits;
+
+	      cur.group       = (word & 0x07000000) >> 24;
+	      cur.chan        = (word & 0x00f80000) >> 19;
+	      cur.edge_type   = (word & 0x00040000) >> 18;
+	      cur.time_coarse = (word & 0x0003ff00) >> 8;
+	      cur.two_ns      = (word & 0x00000080) >> 7;
+	      cur.time_fine   = (word & 0x0000007f);
+	      hits[nhits++] = cur;
+
+	      if(iword+1 >= end)
+		break;
+
+	      next = VFTDC_DECODE_WORD(data[iword+1],dflag);
+	      if((next & VFTDC_DATA_TYPE_DEFINE) &&
+		 ((next & VFTDC_DECODE_HIT_KEY_MASK) != VFTDC_DECODE_HIT_KEY))
+		break;
+
+	      cur.new_type = next >> 31;
+	      word = next;
+	      iword++;
+	    }
+	  break;
+
+	default:
+	  break;
+	}
     }
 
-  VLOCK;
-  rval = (vmeRead32(&TDCp[id]->boardID) & VFTDC_BOARDID_GEOADR_MASK)>>8;
-  VUNLOCK;
+  return nhits;
+}
+
+/**
+ *  @ingroup Decode
+ *  @brief Decode a vfTDC data buffer into an array of TDC hits, without printing.
+ *
+ *  Each hit carries the block and event context (slot, block number,
+ *  event number, trigger time) in which it was found.
+ *
+ *  @param data    Buffer of vfTDC data words
+ *  @param nwords  Number of words in data
+ *  @param dflag   Decode flag
+ * <pre>
+ *          VFTDC_DECODE_SWAP - words are in VME (big-endian) order and must be swapped
+ * </pre>
+ *  @param hits    Array to store decoded hits
+ *  @param maxhits Size of the hits array
+ *
+ *  @return Number of hits stored in hits, otherwise ERROR.
+ */
+int
+vfTDCDecodeBlock(volatile unsigned int *data, int nwords, int dflag,
+		 struct vftdc_data_struct *hits, int maxhits)
+{
+  if((data==NULL) || (hits==NULL) || (nwords<0) || (maxhits<0))
+    {
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
+      return ERROR;
+    }
 
-  return rval;
+  return vfTDCDecodeRange(data, 0, nwords, dflag, hits, maxhits);
 }
 
-#ifdef NOTYET
-/*************************************************************
- Library Interrupt/Polling routines
-*************************************************************/
+/* Allocation granularity of vftdc_arena_struct */
+#define VFTDC_ARENA_ALIGN 8
 
-/*******************************************************************************
+/**
+ *  @ingroup Decode
+ *  @brief Initialize an arena for vfTDCDecodeEvents on memory provided by the caller.
  *
- *  vfTDCInt
- *  - Default interrupt handler
- *    Handles the TI interrupt.  Calls a user defined routine,
- *    if it was connected with vfTDCIntConnect()
- *    
+ *  @param arena   Arena to initialize
+ *  @param mem     Memory to carve events and hits from
+ *  @param nbytes  Size of mem, in bytes
+ *
+ *  @return OK if successful, otherwise ERROR.
  */
-static void
-vfTDCInt(void)
+int
+vfTDCArenaInit(struct vftdc_arena_struct *arena, void *mem, unsigned int nbytes)
 {
-  vfTDCIntCount++;
-
-  INTLOCK;
+  unsigned int skip;
 
-  if (vfTDCIntRoutine != NULL)	/* call user routine */
-    (*vfTDCIntRoutine) (vfTDCIntArg);
+  if((arena==NULL) || (mem==NULL))
+    {
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
+      return ERROR;
+    }
 
-  /* Acknowledge trigger */
-  if(tiDoAck==1)
+  skip = (VFTDC_ARENA_ALIGN - ((unsigned long)mem & (VFTDC_ARENA_ALIGN-1)))
+    & (VFTDC_ARENA_ALIGN-1);
+  if(nbytes < skip + sizeof(struct vftdc_event_struct))
     {
-      vfTDCIntAck();
+      printf("%s: ERROR: Arena of %d bytes is too small\n",__FUNCTION__,nbytes);
+      return ERROR;
     }
-  INTUNLOCK;
 
+  arena->base = (char *)mem + skip;
+  arena->size = (nbytes - skip) & ~(VFTDC_ARENA_ALIGN-1);
+  vfTDCArenaReset(arena);
+
+  return OK;
 }
 
-/*******************************************************************************
- *
- *  tiPoll
- *  - Default Polling Server Thread
- *    Handles the polling of latched triggers.  Calls a user
- *    defined routine if was connected with vfTDCIntConnect.
+/**
+ *  @ingroup Decode
+ *  @brief Release all events and hits taken from an arena.
  *
+ *  @param arena   Arena to reset
  */
-#ifndef VXWORKS
-static void
-vfTDCPoll(void)
+void
+vfTDCArenaReset(struct vftdc_arena_struct *arena)
 {
-  int tdc_data;
-  int policy=0;
-  struct sched_param sp;
-/* #define DO_CPUAFFINITY */
-#ifdef DO_CPUAFFINITY
-  int j;
-  cpu_set_t testCPU;
+  if(arena==NULL)
+    return;
 
-  if (pthread_getaffinity_np(pthread_self(), sizeof(testCPU), &testCPU) <0) 
+  arena->lo = 0;
+  arena->hi = arena->size;
+}
+
+/**
+ *  @ingroup Decode
+ *  @brief Decode a vfTDC data buffer into events with compact hits, without printing.
+ *
+ *  Events and their hits are taken from the arena: the hits of each
+ *  event are a contiguous span of 8 byte vftdc_hit_struct, and the
+ *  events of the call are a contiguous array.  Nothing is freed
+ *  individually; call vfTDCArenaReset once the block has been
+ *  processed.  Hits found outside of an event are not stored.
+ *
+ *  @param data    Buffer of vfTDC data words
+ *  @param nwords  Number of words in data
+ *  @param dflag   Decode flag
+ * <pre>
+ *          VFTDC_DECODE_SWAP - words are in VME (big-endian) order and must be swapped
+ * </pre>
+ *  @param arena   Arena initialized with vfTDCArenaInit
+ *  @param events  Where to return the address of the event array
+ *
+ *  @return Number of events decoded, otherwise ERROR if the arena is full.
+ */
+int
+vfTDCDecodeEvents(volatile unsigned int *data, int nwords, int dflag,
+		  struct vftdc_arena_struct *arena,
+		  struct vftdc_event_struct **events)
+{
+  struct vftdc_event_struct *evt=NULL, *first, *last, tmp;
+  struct vftdc_hit_struct *hit;
+  unsigned int word, next, key, type=VFTDC_TYPE_FILLER;
+  unsigned int slot=0, blk_num=0, time_now=0;
+  int iword, nevents=0;
+
+  if((data==NULL) || (arena==NULL) || (arena->base==NULL) ||
+     (events==NULL) || (nwords<0))
     {
-      perror("pthread_getaffinity_np");
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
+      return ERROR;
     }
-  printf("%s: CPUset = ",__FUNCTION__);
-  for (j = 0; j < CPU_SETSIZE; j++)
-    if (CPU_ISSET(j, &testCPU))
-      printf(" %d", j);
-  printf("\n");
 
-  CPU_ZERO(&testCPU);
-  CPU_SET(7,&testCPU);
-  if (pthread_setaffinity_np(pthread_self(),sizeof(testCPU), &testCPU) <0) 
+  for(iword=0; iword<nwords; iword++)
     {
-      perror("pthread_setaffinity_np");
+      word = VFTDC_DECODE_WORD(data[iword],dflag);
+
+      key  = (word & VFTDC_DATA_TYPE_DEFINE) ? (word >> 27) : type;
+      type = key & 0xF;
+
+      switch(vfTDCDecodeAction[key])
+	{
+	case VFTDC_DECODE_ACT_BLKHDR:
+	  slot     = (word & 0x7C00000) >> 22;
+	  blk_num  = (word & 0x3FF00) >> 8;
+	  time_now = 0;
+	  evt      = NULL;
+	  break;
+
+	case VFTDC_DECODE_ACT_BLKTLR:
+	  evt = NULL;
+	  break;
+
+	case VFTDC_DECODE_ACT_EVTHDR:
+	  if(arena->hi - arena->lo < sizeof(struct vftdc_event_struct))
+	    goto full;
+
+	  arena->hi -= sizeof(struct vftdc_event_struct);
+	  evt = (struct vftdc_event_struct *)(arena->base + arena->hi);
+	  evt->slot    = slot;
+	  evt->blk_num = blk_num;
+	  evt->evt_num = (word & 0x3FFFFF);
+	  evt->time_1  = 0;
+	  evt->time_2  = 0;
+	  evt->nhits   = 0;
+	  evt->hits    = (struct vftdc_hit_struct *)(arena->base + arena->lo);
+	  time_now = 0;
+	  nevents++;
+	  break;
+
+	case VFTDC_DECODE_ACT_TIME1:
+	  if(evt)
+	    evt->time_1 = (word & 0x7FFFFFF);
+	  time_now = 1;
+	  break;
+
+	case VFTDC_DECODE_ACT_TIME2:
+	  if(time_now == 1)
+	    {
+	      if(evt)
+		evt->time_2 = (word & 0xFFFFFF);
+	      time_now = 2;
+	    }
+	  break;
+
+	case VFTDC_DECODE_ACT_HIT:
+	  if(evt == NULL)
+	    break;
+
+	  /* Same run-of-hits loop as vfTDCDecodeRange */
+	  for(;;)
+	    {
+	      if(arena->hi - arena->lo < sizeof(struct vftdc_hit_struct))
+		goto full;
+
+	      hit = (struct vftdc_hit_struct *)(arena->base + arena->lo);
+	      arena->lo += sizeof(struct vftdc_hit_struct);
+
+	      hit->slot = slot;
+	      hit->chan = (word & 0x07f80000) >> 19;
+	      hit->edge = (word & 0x00040000) >> 18;
+	      hit->rsvd = 0;
+	      hit->time = (word & 0x0003ffff);
+	      evt->nhits++;
+
+	      if(iword+1 >= nwords)
+		break;
+
+	      next = VFTDC_DECODE_WORD(data[iword+1],dflag);
+	      if((next & VFTDC_DATA_TYPE_DEFINE) &&
+		 ((next & VFTDC_DECODE_HIT_KEY_MASK) != VFTDC_DECODE_HIT_KEY))
+		break;
+
+	      word = next;
+	      iword++;
+	    }
+	  break;
+
+	default:
+	  break;
+	}
     }
-  if (pthread_getaffinity_np(pthread_self(), sizeof(testCPU), &testCPU) <0) 
+
+  /* Events were taken from the top of the arena, downwards.  Put them
+     back in data order. */
+  first = (struct vftdc_event_struct *)(arena->base + arena->hi);
+  last  = first + nevents - 1;
+  while(first < last)
     {
-      perror("pthread_getaffinity_np");
+      tmp = *first; *first++ = *last; *last-- = tmp;
     }
 
-  printf("%s: CPUset = ",__FUNCTION__);
-  for (j = 0; j < CPU_SETSIZE; j++)
-    if (CPU_ISSET(j, &testCPU))
-      printf(" %d", j);
+  *events = (struct vftdc_event_struct *)(arena->base + arena->hi);
+  return nevents;
 
-  printf("\n");
+ full:
+  printf("%s: ERROR: Arena full (%d bytes) at word %d of %d\n",
+	 __FUNCTION__,arena->size,iword,nwords);
+  return ERROR;
+}
 
+/*************************************************************
+ Software filtering of recorded hits.
 
-#endif
-  
-  /* Set scheduler and priority for this thread */
-  policy=SCHED_FIFO;
-  sp.sched_priority=40;
-  printf("%s: Entering polling loop...\n",__FUNCTION__);
-  pthread_setschedparam(pthread_self(),policy,&sp);
-  pthread_getschedparam(pthread_self(),&policy,&sp);
-  printf ("%s: INFO: Running at %s/%d\n",__FUNCTION__,
-	  (policy == SCHED_FIFO ? "FIFO"
-	   : (policy == SCHED_RR ? "RR"
-	      : (policy == SCHED_OTHER ? "OTHER"
-		 : "unknown"))), sp.sched_priority);  
-  prctl(PR_SET_NAME,"tiPoll");
+ Filters run on a buffer returned by vfTDCReadBlock and remove TDC hit
+ words in place.  vfTDCCompactHits walks the blocks, asks the filter
+ about each word inside a block, moves the kept words down, and
+ rewrites the trailer word count of each block, with a filler word when
+ needed to keep the block an even number of words.
+*************************************************************/
 
-  while(1) 
-    {
+/* Called by vfTDCCompactHits for every word inside a block, with the
+   data type in effect and the slot of the block header.  The return
+   value is only used for TDC hit words: 0 to remove the word. */
+typedef int (*VFTDCWORDFILTER) (unsigned int word, unsigned int type,
+				int slot, void *arg);
+
+/* Remove the hits rejected by filter from data[0..nwords).
+   Returns the new number of words. */
+static int
+vfTDCCompactHits(volatile unsigned int *data, int nwords, int dflag,
+		 VFTDCWORDFILTER filter, void *arg)
+{
+  unsigned int word, type=VFTDC_TYPE_FILLER, n;
+  int iword, out=0, bstart=0, slot=0, inblock=0, padded=0, nblocks=0;
 
-      pthread_testcancel();
+  for(iword=0; iword<nwords; iword++)
+    {
+      word = VFTDC_DECODE_WORD(data[iword],dflag);
+      if(word & VFTDC_DATA_TYPE_DEFINE)
+	type = (word & VFTDC_DATA_TYPE_MASK) >> 27;
 
-      /* If still need Ack, don't test the Trigger Status */
-      if(tiNeedAck>0) 
+      if(!inblock)
 	{
-	  continue;
-	}
+	  if((word & VFTDC_DATA_TYPE_DEFINE) && (type == VFTDC_TYPE_BLOCK_HEADER))
+	    {
+	      inblock = 1;
+	      bstart  = out;
+	      slot    = (word & 0x7C00000) >> 22;
+	      (*filter) (word, type, slot, arg);
+	    }
+	  else if((nblocks > 0) && (word & VFTDC_DATA_TYPE_DEFINE) &&
+		  (type == VFTDC_TYPE_FILLER))
+	    {
+	      /* Padding after a block: keep one if the block still needs it */
+	      if(padded)
+		continue;
+	      padded = 1;
+	    }
 
-      tdc_data = 0;
-	  
-      tdc_data = tiBReady();
-      if(tdc_data == ERROR) 
-	{
-	  printf("%s: ERROR: vfTDCIntPoll returned ERROR.\n",__FUNCTION__);
-	  break;
+	  data[out++] = data[iword];
+	  continue;
 	}
 
-      if(tdc_data && vfTDCIntRunning)
+      if((word & VFTDC_DATA_TYPE_DEFINE) && (type == VFTDC_TYPE_BLOCK_TRAILER))
 	{
-	  INTLOCK; 
-	  tiDaqCount = tdc_data;
-	  vfTDCIntCount++;
-
-	  if (vfTDCIntRoutine != NULL)	/* call user routine */
-	    (*vfTDCIntRoutine) (vfTDCIntArg);
-	
-	  /* Write to TI to Acknowledge Interrupt */	  
-	  if(tiDoAck==1) 
+	  n = out - bstart + 1;
+	  word = (word & ~0x3FFFFF) | n;
+	  data[out++] = VFTDC_DECODE_WORD(word,dflag);
+	  padded = !(n & 1);
+	  if(!padded && (out <= iword))
 	    {
-	      vfTDCIntAck();
+	      data[out++] = VFTDC_DECODE_WORD(VFTDC_DUMMY_DATA,dflag);
+	      padded = 1;
 	    }
-	  INTUNLOCK;
+	  inblock = 0;
+	  nblocks++;
+	  continue;
 	}
-    
+
+      if(((*filter) (word, type, slot, arg) == 0) &&
+	 (type == VFTDC_TYPE_TDC_HIT))
+	continue;
+
+      data[out++] = data[iword];
     }
-  printf("%s: Read ERROR: Exiting Thread\n",__FUNCTION__);
-  pthread_exit(0);
 
+  return out;
 }
-#endif 
 
+/* Software window, per slot and channel, in coarse time steps from the
+   start of the hardware window.  Hits in [lo, hi) are kept. */
+static int            vfTDCSoftWindowOn[VFTDC_MAX_SLOT+1];
+static unsigned short vfTDCSoftWindowLo[VFTDC_MAX_SLOT+1][VFTDC_HIST_NCHAN];
+static unsigned short vfTDCSoftWindowHi[VFTDC_MAX_SLOT+1][VFTDC_HIST_NCHAN];
 
-/*******************************************************************************
- *
- *  vfTDCStartPollingThread
- *  - Routine that launches tiPoll in its own thread 
- *
- */
-#ifndef VXWORKS
-static void
-vfTDCStartPollingThread(void)
+static int
+vfTDCSoftWindowFilter(unsigned int word, unsigned int type, int slot, void *arg)
 {
-  int pvfTDC_status;
+  unsigned int chan, coarse;
 
-  pvfTDC_status = 
-    pthread_create(&vfTDCpollthread,
-		   NULL,
-		   (void*(*)(void *)) vfTDCPoll,
-		   (void *)NULL);
-  if(pvfTDC_status!=0) 
-    {						
-      printf("%s: ERROR: vfTDC Polling Thread could not be started.\n",
-	     __FUNCTION__);	
-      printf("\t pthread_create returned: %d\n",pvfTDC_status);
-    }
+  if((type != VFTDC_TYPE_TDC_HIT) || (slot > VFTDC_MAX_SLOT) ||
+     !vfTDCSoftWindowOn[slot])
+    return 1;
+
+  chan = (word & 0x07f80000) >> 19;
+  if(chan >= VFTDC_HIST_NCHAN)
+    return 1;
 
+  coarse = (word & 0x3ff00) >> 8;
+  return (coarse >= vfTDCSoftWindowLo[slot][chan]) &&
+    (coarse < vfTDCSoftWindowHi[slot][chan]);
 }
-#endif
 
 /**
- * @ingroup IntPoll
- * @brief Connect a user routine to the TI Interrupt or
- *    latched trigger, if polling.
+ * @ingroup Config
+ * @brief Set the software trigger window of a channel
  *
- * @param vector VME Interrupt Vector
- * @param routine Routine to call if block is available
- * @param arg argument to pass to routine
+ *   Hits outside of the window are removed by vfTDCSoftWindowApply.
+ *   The window is relative to the trigger, like the hardware window:
+ *   the coarse time of a hit counts from the start of the hardware
+ *   window, latency steps before the trigger.  The latency is read
+ *   from the module here, so call this after vfTDCSetWindowParamters.
  *
- * @return OK if successful, otherwise ERROR
+ * @param id     Slot Number
+ * @param chan   Channel (group*32 + channel, 0-191), or -1 for all channels
+ * @param offset Start of the window from the trigger (steps of 4ns, negative before)
+ * @param width  Width of the window (steps of 4ns).  0 keeps all hits of the channel.
+ *
+ * @return OK if successful, ERROR otherwise
  */
 int
-vfTDCIntConnect(unsigned int vector, VOIDFUNCPTR routine, unsigned int arg)
+vfTDCSetSoftWindow(int id, int chan, int offset, int width)
 {
-#ifndef VXWORKS
-  int status;
-#endif
+  int pl, lo, hi, ichan;
 
   if(id==0) id=vfTDCID[0];
 
   if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
-      return ERROR;
-    }
-
-
-#ifdef VXWORKS
-  /* Disconnect any current interrupts */
-  if((intDisconnect(vfTDCIntVec) !=0))
-    printf("%s: Error disconnecting Interrupt\n",__FUNCTION__);
-#endif
-
-  vfTDCIntCount = 0;
-  vfTDCAckCount = 0;
-  vfTDCDoAck = 1;
-
-  /* Set Vector and Level */
-  if((vector < 0xFF)&&(vector > 0x40)) 
-    {
-      vfTDCIntVec = vector;
-    }
-  else
-    {
-      vfTDCIntVec = VFTDC_INT_VEC;
-    }
-
-  VLOCK;
-  vmeWrite32(&TDCp->intsetup, (vfTDCIntLevel<<8) | vfTDCIntVec );
-  VUNLOCK;
-
-  switch (tiReadoutMode)
-    {
-    case VFTDC_READOUT_TS_POLL:
-    case VFTDC_READOUT_EXT_POLL:
-      break;
-
-    case VFTDC_READOUT_TS_INT:
-    case VFTDC_READOUT_EXT_INT:
-#ifdef VXWORKS
-      intConnect(INUM_TO_IVEC(vfTDCIntVec),vfTDCInt,arg);
-#else
-      status = vmeIntConnect (vfTDCIntVec, vfTDCIntLevel,
-			      vfTDCInt,arg);
-      if (status != OK) 
-	{
-	  printf("%s: vmeIntConnect failed with status = 0x%08x\n",
-		 __FUNCTION__,status);
-	  return(ERROR);
-	}
-#endif  
-      break;
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
+      return ERROR;
+    }
 
-    default:
-      printf("%s: ERROR: TI Mode not defined (%d)\n",
-	     __FUNCTION__,tiReadoutMode);
+  if((chan < -1) || (chan >= VFTDC_HIST_NCHAN) || (width < 0))
+    {
+      printf("%s: ERROR: Invalid channel (%d) or width (%d)\n",
+	     __FUNCTION__,chan,width);
       return ERROR;
     }
 
-  printf("%s: INFO: Interrupt Vector = 0x%x  Level = %d\n",
-	 __FUNCTION__,vfTDCIntVec,vfTDCIntLevel);
+  VLOCK;
+  pl = vmeRead32(&TDCp[id]->pl) & VFTDC_PL_MASK;
+  VUNLOCK;
 
-  if(routine) 
+  if(width == 0)
     {
-      vfTDCIntRoutine = routine;
-      vfTDCIntArg = arg;
+      lo = 0;
+      hi = 0x400;
     }
   else
     {
-      vfTDCIntRoutine = NULL;
-      vfTDCIntArg = 0;
+      lo = pl + offset;
+      hi = lo + width;
+      if(lo < 0)     lo = 0;
+      if(hi > 0x400) hi = 0x400;
+      if(hi < lo)    hi = lo;
     }
 
-  return(OK);
+  for(ichan=0; ichan<VFTDC_HIST_NCHAN; ichan++)
+    {
+      if((chan != -1) && (ichan != chan))
+	continue;
+      vfTDCSoftWindowLo[id][ichan] = lo;
+      vfTDCSoftWindowHi[id][ichan] = hi;
+    }
+
+  if(!vfTDCSoftWindowOn[id])
+    {
+      /* Channels not set keep all of their hits */
+      for(ichan=0; ichan<VFTDC_HIST_NCHAN; ichan++)
+	{
+	  if((chan != -1) && (ichan != chan))
+	    {
+	      vfTDCSoftWindowLo[id][ichan] = 0;
+	      vfTDCSoftWindowHi[id][ichan] = 0x400;
+	    }
+	}
+      vfTDCSoftWindowOn[id] = 1;
+    }
 
+  return OK;
 }
 
 /**
- * @ingroup IntPoll
- * @brief Disable interrupts or kill the polling service thread
+ * @ingroup Config
+ * @brief Disable the software trigger window of a module
  *
+ * @param id     Slot Number
  *
- * @return OK if successful, otherwise ERROR
+ * @return OK if successful, ERROR otherwise
  */
 int
-vfTDCIntDisconnect()
+vfTDCDisableSoftWindow(int id)
 {
-#ifndef VXWORKS
-  int status;
-  void *res;
-#endif
-
   if(id==0) id=vfTDCID[0];
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if((id<=0) || (id>21))
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR : Invalid slot (%d)\n",__FUNCTION__,id);
       return ERROR;
     }
 
-  if(vfTDCIntRunning) 
+  vfTDCSoftWindowOn[id] = 0;
+
+  return OK;
+}
+
+/**
+ * @ingroup Readout
+ * @brief Remove the hits outside of the software trigger windows
+ *        (vfTDCSetSoftWindow) from a buffer, in place
+ *
+ *   The word count of each block trailer is corrected.
+ *
+ * @param data   Buffer returned by vfTDCReadBlock
+ * @param nwords Number of words in data
+ * @param dflag  Decode flag
+ * <pre>
+ *          VFTDC_DECODE_SWAP - words are in VME (big-endian) order
+ * </pre>
+ *
+ * @return Number of words left in data, otherwise ERROR.
+ */
+int
+vfTDCSoftWindowApply(volatile unsigned int *data, int nwords, int dflag)
+{
+  if((data==NULL) || (nwords<0))
     {
-      logMsg("vfTDCIntDisconnect: ERROR: vfTDC is Enabled - Call vfTDCIntDisable() first\n",
-	     1,2,3,4,5,6);
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
       return ERROR;
     }
 
-  INTLOCK;
+  return vfTDCCompactHits(data, nwords, dflag, vfTDCSoftWindowFilter, NULL);
+}
 
-  switch (tiReadoutMode) 
+/* Channel mask (1: hits removed) and hit multiplicity cap per event
+   (0: no cap), per slot and channel */
+static int            vfTDCFilterOn[VFTDC_MAX_SLOT+1];
+static unsigned int   vfTDCFilterMask[VFTDC_MAX_SLOT+1][VFTDC_CHANMASK_WORDS];
+static unsigned short vfTDCFilterCap[VFTDC_MAX_SLOT+1][VFTDC_HIST_NCHAN];
+static volatile unsigned int vfTDCFilterMasked[VFTDC_MAX_SLOT+1];
+static volatile unsigned int vfTDCFilterCapped[VFTDC_MAX_SLOT+1];
+
+/* Hits per channel in the current event.  A count is valid when its
+   stamp is the current event, so nothing is cleared per event. */
+struct vftdc_filter_state
+{
+  unsigned int   event;
+  unsigned int   stamp[VFTDC_HIST_NCHAN];
+  unsigned short count[VFTDC_HIST_NCHAN];
+  unsigned int   masked[VFTDC_MAX_SLOT+1];
+  unsigned int   capped[VFTDC_MAX_SLOT+1];
+};
+
+static int
+vfTDCChannelFilter(unsigned int word, unsigned int type, int slot, void *arg)
+{
+  struct vftdc_filter_state *st = (struct vftdc_filter_state *)arg;
+  unsigned int chan;
+
+  if(type != VFTDC_TYPE_TDC_HIT)
     {
-    case VFTDC_READOUT_TS_INT:
-    case VFTDC_READOUT_EXT_INT:
+      if((type == VFTDC_TYPE_EVENT_HEADER) && (word & VFTDC_DATA_TYPE_DEFINE))
+	st->event++;
+      return 1;
+    }
 
-#ifdef VXWORKS
-      /* Disconnect any current interrupts */
-      sysIntDisable(vfTDCIntLevel);
-      if((intDisconnect(vfTDCIntVec) !=0))
-	printf("%s: Error disconnecting Interrupt\n",__FUNCTION__);
-#else
-      status = vmeIntDisconnect(vfTDCIntLevel);
-      if (status != OK) 
+  if((slot > VFTDC_MAX_SLOT) || !vfTDCFilterOn[slot])
+    return 1;
+
+  chan = (word & 0x07f80000) >> 19;
+  if(chan >= VFTDC_HIST_NCHAN)
+    return 1;
+
+  if(vfTDCFilterMask[slot][chan>>5] & (1<<(chan & 0x1F)))
+    {
+      st->masked[slot]++;
+      return 0;
+    }
+
+  if(vfTDCFilterCap[slot][chan])
+    {
+      if(st->stamp[chan] != st->event)
 	{
-	  printf("vmeIntDisconnect failed\n");
+	  st->stamp[chan] = st->event;
+	  st->count[chan] = 0;
 	}
-#endif
-      break;
-
-    case VFTDC_READOUT_TS_POLL:
-    case VFTDC_READOUT_EXT_POLL:
-#ifndef VXWORKS
-      if(vfTDCpollthread) 
+      if(st->count[chan] >= vfTDCFilterCap[slot][chan])
 	{
-	  if(pthread_cancel(vfTDCpollthread)<0) 
-	    perror("pthread_cancel");
-	  if(pthread_join(vfTDCpollthread,&res)<0)
-	    perror("pthread_join");
-	  if (res == PTHREAD_CANCELED)
-	    printf("%s: Polling thread canceled\n",__FUNCTION__);
-	  else
-	    printf("%s: ERROR: Polling thread NOT canceled\n",__FUNCTION__);
+	  st->capped[slot]++;
+	  return 0;
 	}
-#endif
-      break;
-    default:
-      break;
+      st->count[chan]++;
     }
 
-  INTUNLOCK;
-
-  printf("%s: Disconnected\n",__FUNCTION__);
-
-  return OK;
-  
+  return 1;
 }
 
 /**
- * @ingroup IntPoll
- * @brief Connect a user routine to be executed instead of the default 
- *  TI interrupt/trigger latching acknowledge prescription
+ * @ingroup Config
+ * @brief Set the channels whose hits are removed by vfTDCFilterApply
  *
- * @param routine Routine to call 
- * @param arg argument to pass to routine
- * @return OK if successful, otherwise ERROR
+ * @param id   Slot Number
+ * @param mask VFTDC_CHANMASK_WORDS words, bit (chan%32) of word (chan/32)
+ *             set to remove the hits of channel chan (group*32 + channel).
+ *             NULL to clear the mask.
+ *
+ * @return OK if successful, ERROR otherwise
  */
 int
-vfTDCAckConnect(VOIDFUNCPTR routine, unsigned int arg)
+vfTDCSetChannelMask(int id, unsigned int *mask)
 {
-  if(routine)
-    {
-      vfTDCAckRoutine = routine;
-      vfTDCAckArg = arg;
-    }
-  else
+  int iword;
+
+  if(id==0) id=vfTDCID[0];
+
+  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
     {
-      printf("%s: WARN: routine undefined.\n",__FUNCTION__);
-      vfTDCAckRoutine = NULL;
-      vfTDCAckArg = 0;
+      printf("%s: ERROR : TDC in slot %d is not initialized \n",
+	     __FUNCTION__,id);
       return ERROR;
     }
+
+  for(iword=0; iword<VFTDC_CHANMASK_WORDS; iword++)
+    vfTDCFilterMask[id][iword] = (mask) ? mask[iword] : 0;
+  vfTDCFilterOn[id] = 1;
+
   return OK;
 }
 
 /**
- * @ingroup IntPoll
- * @brief Acknowledge an interrupt or latched trigger.  This "should" effectively 
- *  release the "Busy" state of the TI.
+ * @ingroup Config
+ * @brief Set the maximum number of hits per event kept by vfTDCFilterApply
+ *        for a channel
  *
- *  Execute a user defined routine, if it is defined.  Otherwise, use
- *  a default prescription.
+ * @param id      Slot Number
+ * @param chan    Channel (group*32 + channel, 0-191), or -1 for all channels
+ * @param maxhits Maximum number of hits (0: no maximum)
+ *
+ * @return OK if successful, ERROR otherwise
  */
-void
-vfTDCIntAck()
+int
+vfTDCSetMultiplicityCap(int id, int chan, int maxhits)
 {
-  int resetbits=0;
+  int ichan;
+
   if(id==0) id=vfTDCID[0];
 
   if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
@@ -2353,300 +7857,561 @@ vfTDCIntAck()
       return ERROR;
     }
 
-  if (vfTDCAckRoutine != NULL)
+  if((chan < -1) || (chan >= VFTDC_HIST_NCHAN) ||
+     (maxhits < 0) || (maxhits > 0xFFFF))
     {
-      /* Execute user defined Acknowlege, if it was defined */
-      VLOCK;
-      (*vfTDCAckRoutine) (vfTDCAckArg);
-      VUNLOCK;
+      printf("%s: ERROR: Invalid channel (%d) or maxhits (%d)\n",
+	     __FUNCTION__,chan,maxhits);
+      return ERROR;
     }
-  else
+
+  for(ichan=0; ichan<VFTDC_HIST_NCHAN; ichan++)
     {
-      VLOCK;
-      vfTDCDoAck = 1;
-      vfTDCAckCount++;
-      resetbits = VFTDC_RESET_BUSYACK;
+      if((chan == -1) || (ichan == chan))
+	vfTDCFilterCap[id][ichan] = maxhits;
+    }
+  vfTDCFilterOn[id] = 1;
 
-      if(!vfTDCReadoutEnabled)
-	{
-	  /* Readout Acknowledge and decrease the number of available blocks by 1 */
-	  resetbits |= VFTDC_RESET_BLOCK_READOUT;
-	}
-      
-      vmeWrite32(&TDCp->reset, resetbits);
+  return OK;
+}
 
-      VUNLOCK;
+/**
+ * @ingroup Readout
+ * @brief Remove the hits of masked channels (vfTDCSetChannelMask) and
+ *        the hits over the multiplicity cap (vfTDCSetMultiplicityCap)
+ *        from a buffer, in place
+ *
+ *   The word count of each block trailer is corrected.
+ *
+ * @param data   Buffer returned by vfTDCReadBlock
+ * @param nwords Number of words in data
+ * @param dflag  Decode flag
+ * <pre>
+ *          VFTDC_DECODE_SWAP - words are in VME (big-endian) order
+ * </pre>
+ *
+ * @return Number of words left in data, otherwise ERROR.
+ */
+int
+vfTDCFilterApply(volatile unsigned int *data, int nwords, int dflag)
+{
+  struct vftdc_filter_state st;
+  int rval, slot;
+
+  if((data==NULL) || (nwords<0))
+    {
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
+      return ERROR;
     }
 
+  memset(&st, 0, sizeof(st));
+  st.event = 1;
+
+  rval = vfTDCCompactHits(data, nwords, dflag, vfTDCChannelFilter, &st);
+
+  for(slot=1; slot<=VFTDC_MAX_SLOT; slot++)
+    {
+      if(st.masked[slot])
+	VFTDC_ATOMIC_ADD(&vfTDCFilterMasked[slot], st.masked[slot]);
+      if(st.capped[slot])
+	VFTDC_ATOMIC_ADD(&vfTDCFilterCapped[slot], st.capped[slot]);
+    }
+
+  return rval;
 }
 
 /**
- * @ingroup IntPoll
- * @brief Enable interrupts or latching triggers (depending on set TI mode)
- *  
- * @param iflag if = 1, trigger counter will be reset
+ * @ingroup Status
+ * @brief Return the number of hits removed by vfTDCFilterApply for a module
  *
- * @return OK if successful, otherwise ERROR
+ * @param id     Slot Number
+ * @param masked Where to return the hits removed by the channel mask (may be NULL)
+ * @param capped Where to return the hits removed by the multiplicity cap (may be NULL)
+ *
+ * @return OK if successful, ERROR otherwise
  */
 int
-vfTDCIntEnable(int iflag)
+vfTDCGetFilterCounts(int id, unsigned int *masked, unsigned int *capped)
 {
-#ifdef VXWORKS
-  int lock_key=0;
-#endif
-
   if(id==0) id=vfTDCID[0];
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if((id<=0) || (id>21))
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR : Invalid slot (%d)\n",__FUNCTION__,id);
       return ERROR;
     }
 
-  VLOCK;
-  if(iflag == 1)
-    {
-      vfTDCIntCount = 0;
-      vfTDCAckCount = 0;
+  if(masked)
+    *masked = vfTDCFilterMasked[id];
+  if(capped)
+    *capped = vfTDCFilterCapped[id];
+
+  return OK;
+}
+
+#ifndef VXWORKS
+/*************************************************************
+ Parallel decoding, with block-granular work stealing.
+
+ The buffer is cut at block header words.  Each worker first scans
+ its own slice of the buffer for block headers.  The resulting
+ (ordered) block list is then dealt out as contiguous ranges, one per
+ worker.  A worker pops blocks from the front of its own range, and
+ when empty, steals the back half of another worker's range.  Hits
+ are decoded into per-worker output, then copied to their final
+ position in block order.
+*************************************************************/
+
+struct vftdc_decode_worker
+{
+  int                        id;
+  struct vftdc_decode_job   *job;
+  /* Block headers found in this worker's slice */
+  int                       *starts;
+  int                        nstarts;
+  /* Decoded hits, in the order this worker decoded its blocks */
+  struct vftdc_data_struct  *hits;
+  int                        nhits;
+  int                        maxhits;
+  /* Remaining block range [top,bottom), packed as (top<<32)|bottom */
+  volatile unsigned long long range;
+};
+
+struct vftdc_decode_job
+{
+  volatile unsigned int     *data;
+  int                        nwords;
+  int                        dflag;
+  int                        nthreads;
+  /* Workers wait for go, once the number of started threads is known */
+  pthread_mutex_t            golock;
+  pthread_cond_t             gocond;
+  int                        go;
+  pthread_barrier_t          barrier;
+  struct vftdc_decode_worker worker[VFTDC_DECODE_MAX_THREADS];
+  /* Global list of block start words, in buffer order */
+  int                       *blkstart;
+  int                        nblocks;
+  /* Per block: decoding worker, offset into its hits, hit count, output position */
+  int                       *blkowner;
+  int                       *blkoffset;
+  int                       *blkcount;
+  int                       *blkpos;
+  struct vftdc_data_struct  *out;
+  int                        nout;
+  int                        err;
+};
+
+#define VFTDC_IS_BLOCK_HEADER(_word)					\
+  (((_word) & (VFTDC_DATA_TYPE_DEFINE|VFTDC_DATA_TYPE_MASK)) ==		\
+   (VFTDC_DATA_TYPE_DEFINE|VFTDC_DATA_BLOCK_HEADER))
+
+#define VFTDC_RANGE_PACK(_top,_bottom)					\
+  ((((unsigned long long)(unsigned int)(_top))<<32) | (unsigned int)(_bottom))
+#define VFTDC_RANGE_TOP(_range)    ((int)((_range)>>32))
+#define VFTDC_RANGE_BOTTOM(_range) ((int)((_range)&0xFFFFFFFF))
+
+/* Take the next block from the front of this worker's own range */
+static int
+vfTDCDecodePop(struct vftdc_decode_worker *w)
+{
+  unsigned long long old;
+  int top, bottom;
+
+  while(1)
+    {
+      old    = w->range;
+      top    = VFTDC_RANGE_TOP(old);
+      bottom = VFTDC_RANGE_BOTTOM(old);
+      if(top >= bottom)
+	return -1;
+      if(VFTDC_ATOMIC_CAS(&w->range, old,
+			  VFTDC_RANGE_PACK(top+1, bottom)))
+	return top;
+    }
+}
+
+/* Steal the back half of another worker's range into this worker's range */
+static int
+vfTDCDecodeSteal(struct vftdc_decode_worker *w)
+{
+  struct vftdc_decode_job *job = w->job;
+  struct vftdc_decode_worker *victim;
+  unsigned long long old;
+  int ivictim, top, bottom, nsteal;
+
+  for(ivictim=1; ivictim<job->nthreads; ivictim++)
+    {
+      victim = &job->worker[(w->id + ivictim) % job->nthreads];
+      while(1)
+	{
+	  old    = victim->range;
+	  top    = VFTDC_RANGE_TOP(old);
+	  bottom = VFTDC_RANGE_BOTTOM(old);
+	  if(top >= bottom)
+	    break;
+
+	  nsteal = (bottom - top + 1)/2;
+	  if(VFTDC_ATOMIC_CAS(&victim->range, old,
+			      VFTDC_RANGE_PACK(top, bottom-nsteal)))
+	    {
+	      /* Own range is empty, so only thieves can be looking at it */
+	      old = w->range;
+	      VFTDC_ATOMIC_CAS(&w->range, old,
+			       VFTDC_RANGE_PACK(bottom-nsteal, bottom));
+	      return OK;
+	    }
+	}
+    }
+
+  return ERROR;
+}
+
+static void *
+vfTDCDecodeWorker(void *arg)
+{
+  struct vftdc_decode_worker *w = (struct vftdc_decode_worker *)arg;
+  struct vftdc_decode_job *job = w->job;
+  struct vftdc_data_struct *newhits;
+  int slice, first, last, iword, iblk, ithr;
+  int bstart, bend, need, nblk, total, lead;
+  unsigned int word;
+
+  pthread_mutex_lock(&job->golock);
+  while(!job->go)
+    pthread_cond_wait(&job->gocond, &job->golock);
+  pthread_mutex_unlock(&job->golock);
+
+  /* Phase 1: find the block headers in this worker's slice */
+  slice = (job->nwords + job->nthreads - 1) / job->nthreads;
+  first = w->id * slice;
+  last  = first + slice;
+  if(last > job->nwords) last = job->nwords;
+
+  w->nstarts = 0;
+  w->starts  = NULL;
+  if(first < last)
+    {
+      /* Count, then store, so the list is sized by the number of headers */
+      nblk = 0;
+      for(iword=first; iword<last; iword++)
+	{
+	  word = VFTDC_DECODE_WORD(job->data[iword],job->dflag);
+	  if(VFTDC_IS_BLOCK_HEADER(word))
+	    nblk++;
+	}
+
+      if(nblk > 0)
+	{
+	  w->starts = (int *)malloc(nblk * sizeof(int));
+	  if(w->starts == NULL)
+	    job->err = 1;
+	  else
+	    {
+	      for(iword=first; (iword<last) && (w->nstarts<nblk); iword++)
+		{
+		  word = VFTDC_DECODE_WORD(job->data[iword],job->dflag);
+		  if(VFTDC_IS_BLOCK_HEADER(word))
+		    w->starts[w->nstarts++] = iword;
+		}
+	    }
+	}
+    }
+
+  pthread_barrier_wait(&job->barrier);
+
+  /* Phase 2 (worker 0): merge the block lists and deal out ranges */
+  if(w->id == 0)
+    {
+      total = 0;
+      for(ithr=0; ithr<job->nthreads; ithr++)
+	total += job->worker[ithr].nstarts;
+
+      /* Words before the first block header are decoded as a block of
+	 their own, as vfTDCDecodeBlock would */
+      lead = (job->nwords > 0) &&
+	((total == 0) || (job->worker[0].nstarts == 0) ||
+	 (job->worker[0].starts[0] != 0));
+
+      job->nblocks   = 0;
+      job->blkstart  = (int *)malloc((total+lead+1) * sizeof(int));
+      job->blkowner  = (int *)malloc((total+lead+1) * sizeof(int));
+      job->blkoffset = (int *)malloc((total+lead+1) * sizeof(int));
+      job->blkcount  = (int *)malloc((total+lead+1) * sizeof(int));
+      job->blkpos    = (int *)malloc((total+lead+1) * sizeof(int));
+      if(!job->blkstart || !job->blkowner || !job->blkoffset ||
+	 !job->blkcount || !job->blkpos)
+	job->err = 1;
+
+      if(!job->err)
+	{
+	  if(lead)
+	    job->blkstart[job->nblocks++] = 0;
+	  for(ithr=0; ithr<job->nthreads; ithr++)
+	    {
+	      memcpy(&job->blkstart[job->nblocks], job->worker[ithr].starts,
+		     job->worker[ithr].nstarts * sizeof(int));
+	      job->nblocks += job->worker[ithr].nstarts;
+	    }
+	  job->blkstart[job->nblocks] = job->nwords;
+	}
+
+      nblk = job->err ? 0 : job->nblocks;
+      for(ithr=0; ithr<job->nthreads; ithr++)
+	job->worker[ithr].range =
+	  VFTDC_RANGE_PACK((nblk*ithr)/job->nthreads,
+			   (nblk*(ithr+1))/job->nthreads);
+      VFTDC_BARRIER();
     }
 
-  vfTDCIntRunning = 1;
-  vfTDCDoAck      = 1;
-  vfTDCNeedAck    = 0;
+  pthread_barrier_wait(&job->barrier);
 
-  switch (vfTDCReadoutMode)
+  /* Phase 3: decode own blocks, then steal */
+  while(!job->err)
     {
-    case VFTDC_READOUT_TS_POLL:
-    case VFTDC_READOUT_EXT_POLL:
-#ifndef VXWORKS
-      vfTDCStartPollingThread();
-#endif
-      break;
+      iblk = vfTDCDecodePop(w);
+      if(iblk < 0)
+	{
+	  if(vfTDCDecodeSteal(w) != OK)
+	    break;
+	  continue;
+	}
 
-    case VFTDC_READOUT_TS_INT:
-    case VFTDC_READOUT_EXT_INT:
-#ifdef VXWORKS
-      lock_key = intLock();
-      sysIntEnable(vfTDCIntLevel);
-#endif
-      printf("%s: ******* ENABLE INTERRUPTS *******\n",__FUNCTION__);
-      vmeWrite32(&TDCp->intsetup,
-	       vmeRead32(&TDCp->intsetup) | VFTDC_INTSETUP_ENABLE );
-      break;
+      bstart = job->blkstart[iblk];
+      bend   = job->blkstart[iblk+1];
 
-    default:
-      vfTDCIntRunning = 0;
-#ifdef VXWORKS
-      if(lock_key)
-	intUnlock(lock_key);
-#endif
-      printf("%s: ERROR: vfTDC Readout Mode not defined %d\n",
-	     __FUNCTION__,tiReadoutMode);
-      VUNLOCK;
-      return(ERROR);
-      
+      /* A block cannot hold more hits than words */
+      need = w->nhits + (bend - bstart);
+      if(need > w->maxhits)
+	{
+	  if(need < 2*w->maxhits) need = 2*w->maxhits;
+	  newhits = (struct vftdc_data_struct *)
+	    realloc(w->hits, need * sizeof(struct vftdc_data_struct));
+	  if(newhits == NULL)
+	    {
+	      job->err = 1;
+	      break;
+	    }
+	  w->hits    = newhits;
+	  w->maxhits = need;
+	}
+
+      job->blkowner[iblk]  = w->id;
+      job->blkoffset[iblk] = w->nhits;
+      job->blkcount[iblk]  = vfTDCDecodeRange(job->data, bstart, bend, job->dflag,
+					      &w->hits[w->nhits],
+					      w->maxhits - w->nhits);
+      w->nhits += job->blkcount[iblk];
     }
 
-  vmeWrite32(&TDCp->runningMode,0x71);
-  VUNLOCK; /* Locks performed in tiEnableTriggerSource() */
+  pthread_barrier_wait(&job->barrier);
 
-  taskDelay(30);
-  vfTDCEnableTriggerSource();
+  /* Phase 4 (worker 0): output positions in block order */
+  if(w->id == 0 && !job->err)
+    {
+      job->nout = 0;
+      for(iblk=0; iblk<job->nblocks; iblk++)
+	{
+	  job->blkpos[iblk] = job->nout;
+	  job->nout += job->blkcount[iblk];
+	}
+      job->out = (struct vftdc_data_struct *)
+	malloc((job->nout ? job->nout : 1) * sizeof(struct vftdc_data_struct));
+      if(job->out == NULL)
+	job->err = 1;
+    }
 
-#ifdef VXWORKS
-  if(lock_key)
-    intUnlock(lock_key);
-#endif
+  pthread_barrier_wait(&job->barrier);
 
-  return(OK);
+  /* Phase 5: copy the blocks this worker decoded into place */
+  if(!job->err)
+    {
+      for(iblk=0; iblk<job->nblocks; iblk++)
+	{
+	  if(job->blkowner[iblk] != w->id)
+	    continue;
+	  memcpy(&job->out[job->blkpos[iblk]], &w->hits[job->blkoffset[iblk]],
+		 job->blkcount[iblk] * sizeof(struct vftdc_data_struct));
+	}
+    }
 
+  return NULL;
 }
 
 /**
- * @ingroup IntPoll
- * @brief Disable interrupts or latching triggers
+ *  @ingroup Decode
+ *  @brief Decode a large buffer of vfTDC blocks using multiple threads.
  *
-*/
-void 
-vfTDCIntDisable()
+ *  The buffer is split at block header words and blocks are distributed
+ *  over a work-stealing set of threads.  Hits are returned in block order,
+ *  identical to what vfTDCDecodeBlock would return for the whole buffer.
+ *
+ *  @param data     Buffer of vfTDC data words
+ *  @param nwords   Number of words in data
+ *  @param dflag    Decode flag (see vfTDCDecodeBlock)
+ *  @param nthreads Number of threads to use (<=0: number of online CPUs)
+ *  @param hits     Returned array of decoded hits.  Must be free()'d by the caller.
+ *
+ *  @return Number of hits in *hits, otherwise ERROR.
+ */
+int
+vfTDCDecodeParallel(volatile unsigned int *data, int nwords, int dflag,
+		    int nthreads, struct vftdc_data_struct **hits)
 {
+  struct vftdc_decode_job *job;
+  pthread_t tid[VFTDC_DECODE_MAX_THREADS];
+  int ithr, nstarted, rval;
 
-  if(id==0) id=vfTDCID[0];
+  if((data==NULL) || (hits==NULL) || (nwords<0))
+    {
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
+      return ERROR;
+    }
+  *hits = NULL;
 
-  if((id<=0) || (id>21) || (TDCp[id] == NULL)) 
+  if(nthreads <= 0)
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(nthreads <= 0)
+    nthreads = 1;
+  if(nthreads > VFTDC_DECODE_MAX_THREADS)
+    nthreads = VFTDC_DECODE_MAX_THREADS;
+
+  job = (struct vftdc_decode_job *)calloc(1, sizeof(struct vftdc_decode_job));
+  if(job == NULL)
     {
-      printf("%s: ERROR : TDC in slot %d is not initialized \n",
-	     __FUNCTION__,id);
+      printf("%s: ERROR: Unable to allocate memory\n",__FUNCTION__);
       return ERROR;
     }
 
-  vfTDCDisableTriggerSource(1);
+  job->data     = data;
+  job->nwords   = nwords;
+  job->dflag    = dflag;
+  job->nthreads = nthreads;
+  pthread_mutex_init(&job->golock, NULL);
+  pthread_cond_init(&job->gocond, NULL);
 
-  VLOCK;
-  vmeWrite32(&TDCp->intsetup,
-	     vmeRead32(&TDCp->intsetup) & ~(VFTDC_INTSETUP_ENABLE));
-  vmeWrite32(&TDCp->runningMode,0x0);
-  vfTDCIntRunning = 0;
-  VUNLOCK;
-}
+  for(ithr=0; ithr<nthreads; ithr++)
+    {
+      job->worker[ithr].id  = ithr;
+      job->worker[ithr].job = job;
+    }
 
-/**
- * @ingroup Status
- * @brief Return current readout count
- */
-unsigned int
-vfTDCGetIntCount()
-{
-  unsigned int rval=0;
+  for(nstarted=1; nstarted<nthreads; nstarted++)
+    {
+      if(pthread_create(&tid[nstarted], NULL, vfTDCDecodeWorker,
+			&job->worker[nstarted]) != 0)
+	break;
+    }
 
-  VLOCK;
-  rval = vfTDCIntCount;
-  VUNLOCK;
+  /* Run with the workers that could be started */
+  if(nstarted < nthreads)
+    printf("%s: WARN: Only %d of %d decode threads started\n",
+	   __FUNCTION__,nstarted,nthreads);
 
-  return(rval);
-}
+  pthread_mutex_lock(&job->golock);
+  job->nthreads = nthreads = nstarted;
+  pthread_barrier_init(&job->barrier, NULL, nthreads);
+  job->go = 1;
+  pthread_cond_broadcast(&job->gocond);
+  pthread_mutex_unlock(&job->golock);
 
-/**
- * @ingroup Status
- * @brief Return current acknowledge count
- */
-unsigned int
-vfTDCGetAckCount()
-{
-  unsigned int rval=0;
+  vfTDCDecodeWorker(&job->worker[0]);
 
-  VLOCK;
-  rval = vfTDCAckCount;
-  VUNLOCK;
+  for(ithr=1; ithr<nthreads; ithr++)
+    pthread_join(tid[ithr], NULL);
 
-  return(rval);
+  if(job->err)
+    {
+      printf("%s: ERROR: Unable to allocate memory\n",__FUNCTION__);
+      if(job->out) free(job->out);
+      rval = ERROR;
+    }
+  else
+    {
+      *hits = job->out;
+      rval  = job->nout;
+    }
+
+  for(ithr=0; ithr<nthreads; ithr++)
+    {
+      if(job->worker[ithr].starts) free(job->worker[ithr].starts);
+      if(job->worker[ithr].hits)   free(job->worker[ithr].hits);
+    }
+  if(job->blkstart)  free(job->blkstart);
+  if(job->blkowner)  free(job->blkowner);
+  if(job->blkoffset) free(job->blkoffset);
+  if(job->blkcount)  free(job->blkcount);
+  if(job->blkpos)    free(job->blkpos);
+  pthread_barrier_destroy(&job->barrier);
+  pthread_cond_destroy(&job->gocond);
+  pthread_mutex_destroy(&job->golock);
+  free(job);
+
+  return rval;
 }
-#endif /* NOTYET */
 
 /**
- *  @ingroup Status
- *  @brief Decode a data word from an vfTDC and print to standard out.
- *  @param data 32bit vfTDC data word
+ *  @ingroup Decode
+ *  @brief Decode a file of raw vfTDC data words using multiple threads.
+ *
+ *  @param filename File containing raw vfTDC data words
+ *  @param dflag    Decode flag (see vfTDCDecodeBlock)
+ *  @param nthreads Number of threads to use (<=0: number of online CPUs)
+ *  @param hits     Returned array of decoded hits.  Must be free()'d by the caller.
+ *
+ *  @return Number of hits in *hits, otherwise ERROR.
+ *  @sa vfTDCDecodeParallel
  */
-
-struct vftdc_data_struct vftdc_data;
-
-void 
-vfTDCDataDecode(unsigned int data)
+int
+vfTDCDecodeFileParallel(const char *filename, int dflag, int nthreads,
+			struct vftdc_data_struct **hits)
 {
-  int i_print = 1;
-  static unsigned int type_last = 15;	/* initialize to type FILLER WORD */
-  static unsigned int time_last = 0;
+  struct stat st;
+  void *map;
+  int fd, rval;
 
-  if( data & 0x80000000 )		/* data type defining word */
+  if((filename==NULL) || (hits==NULL))
     {
-      vftdc_data.new_type = 1;
-      vftdc_data.type = (data & 0x78000000) >> 27;
+      printf("%s: ERROR: Invalid arguments\n",__FUNCTION__);
+      return ERROR;
     }
-  else
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0)
     {
-      vftdc_data.new_type = 0;
-      vftdc_data.type = type_last;
+      perror("open");
+      return ERROR;
     }
-        
-  switch( vftdc_data.type )
-    {
-    case 0:		/* BLOCK HEADER */
-      vftdc_data.slot_id_hd = ((data) & 0x7C00000) >> 22;
-      vftdc_data.modID      = (data & 0x3C0000)>>18;
-      vftdc_data.blk_num    = (data & 0x3FF00) >> 8;
-      vftdc_data.n_evts     = (data & 0xFF);
-      if( i_print ) 
-	printf("%8X - BLOCK HEADER - slot = %d  modID = %d   n_evts = %d   n_blk = %d\n",
-	       data, vftdc_data.slot_id_hd, 
-	       vftdc_data.modID, vftdc_data.n_evts, vftdc_data.blk_num);
-      break;
 
-    case 1:		/* BLOCK TRAILER */
-      vftdc_data.slot_id_tr = (data & 0x7C00000) >> 22;
-      vftdc_data.n_words = (data & 0x3FFFFF);
-      if( i_print ) 
-	printf("%8X - BLOCK TRAILER - slot = %d   n_words = %d\n",
-	       data, vftdc_data.slot_id_tr, vftdc_data.n_words);
-      break;
+  if(fstat(fd, &st) < 0)
+    {
+      perror("fstat");
+      close(fd);
+      return ERROR;
+    }
 
-    case 2:		/* EVENT HEADER */
-      vftdc_data.slot_id_evh = (data & 0x7C00000) >> 22;
-      vftdc_data.evt_num_1 = (data & 0x3FFFFF);
-      if( i_print ) 
-	printf("%8X - EVENT HEADER - slot = %d   evt_num = %d\n", data, 
-	       vftdc_data.slot_id_evh, vftdc_data.evt_num_1);
-      break;
+  if(st.st_size < (off_t)sizeof(unsigned int))
+    {
+      close(fd);
+      *hits = NULL;
+      return 0;
+    }
 
-    case 3:		/* TRIGGER TIME */
-      if( vftdc_data.new_type )
-	{
-	  vftdc_data.time_1 = (data & 0x7FFFFFF);
-	  if( i_print ) 
-	    printf("%8X - TRIGGER TIME 1 - time = %08x\n", data, vftdc_data.time_1);
-	  vftdc_data.time_now = 1;
-	  time_last = 1;
-	}    
-      else
-	{
-	  if( time_last == 1 )
-	    {
-	      vftdc_data.time_2 = (data & 0xFFFFFF);
-	      if( i_print ) 
-		printf("%8X - TRIGGER TIME 2 - time = %08x\n", data, vftdc_data.time_2);
-	      vftdc_data.time_now = 2;
-	    }    
-	  else
-	    if( i_print ) 
-	      printf("%8X - TRIGGER TIME - (ERROR)\n", data);
-	                
-	  time_last = vftdc_data.time_now;
-	}    
-      break;
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    {
+      perror("mmap");
+      return ERROR;
+    }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
 
-    case 7:
-      vftdc_data.group        = (data & 0x07000000)>>24;
-      vftdc_data.chan         = (data & 0x00f80000)>>19;
-      vftdc_data.edge_type    = (data & 0x00040000)>>18;
-      vftdc_data.time_coarse  = (data & 0x0003ff00)>>8;
-      vftdc_data.two_ns       = (data & 0x00000080)>>7;
-      vftdc_data.time_fine    = (data & 0x0000007f)>>0;
+  rval = vfTDCDecodeParallel((volatile unsigned int *)map,
+			     (int)(st.st_size / sizeof(unsigned int)),
+			     dflag, nthreads, hits);
 
-      printf("%8X - TDC - grp = %d  ch = %2d  edge = %d  coarse = %4d  2ns = %d  fine time = %3d\n", 
-	     data, 
-	     vftdc_data.group,
-	     vftdc_data.chan,
-	     vftdc_data.edge_type,
-	     vftdc_data.time_coarse,
-	     vftdc_data.two_ns,
-	     vftdc_data.time_fine);
-      break;
- 
-    case 4:
-    case 5:
-    case 6:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:		/* UNDEFINED TYPE */
-    case 13:
-      if( i_print ) 
-	printf("%8X - UNDEFINED TYPE = %d\n", data, vftdc_data.type);
-      break;
- 
-    case 14:		/* DATA NOT VALID (no data available) */
-      if( i_print ) 
-	printf("%8X - DATA NOT VALID = %d\n", data, vftdc_data.type);
-      break;
+  munmap(map, st.st_size);
 
-    case 15:		/* FILLER WORD */
-      if( i_print ) 
-	printf("%8X - FILLER WORD = %d\n", data, vftdc_data.type);
-      break;
-    }
-	
-  type_last = vftdc_data.type;	/* save type of current data word */
-		   
-}        
+  return rval;
+}
+#endif /* VXWORKS */
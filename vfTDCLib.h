@@ -24,6 +24,7 @@
 #define VFTDC_INT_LEVEL    5
 
 #define VFTDC_MAX_BOARDS             20
+#define VFTDC_MAX_SLOT               21
 #define VFTDC_MAX_TDC_CHANNELS      192
 #define VFTDC_MAX_DATA_PER_CHANNEL    8
 #define VFTDC_MAX_A32_MEM      0x800000   /* 8 Meg */
@@ -118,6 +119,9 @@ struct vfTDC_struct
 #define VFTDC_ADR32_MBLK_ADDR_MIN_MASK  0x003FC000
 #define VFTDC_ADR32_BASE_MASK           0xFF800000
 
+/* 0x14 blocklevel bits and masks */
+#define VFTDC_BLOCKLEVEL_MASK           0x000000FF
+
 /* 0x1C vmeControl bits and masks */
 #define VFTDC_VMECONTROL_BERR           (1<<0)
 #define VFTDC_VMECONTROL_TOKEN_TESTMODE (1<<1)
@@ -173,6 +177,7 @@ struct vfTDC_struct
 #define VFTDC_CLOCK_INTERNAL    (2)
 #define VFTDC_CLOCK_VXS         (3)
 #define VFTDC_CLOCK_MASK        0x00000003
+#define VFTDC_CLOCK_ALL_MASK    0x000000FF
 
 /* 0x34 blockBuffer bits and masks */
 #define VFTDC_BLOCKBUFFER_BLOCKS_READY_MASK     0x0000FF00
@@ -249,6 +254,27 @@ struct vfTDC_struct
 #define VFTDC_INIT_SKIP                (1<<16)
 #define VFTDC_INIT_USE_ADDRLIST        (1<<17)
 #define VFTDC_INIT_SKIP_FIRMWARE_CHECK (1<<18)
+#define VFTDC_INIT_AUTO_DISCOVER       (1<<19)
+#define VFTDC_INIT_WARM_RESTART        (1<<20)
+
+/* First slot scanned with VFTDC_INIT_AUTO_DISCOVER (slot 1 is the controller) */
+#define VFTDC_DISCOVER_FIRST_SLOT      2
+/* Seconds a VFTDC_INIT_AUTO_DISCOVER probe result of a slot is reused */
+#define VFTDC_DISCOVER_MAX_AGE        60
+
+/* vfTDCReadBlock rflag bits, above the readout mode (0x0F) */
+#define VFTDC_READOUT_TIGHT            (1<<4)
+#define VFTDC_READOUT_AUTORECOVER      (1<<5)
+#define VFTDC_READOUT_ALIGNED          (1<<6)
+#define VFTDC_READOUT_HISTOGRAM        (1<<7)
+#define VFTDC_READOUT_SAMPLE           (1<<8)
+
+/* Destination alignment for VFTDC_READOUT_ALIGNED (cache line) */
+#define VFTDC_ALIGN_BYTES              64
+
+/* Block size history used by vfTDCGetTransferSize */
+#define VFTDC_XFERSIZE_HISTORY         16
+#define VFTDC_XFERSIZE_MARGIN           8
 
 /* vfTDCBlockError values */
 #define VFTDC_BLOCKERROR_NO_ERROR          0
@@ -256,7 +282,222 @@ struct vfTDC_struct
 #define VFTDC_BLOCKERROR_UNKNOWN_BUS_ERROR 2
 #define VFTDC_BLOCKERROR_ZERO_WORD_COUNT   3
 #define VFTDC_BLOCKERROR_DMADONE_ERROR     4
-#define VFTDC_BLOCKERROR_NTYPES            5
+#define VFTDC_BLOCKERROR_DMA_INIT_ERROR    5
+#define VFTDC_BLOCKERROR_INVALID_HEADER    6
+#define VFTDC_BLOCKERROR_UNALIGNED_DEST    7
+#define VFTDC_BLOCKERROR_NTYPES            8
+
+/* Status of a single transfer, from vfTDCReadBlockResult */
+struct vftdc_readout_result
+{
+  int                nwords;    /* Return value of the readout */
+  int                error;     /* VFTDC_BLOCKERROR_* */
+  int                berrSlot;  /* Slot that ended the DMA with a bus error (0: none) */
+  int                dummy;     /* 1 if a dummy word was inserted for alignment */
+  unsigned int       csr;       /* Status register read after the DMA */
+  int                recovered; /* VFTDC_READOUT_AUTORECOVER: 1 recovered, -1 failed */
+  int                order;     /* VFTDC_ORDER_* of the data read */
+};
+
+/* Scaler and status snapshot, from vfTDCGetSnapshot */
+struct vftdc_snapshot_struct
+{
+  int                slot;
+  unsigned int       trig1_scaler;
+  unsigned int       trig2_scaler;
+  unsigned int       sync_scaler;
+  unsigned int       berr_scaler;
+  unsigned int       livetime;
+  unsigned int       busytime;
+  unsigned long long eventCounter;
+  unsigned int       status;       /* FIFO flags and firmware version */
+  unsigned int       blockBuffer;
+  unsigned int       blocksReady;
+  unsigned int       busy;         /* Busy sources and monitor */
+};
+
+/* Crate wide scalers and rates, from vfTDCLatchScalersAll */
+struct vftdc_scaler_struct
+{
+  int                slot;
+  unsigned int       trig1_scaler;
+  unsigned int       trig2_scaler;
+  unsigned int       sync_scaler;
+  unsigned int       berr_scaler;
+  float              trig1_rate;   /* Hz, since the previous latch */
+  float              trig2_rate;
+  float              sync_rate;
+  float              berr_rate;
+};
+
+struct vftdc_crate_scalers_struct
+{
+  unsigned long long timestamp;    /* Host time of the latch (usec) */
+  float              dt;           /* Seconds since the previous latch, 0 if none */
+  int                nboards;
+  struct vftdc_scaler_struct board[VFTDC_MAX_BOARDS];
+};
+
+/* Live/busy time accounting, from vfTDCLiveGet */
+#define VFTDC_LIVE_NSOURCES  16  /* Busy monitor bits 16-31 */
+
+struct vftdc_live_struct
+{
+  int                slot;
+  unsigned int       livetime;          /* Counters at the last sample */
+  unsigned int       busytime;
+  unsigned int       monitor;           /* Busy monitor bits at the last sample */
+  unsigned int       nsamples;
+  float              liveFraction;      /* Last interval */
+  float              runLiveFraction;   /* Since vfTDCLiveStart */
+  unsigned long long liveSum;
+  unsigned long long busySum;
+  unsigned long long busyBySource[VFTDC_LIVE_NSOURCES];
+  unsigned long long busyUnattributed;
+  unsigned int       busyRemainder;     /* Not yet attributed (less than one per source) */
+};
+
+/* Readout instrumentation (library compiled with -DVFTDC_INSTRUMENT) */
+#define VFTDC_INSTR_LOCK_WAIT       0  /* ns waiting for the library mutex */
+#define VFTDC_INSTR_DMA_SETUP       1  /* ns in vmeDmaSend */
+#define VFTDC_INSTR_DMA_WAIT        2  /* ns in vmeDmaDone */
+#define VFTDC_INSTR_XFER_WORDS      3  /* words returned by vfTDCReadBlock */
+#define VFTDC_INSTR_BERR_TERM       4  /* DMA terminated by vfTDC bus error */
+#define VFTDC_INSTR_READBLOCK       5  /* ns in vfTDCReadBlock */
+#define VFTDC_INSTR_BREADY          6  /* ns in vfTDCBReady */
+#define VFTDC_INSTR_NMETRICS        7
+#define VFTDC_INSTR_NBINS          40  /* log2 bins */
+#define VFTDC_INSTR_MAX_THREADS    16
+
+struct vftdc_instr_struct
+{
+  volatile unsigned long long bin[VFTDC_INSTR_NMETRICS][VFTDC_INSTR_NBINS];
+  volatile unsigned long long sum[VFTDC_INSTR_NMETRICS];
+};
+
+/* vfTDCBlockLevelControlConfig modes */
+#define VFTDC_BLCTRL_DISABLE    0
+#define VFTDC_BLCTRL_RECOMMEND  1
+#define VFTDC_BLCTRL_APPLY      2
+
+struct vftdc_blctrl_struct
+{
+  int                mode;
+  int                minBL;
+  int                maxBL;
+  float              cpuBudget;
+  unsigned int       maxBlocksReady;
+  int                applied;
+  /* Measurements since the last sync event */
+  unsigned long long tstart;
+  unsigned long long readoutUsec;
+  unsigned int       nread;
+  unsigned int       maxReady;
+  unsigned int       trig1;
+  int                haveTrig1;
+  /* Results of the last decision */
+  float              rate;
+  float              cpu;
+  int                recommended;
+};
+
+/* Readout buffer pool statistics, from vfTDCPoolGetStats */
+struct vftdc_pool_stats_struct
+{
+  int                nbuffers;
+  int                nbytes;     /* Size of each buffer */
+  int                locked;     /* All buffers locked in memory */
+  int                aligned;    /* All buffers 8 byte aligned */
+  int                cacheAligned; /* All buffers VFTDC_ALIGN_BYTES aligned */
+  volatile int       inUse;      /* Taken with vfTDCPoolGet, not yet freed */
+  volatile int       maxInUse;
+  volatile unsigned int nget;    /* Successful vfTDCPoolGet */
+  volatile unsigned int nfail;   /* vfTDCPoolGet with no free buffer */
+};
+
+/* Settings of one slot from a configuration file (-1: not set) */
+struct vftdc_slot_config_struct
+{
+  int                latency;
+  int                width;
+  int                clock;     /* VFTDC_CLOCK_* */
+  int                trigsrc;   /* VFTDC_TRIGSRC_* */
+  int                sync;      /* VFTDC_SYNC_* */
+};
+
+/* Settings from vfTDCConfigRead */
+struct vftdc_config_struct
+{
+  unsigned int       a32Base;   /* 0: not set */
+  struct vftdc_slot_config_struct slot[VFTDC_MAX_SLOT+1]; /* [0]: all slots */
+};
+
+/* vfTDCCheckConsistency reasons */
+#define VFTDC_CONSIST_OK               0
+#define VFTDC_CONSIST_COUNTER          1
+#define VFTDC_CONSIST_BLOCK            2
+#define VFTDC_CONSIST_EVENT            3
+#define VFTDC_CONSIST_READOUT          4
+#define VFTDC_CONSIST_UNSTABLE         5
+#define VFTDC_CONSIST_NTYPES           6
+#define VFTDC_CONSIST_MAX_TRIES       10  /* Reads of blocks ready around the event counter */
+
+/* Event counters and last block headers of all modules, from vfTDCCheckConsistency */
+struct vftdc_consistency_struct
+{
+  int                nboards;
+  int                slot[VFTDC_MAX_BOARDS];
+  unsigned long long eventCounter[VFTDC_MAX_BOARDS];
+  unsigned int       blocksReady[VFTDC_MAX_BOARDS];
+  unsigned int       blocklevel[VFTDC_MAX_BOARDS];
+  int                valid[VFTDC_MAX_BOARDS];     /* A block header has been read */
+  unsigned int       lastBlock[VFTDC_MAX_BOARDS]; /* Block number of last block read */
+  unsigned int       lastEvent[VFTDC_MAX_BOARDS]; /* Last event number of last block read */
+  int                badSlot;                     /* First divergent module (0: none) */
+  int                reason;                      /* VFTDC_CONSIST_* */
+  unsigned int       value;                       /* Divergent value */
+};
+
+/* Readout stall watchdog alarm types and actions */
+#define VFTDC_STALL_NO_BLOCKS          1  /* Triggers counted, no blocks ready (alarm only) */
+#define VFTDC_STALL_NO_READOUT         2  /* Blocks ready, not read out */
+#define VFTDC_WATCHDOG_ALARM           0
+#define VFTDC_WATCHDOG_RECOVER         1
+
+/* Readout stall alarm, passed to the vfTDCWatchdogConnect routine */
+struct vftdc_stall_struct
+{
+  int                slot;
+  int                type;         /* VFTDC_STALL_* */
+  unsigned int       triggers;     /* Triggers since the last readout progress */
+  unsigned int       blocksReady;
+  unsigned int       blocklevel;
+  unsigned int       nread;        /* Readouts that returned data */
+  unsigned long long stalledUsec;  /* How long the readout has been stalled */
+  int                recoverRequested; /* 1: recovery requested from the readout */
+};
+
+typedef void (*VFTDCSTALLFUNCPTR) (struct vftdc_stall_struct *alarm, unsigned int arg);
+
+/* vfTDCLogEnqueue message codes */
+#define VFTDC_LOG_NOT_INITIALIZED      0
+#define VFTDC_LOG_INVALID_DEST         1
+#define VFTDC_LOG_MBLK_UNSUPPORTED     2
+#define VFTDC_LOG_DMA_INIT_ERROR       3
+#define VFTDC_LOG_UNKNOWN_BERR         4
+#define VFTDC_LOG_TERM_WORDCOUNT       5
+#define VFTDC_LOG_ZERO_WORDCOUNT       6
+#define VFTDC_LOG_DMADONE_ERROR        7
+#define VFTDC_LOG_FIFO_EMPTY           8
+#define VFTDC_LOG_INVALID_HEADER       9
+#define VFTDC_LOG_RECOVERED           10
+#define VFTDC_LOG_RECOVER_FAILED      11
+#define VFTDC_LOG_DESYNC              12
+#define VFTDC_LOG_STALL               13
+#define VFTDC_LOG_UNALIGNED_DEST      14
+#define VFTDC_LOG_NCODES              15  /* Library codes, vfTDCLogRegister adds more */
+#define VFTDC_LOG_MAX_CODES           32
+#define VFTDC_LOG_RING_SIZE         1024  /* Must be a power of 2 */
 
 /* Data types and masks */
 #define VFTDC_DUMMY_DATA             0xf800f7dc
@@ -267,6 +508,106 @@ struct vfTDC_struct
 #define VFTDC_DATA_BLOCK_TRAILER     0x08000000
 #define VFTDC_DATA_BLKNUM_MASK       0x0000003f
 
+/* Data word types, (data & VFTDC_DATA_TYPE_MASK)>>27 */
+#define VFTDC_TYPE_BLOCK_HEADER       0
+#define VFTDC_TYPE_BLOCK_TRAILER      1
+#define VFTDC_TYPE_EVENT_HEADER       2
+#define VFTDC_TYPE_TRIGGER_TIME       3
+#define VFTDC_TYPE_TDC_HIT            7
+#define VFTDC_TYPE_DATA_NOT_VALID    14
+#define VFTDC_TYPE_FILLER            15
+
+/* Byte order of a readout buffer */
+#define VFTDC_ORDER_VME              0  /* As read out (big endian) */
+#define VFTDC_ORDER_HOST             1
+
+/* Buffer of readout data, and its byte order, for vfTDCBufferToHost */
+struct vftdc_buffer_struct
+{
+  volatile unsigned int *data;
+  int                nwords;
+  int                order;     /* VFTDC_ORDER_* */
+};
+
+/* Online histograms, filled with VFTDC_READOUT_HISTOGRAM.
+   Channels are group*32 + channel; the coarse time (10 bits) is binned
+   by 1<<VFTDC_HIST_BIN_SHIFT. */
+#define VFTDC_HIST_NCHAN             192
+#define VFTDC_HIST_BIN_SHIFT         4
+#define VFTDC_HIST_NBINS             (1024>>VFTDC_HIST_BIN_SHIFT)
+
+/* Words in a channel mask (vfTDCSetChannelMask), one bit per channel */
+#define VFTDC_CHANMASK_WORDS         (VFTDC_HIST_NCHAN/32)
+
+struct vftdc_hist_struct
+{
+  unsigned int nblocks;
+  unsigned int nhits;
+  unsigned int occupancy[VFTDC_HIST_NCHAN];
+  unsigned int coarse[VFTDC_HIST_NCHAN][VFTDC_HIST_NBINS];
+};
+
+/* Status published in shared memory by vfTDCShmStart (Linux) */
+#define VFTDC_SHM_NAME               "/vfTDC"
+#define VFTDC_SHM_MAGIC              0x76544443
+#define VFTDC_SHM_VERSION            2
+#define VFTDC_SHM_READ_TRIES         1000
+#define VFTDC_SHM_SNAPSHOT_UPDATES   10    /* Updates between register reads */
+
+struct vftdc_shm_struct
+{
+  /* Set once by vfTDCShmStart */
+  unsigned int       magic;
+  unsigned int       version;
+  unsigned int       size;         /* sizeof(struct vftdc_shm_struct) */
+  unsigned int       period;       /* Update period, ms */
+  volatile unsigned int seq;       /* Odd while an update is copied in */
+  unsigned int       rsvd;
+
+  /* Update */
+  unsigned long long timestamp;    /* vfTDCTimeUsec of the update */
+  unsigned int       nupdates;
+  int                ntdc;
+  int                slotList[VFTDC_MAX_SLOT+1];
+  unsigned int       readCount[VFTDC_MAX_SLOT+1];   /* Readouts that returned data */
+  float              readRate[VFTDC_MAX_SLOT+1];    /* Hz, since the last update */
+  unsigned int       lastEvent[VFTDC_MAX_SLOT+1];   /* Last event number read */
+  unsigned int       blockErrors[VFTDC_MAX_SLOT+1][VFTDC_BLOCKERROR_NTYPES];
+  /* Registers, read every VFTDC_SHM_SNAPSHOT_UPDATES updates at most */
+  unsigned long long snapTimestamp; /* vfTDCTimeUsec of the register read */
+  int                snapUpdate;   /* nupdates of the register read */
+  struct vftdc_snapshot_struct snap[VFTDC_MAX_SLOT+1];
+  float              trig1Rate[VFTDC_MAX_SLOT+1];   /* Hz, since the previous register read */
+  int                histValid;    /* hist: slots with online histograms completed since
+				      the last update (others are empty) */
+  struct vftdc_hist_struct hist[VFTDC_MAX_SLOT+1];
+  int                instrValid;   /* instr: readout latency (VFTDC_INSTRUMENT) */
+  struct vftdc_instr_struct instr;
+};
+
+/* Sampling monitor (vfTDCSampleStart, VFTDC_READOUT_SAMPLE) */
+#define VFTDC_SAMPLE_NBUFFERS        16
+#define VFTDC_SAMPLE_MAX_RATIO       (1<<16)
+
+struct vftdc_sample_stats_struct
+{
+  int                ratio;        /* One block out of ratio is sampled */
+  float              cpuFraction;  /* Sampling thread, last second */
+  float              busyFraction; /* Readout (vfTDCReadBlockResult), last second */
+  unsigned int       nsampled;
+  unsigned int       ndropped;     /* Ring full */
+  unsigned int       ntoolarge;    /* Larger than maxwords */
+  unsigned int       ndecoded;
+  unsigned long long nevents;
+  unsigned long long nhits;
+};
+
+/* vfTDCDecode* dflag bits */
+#define VFTDC_DECODE_SWAP            (1<<0)
+
+/* Maximum number of threads used by vfTDCDecodeParallel */
+#define VFTDC_DECODE_MAX_THREADS     64
+
 struct vftdc_data_struct 
 {
   unsigned int new_type;	
@@ -294,18 +635,125 @@ struct vftdc_data_struct
   unsigned int time_fine;
 };
 
+/* Compact TDC hit, as stored by vfTDCDecodeEvents */
+struct vftdc_hit_struct
+{
+  unsigned char  slot;
+  unsigned char  chan;		/* group*32 + channel (0-191) */
+  unsigned char  edge;
+  unsigned char  rsvd;
+  unsigned int   time;		/* coarse(17:8), two_ns(7), fine(6:0) */
+};
+
+#define VFTDC_HIT_CHAN(_group,_chan)  (((_group)<<5) | (_chan))
+#define VFTDC_HIT_GROUP(_hitchan)     ((_hitchan)>>5)
+#define VFTDC_HIT_TIME_COARSE(_time)  (((_time) & 0x3ff00)>>8)
+#define VFTDC_HIT_TIME_TWO_NS(_time)  (((_time) & 0x80)>>7)
+#define VFTDC_HIT_TIME_FINE(_time)    ((_time) & 0x7f)
+
+/* Event, with its hits as a contiguous span in the same arena */
+struct vftdc_event_struct
+{
+  unsigned int  slot;
+  unsigned int  blk_num;
+  unsigned int  evt_num;
+  unsigned int  time_1;
+  unsigned int  time_2;
+  unsigned int  nhits;
+  struct vftdc_hit_struct *hits;
+};
+
+typedef void (*VFTDCSAMPLEFUNCPTR) (struct vftdc_event_struct *events,
+				   int nevents, unsigned int arg);
+
+/* Bump allocator for vfTDCDecodeEvents.  Hits are taken from the bottom,
+   events from the top; vfTDCArenaReset releases everything at once. */
+struct vftdc_arena_struct
+{
+  char          *base;
+  unsigned int   size;
+  unsigned int   lo;
+  unsigned int   hi;
+};
+
 /* Function prototypes */
+void vfTDCClearDiscoveryCache();
 STATUS vfTDCInit(UINT32 addr, UINT32 addr_inc, int ntdc, int iFlag);
 int  vfTDCCheckAddresses();
 void vfTDCStatus(int id, int pflag);
+int  vfTDCGetSnapshot(int id, struct vftdc_snapshot_struct *snap);
+void vfTDCPrintSnapshot(struct vftdc_snapshot_struct *snap);
+int  vfTDCLatchScalersAll(struct vftdc_crate_scalers_struct *sc,
+			  struct vftdc_crate_scalers_struct *prev);
+void vfTDCPrintScalersAll(struct vftdc_crate_scalers_struct *sc);
+int  vfTDCLiveStart(int period);
+int  vfTDCLiveStop();
+int  vfTDCLiveSample();
+int  vfTDCLiveGet(int id, struct vftdc_live_struct *lt);
+void vfTDCLivePrint();
+int  vfTDCInstrGet(struct vftdc_instr_struct *h);
+void vfTDCInstrPrint();
 int  vfTDCReset(int id);
 int  vfTDCSetBlockLevel(int id, int blockLevel);
 int  vfTDCSetTriggerSource(int id, unsigned int trigmask);
 int  vfTDCSetSyncSource(int id, unsigned int sync);
 int  vfTDCSoftTrig(int id);
 int  vfTDCSetWindowParamters(int id, int latency, int width);
+int  vfTDCSetSoftWindow(int id, int chan, int offset, int width);
+int  vfTDCDisableSoftWindow(int id);
+int  vfTDCSoftWindowApply(volatile unsigned int *data, int nwords, int dflag);
+int  vfTDCSetChannelMask(int id, unsigned int *mask);
+int  vfTDCSetMultiplicityCap(int id, int chan, int maxhits);
+int  vfTDCFilterApply(volatile unsigned int *data, int nwords, int dflag);
+int  vfTDCGetFilterCounts(int id, unsigned int *masked, unsigned int *capped);
+#ifndef VXWORKS
+unsigned int *vfTDCAllocAligned(int nwords);
+DMA_MEM_ID vfTDCPoolCreate(int nbuffers, int nbytes);
+int  vfTDCPoolDelete();
+DMANODE *vfTDCPoolGet();
+void vfTDCPoolFree(DMANODE *node);
+int  vfTDCPoolGetStats(struct vftdc_pool_stats_struct *stats);
+void vfTDCPoolPrintStats();
+#endif
+int  vfTDCConfigRead(const char *filename, struct vftdc_config_struct *cfg);
+int  vfTDCConfigApply(struct vftdc_config_struct *cfg);
 int  vfTDCReadBlockStatus(int pflag);
 int  vfTDCReadBlock(int id, volatile UINT32 *data, int nwrds, int rflag);
+int  vfTDCReadBlockResult(int id, volatile UINT32 *data, int nwrds, int rflag,
+			  struct vftdc_readout_result *result);
+int  vfTDCGetBlockErrorCount(int id, int type);
+void vfTDCPrintBlockErrorCounts(int clear);
+int  vfTDCGetTransferSize(int id);
+int  vfTDCLogRegister(const char *format);
+void vfTDCLogEnqueue(int code, int a1, int a2, int a3);
+int  vfTDCLogStart(int maxPerSecond);
+int  vfTDCLogStop();
+int  vfTDCLogGetCount(int code);
+int  vfTDCGetTightFallbackCount(int id);
+int  vfTDCAlignDestination(volatile unsigned int *data);
+int  vfTDCRecoverReadout(int id);
+int  vfTDCGetRecoverCount(int id);
+int  vfTDCCheckConsistency(struct vftdc_consistency_struct *c, unsigned int maxdiff);
+int  vfTDCPrintConsistency(struct vftdc_consistency_struct *c);
+int  vfTDCWatchdogConnect(VFTDCSTALLFUNCPTR routine, unsigned int arg);
+int  vfTDCWatchdogStart(int timeout, int action);
+int  vfTDCWatchdogStop();
+int  vfTDCGetWatchdogAlarmCount(int id);
+int  vfTDCHistInit();
+void vfTDCHistFree();
+int  vfTDCHistFill(int id, volatile unsigned int *data, int nwords);
+struct vftdc_hist_struct *vfTDCHistSwap(int timeout);
+int  vfTDCSampleConnect(VFTDCSAMPLEFUNCPTR routine, unsigned int arg);
+int  vfTDCSampleStart(int ratio, float cpuBudget, int maxwords);
+int  vfTDCSampleStop();
+int  vfTDCSampleGetStats(struct vftdc_sample_stats_struct *stats);
+void vfTDCSamplePrintStats();
+#ifndef VXWORKS
+int  vfTDCShmStart(const char *name, int period);
+int  vfTDCShmStop();
+int  vfTDCShmRead(const char *name, struct vftdc_shm_struct *copy);
+#endif
+int  vfTDCHistPrint(int id, struct vftdc_hist_struct *hist);
 int  vfTDCEnableBusError(int id);
 int  vfTDCDisableBusError(int id);
 int  vfTDCSyncReset(int id);
@@ -318,6 +766,28 @@ int  vfTDCSetClockSource(int id, unsigned int source);
 int  vfTDCGetClockSource(int id);
 int  vfTDCGetGeoAddress(int id);
 void vfTDCDataDecode(unsigned int data);
+int  vfTDCBlockLevelControlConfig(int mode, int minBL, int maxBL,
+				  float cpuBudget, int maxBlocksReady);
+int  vfTDCBlockLevelControlSyncEvent(int currentBL);
+int  vfTDCBlockLevelControlApply();
+void vfTDCBlockLevelControlStatus();
+int  vfTDCSwapBuffer(volatile unsigned int *dst, volatile unsigned int *src, int nwords);
+int  vfTDCBufferToHost(struct vftdc_buffer_struct *buf);
+int  vfTDCBufferToVME(struct vftdc_buffer_struct *buf);
+int  vfTDCBufferDecodeFlag(struct vftdc_buffer_struct *buf);
+int  vfTDCDecodeBlock(volatile unsigned int *data, int nwords, int dflag,
+		      struct vftdc_data_struct *hits, int maxhits);
+int  vfTDCArenaInit(struct vftdc_arena_struct *arena, void *mem, unsigned int nbytes);
+void vfTDCArenaReset(struct vftdc_arena_struct *arena);
+int  vfTDCDecodeEvents(volatile unsigned int *data, int nwords, int dflag,
+		       struct vftdc_arena_struct *arena,
+		       struct vftdc_event_struct **events);
+#ifndef VXWORKS
+int  vfTDCDecodeParallel(volatile unsigned int *data, int nwords, int dflag,
+			 int nthreads, struct vftdc_data_struct **hits);
+int  vfTDCDecodeFileParallel(const char *filename, int dflag, int nthreads,
+			     struct vftdc_data_struct **hits);
+#endif
 
 
 #endif /* VFTDCLIB_H */